@@ -1,31 +1,156 @@
 ﻿#include "HeliMathLibrary.h"
 
-#include "Kismet/KismetMathLibrary.h"
+#include "Heli/LogHeli.h"
 
-float UHeliMathLibrary::GetRotationAroundAxis(const FRotator& Rotator, const FVector& Axis)
+namespace HeliMath
 {
-	const FQuat Quat = Rotator.Quaternion();
+	// Twist of a quaternion is the angle of (W, dot(Axis, XYZ)) pair doubled, rotating around Axis rotates the pair.
+	// Rotation that takes the pair to the wanted angle is their complex quotient, no angle of the current twist needed
+	FORCEINLINE FQuat SetTwist(const FQuat& Quat, const FVector& Axis, double SinHalfAngle, double CosHalfAngle)
+	{
+		const double W = Quat.W;
+		const double D = Axis.X * Quat.X + Axis.Y * Quat.Y + Axis.Z * Quat.Z;
+		const double LengthSquared = W * W + D * D;
+
+		// Swing of 180 degrees, twist is undefined and any rotation around Axis sets it
+		if(LengthSquared < UE_SMALL_NUMBER)
+			return FQuat(Axis * SinHalfAngle, CosHalfAngle) * Quat;
+
+		const double InvLength = FMath::InvSqrt(LengthSquared);
+		const double Cos = (W * CosHalfAngle + D * SinHalfAngle) * InvLength;
+		const double Sin = (W * SinHalfAngle - D * CosHalfAngle) * InvLength;
+
+		return FQuat(Axis.X * Sin, Axis.Y * Sin, Axis.Z * Sin, Cos) * Quat;
+	}
+
+	// The same in vector registers for batches. Axis4 is Axis with zero W, UnitW is (0, 0, 0, 1)
+	FORCEINLINE void SetTwist(FQuat& Quat, const FVector& Axis, const VectorRegister4Double& Axis4,
+		const VectorRegister4Double& UnitW, const VectorRegister4Double& SinHalfAngle, const VectorRegister4Double& CosHalfAngle)
+	{
+		const VectorRegister4Double Q = VectorLoad(&Quat.X);
+		const VectorRegister4Double W = VectorReplicate(Q, 3);
+		const VectorRegister4Double D = VectorDot3(Q, Axis4);
+		const VectorRegister4Double LengthSquared = VectorMultiplyAdd(W, W, VectorMultiply(D, D));
+
+		// Rare enough to take the scalar path
+		if(VectorGetComponent(LengthSquared, 0) < UE_SMALL_NUMBER)
+		{
+			Quat = SetTwist(Quat, Axis, VectorGetComponent(SinHalfAngle, 0), VectorGetComponent(CosHalfAngle, 0));
+			return;
+		}
 
-	return FMath::RadiansToDegrees(Quat.GetTwistAngle(Axis));
+		const VectorRegister4Double InvLength = VectorReciprocalSqrtAccurate(LengthSquared);
+		const VectorRegister4Double Cos = VectorMultiply(VectorMultiplyAdd(W, CosHalfAngle, VectorMultiply(D, SinHalfAngle)), InvLength);
+		const VectorRegister4Double Sin = VectorMultiply(VectorNegateMultiplyAdd(D, CosHalfAngle, VectorMultiply(W, SinHalfAngle)), InvLength);
+		const VectorRegister4Double Delta = VectorMultiplyAdd(Axis4, Sin, VectorMultiply(UnitW, Cos));
+
+		VectorStore(VectorQuaternionMultiply2(Delta, Q), &Quat.X);
+	}
+}
+
+float UHeliMathLibrary::GetTwistAngle(const FQuat& Quat, const FVector& Axis)
+{
+	return Quat.GetTwistAngle(Axis);
+}
+
+FQuat UHeliMathLibrary::SetTwistAngle(const FQuat& Quat, const FVector& Axis, float Angle)
+{
+	double SinHalfAngle, CosHalfAngle;
+	FMath::SinCos(&SinHalfAngle, &CosHalfAngle, 0.5 * Angle);
+
+	return HeliMath::SetTwist(Quat, Axis, SinHalfAngle, CosHalfAngle);
+}
+
+FQuat UHeliMathLibrary::ClampTwistAngle(const FQuat& Quat, const FVector& Axis, float Min, float Max)
+{
+	const float Angle = GetTwistAngle(Quat, Axis);
+	const float ClampedAngle = FMath::Clamp(Angle, Min, Max);
+
+	if(ClampedAngle == Angle)
+		return Quat;
+
+	return SetTwistAngle(Quat, Axis, ClampedAngle);
+}
+
+void UHeliMathLibrary::GetTwistAngles(TConstArrayView<FQuat> Quats, const FVector& Axis, TArrayView<float> OutAngles)
+{
+	if(Quats.Num() != OutAngles.Num())
+	{
+		HELI_ERR("Can't get %d twist angles into %d floats", Quats.Num(), OutAngles.Num());
+		return;
+	}
+
+	for(int32 Index = 0; Index < Quats.Num(); ++Index)
+	{
+		OutAngles[Index] = Quats[Index].GetTwistAngle(Axis);
+	}
+}
+
+void UHeliMathLibrary::SetTwistAngles(TArrayView<FQuat> Quats, const FVector& Axis, TConstArrayView<float> Angles)
+{
+	if(Quats.Num() != Angles.Num())
+	{
+		HELI_ERR("Can't set twist of %d quaternions from %d angles", Quats.Num(), Angles.Num());
+		return;
+	}
+
+	const VectorRegister4Double Axis4 = MakeVectorRegisterDouble(Axis.X, Axis.Y, Axis.Z, 0.0);
+	const VectorRegister4Double UnitW = MakeVectorRegisterDouble(0.0, 0.0, 0.0, 1.0);
+
+	for(int32 Index = 0; Index < Quats.Num(); ++Index)
+	{
+		double SinHalfAngle, CosHalfAngle;
+		FMath::SinCos(&SinHalfAngle, &CosHalfAngle, 0.5 * Angles[Index]);
+
+		HeliMath::SetTwist(Quats[Index], Axis, Axis4, UnitW, VectorSetFloat1(SinHalfAngle), VectorSetFloat1(CosHalfAngle));
+	}
+}
+
+void UHeliMathLibrary::ClampTwistAngles(TArrayView<FQuat> Quats, const FVector& Axis, float Min, float Max)
+{
+	// Only two angles can come out of a clamp, so sin and cos of them are computed once for the whole batch
+	double SinHalfMin, CosHalfMin, SinHalfMax, CosHalfMax;
+	FMath::SinCos(&SinHalfMin, &CosHalfMin, 0.5 * Min);
+	FMath::SinCos(&SinHalfMax, &CosHalfMax, 0.5 * Max);
+
+	const VectorRegister4Double Axis4 = MakeVectorRegisterDouble(Axis.X, Axis.Y, Axis.Z, 0.0);
+	const VectorRegister4Double UnitW = MakeVectorRegisterDouble(0.0, 0.0, 0.0, 1.0);
+	const VectorRegister4Double SinHalfMin4 = VectorSetFloat1(SinHalfMin);
+	const VectorRegister4Double CosHalfMin4 = VectorSetFloat1(CosHalfMin);
+	const VectorRegister4Double SinHalfMax4 = VectorSetFloat1(SinHalfMax);
+	const VectorRegister4Double CosHalfMax4 = VectorSetFloat1(CosHalfMax);
+
+	for(FQuat& Quat : Quats)
+	{
+		const float Angle = Quat.GetTwistAngle(Axis);
+
+		if(Angle < Min)
+			HeliMath::SetTwist(Quat, Axis, Axis4, UnitW, SinHalfMin4, CosHalfMin4);
+		else if(Angle > Max)
+			HeliMath::SetTwist(Quat, Axis, Axis4, UnitW, SinHalfMax4, CosHalfMax4);
+	}
+}
+
+float UHeliMathLibrary::GetRotationAroundAxis(const FRotator& Rotator, const FVector& Axis)
+{
+	return FMath::RadiansToDegrees(GetTwistAngle(Rotator.Quaternion(), Axis.GetSafeNormal()));
 }
 
 void UHeliMathLibrary::SetRotationAroundAxis(FRotator& Rotator, const FVector& Axis, float Angle)
 {
-	const float CurrentRotation = GetRotationAroundAxis(Rotator, Axis);
-	const float AngleDelta = Angle - CurrentRotation;
-	
-	const FRotator DeltaRotation = UKismetMathLibrary::RotatorFromAxisAndAngle(
-		Axis,
-		AngleDelta
-	);
+	const FQuat Quat = SetTwistAngle(Rotator.Quaternion(), Axis.GetSafeNormal(), FMath::DegreesToRadians(Angle));
 
-	Rotator = UKismetMathLibrary::ComposeRotators(Rotator, DeltaRotation);
+	Rotator = Quat.Rotator();
 }
 
 void UHeliMathLibrary::ClampVelocityAroundAxis(FRotator& Rotator, const FVector& Axis, float Min, float Max)
 {
-	const float Current = GetRotationAroundAxis(Rotator, Axis);
-	const float Target = FMath::Clamp(Current, Min, Max);
+	const FQuat Quat = ClampTwistAngle(
+		Rotator.Quaternion(),
+		Axis.GetSafeNormal(),
+		FMath::DegreesToRadians(Min),
+		FMath::DegreesToRadians(Max)
+	);
 
-	SetRotationAroundAxis(Rotator, Axis, Target);
+	Rotator = Quat.Rotator();
 }
@@ -14,6 +14,27 @@ class HELI_API UHeliMathLibrary : public UBlueprintFunctionLibrary
 
 public:
 
+	// Twist is the part of rotation around Axis, the rest is swing. Angles are in radians and unwound to [-PI, PI],
+	// Axis must be normalized. Setting twist rotates around Axis in world space and keeps swing as it is
+
+	static float GetTwistAngle(const FQuat& Quat, const FVector& Axis);
+
+	static FQuat SetTwistAngle(const FQuat& Quat, const FVector& Axis, float Angle);
+
+	static FQuat ClampTwistAngle(const FQuat& Quat, const FVector& Axis, float Min, float Max);
+
+	// Batch versions for many bodies at once, e.g. rotor blades or ghost samples. Set and clamp do the quaternion math
+	// in vector registers, get is a dot product and an atan2 per quaternion either way
+
+	static void GetTwistAngles(TConstArrayView<FQuat> Quats, const FVector& Axis, TArrayView<float> OutAngles);
+
+	// Angles holds one angle per quaternion
+	static void SetTwistAngles(TArrayView<FQuat> Quats, const FVector& Axis, TConstArrayView<float> Angles);
+
+	static void ClampTwistAngles(TArrayView<FQuat> Quats, const FVector& Axis, float Min, float Max);
+
+	// Blueprint versions of the above, in degrees and for any axis length
+
 	UFUNCTION(BlueprintCallable)
 	static float GetRotationAroundAxis(const FRotator& Rotator, const FVector& Axis);
 
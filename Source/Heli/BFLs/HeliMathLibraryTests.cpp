@@ -0,0 +1,309 @@
+﻿#include "HeliMathLibrary.h"
+
+#include "Kismet/KismetMathLibrary.h"
+#include "Math/RandomStream.h"
+#include "Misc/AutomationTest.h"
+
+#if WITH_DEV_AUTOMATION_TESTS
+
+namespace HeliMathTests
+{
+	constexpr int32 NumAccuracyCases { 10000 };
+	constexpr int32 NumSpeedCases { 200000 };
+
+	// Rotator round trips lose a bit near pitch of 90 degrees, quaternion paths shouldn't lose anything
+	constexpr double RotatorTolerance { 1e-3 };
+	constexpr double QuatTolerance { 1e-5 };
+	// Batches differ from single calls by rounding only. Quaternions are compared as 1 - |dot|,
+	// AngularDistance is already about 1e-8 for equal ones that are a few ulps off unit length
+	constexpr double BatchTolerance { 1e-6 };
+
+	struct FCase
+	{
+		FQuat Quat { FQuat::Identity };
+		float Angle { 0.f };
+	};
+
+	// Random rotations and target twists in radians. Batches take one axis, so the axis is shared
+	TArray<FCase> MakeCases(int32 Num, FRandomStream& Stream)
+	{
+		TArray<FCase> Cases {};
+		Cases.SetNum(Num);
+
+		for(FCase& Case : Cases)
+		{
+			Case.Quat = FQuat(Stream.VRand(), Stream.FRandRange(-UE_PI, UE_PI));
+			Case.Angle = Stream.FRandRange(-UE_PI, UE_PI);
+		}
+
+		return Cases;
+	}
+
+	// What the library did before it had quaternion functions, in degrees
+	FRotator OldSetRotationAroundAxis(const FRotator& Rotator, const FVector& Axis, float Angle)
+	{
+		const float CurrentRotation = FMath::RadiansToDegrees(Rotator.Quaternion().GetTwistAngle(Axis));
+		const FRotator DeltaRotation = UKismetMathLibrary::RotatorFromAxisAndAngle(Axis, Angle - CurrentRotation);
+
+		return UKismetMathLibrary::ComposeRotators(Rotator, DeltaRotation);
+	}
+
+	FRotator OldClampVelocityAroundAxis(const FRotator& Rotator, const FVector& Axis, float Min, float Max)
+	{
+		const float Current = FMath::RadiansToDegrees(Rotator.Quaternion().GetTwistAngle(Axis));
+
+		return OldSetRotationAroundAxis(Rotator, Axis, FMath::Clamp(Current, Min, Max));
+	}
+
+	// The same delta composition without rotators, in radians
+	FQuat OldSetTwistAngle(const FQuat& Quat, const FVector& Axis, float Angle)
+	{
+		return FQuat(Axis, Angle - Quat.GetTwistAngle(Axis)) * Quat;
+	}
+
+	FQuat OldClampTwistAngle(const FQuat& Quat, const FVector& Axis, float Min, float Max)
+	{
+		return OldSetTwistAngle(Quat, Axis, FMath::Clamp<float>(Quat.GetTwistAngle(Axis), Min, Max));
+	}
+
+	// Nanoseconds per case
+	double Measure(int32 Num, TFunctionRef<void()> Function)
+	{
+		const double StartSeconds = FPlatformTime::Seconds();
+		Function();
+
+		return (FPlatformTime::Seconds() - StartSeconds) * 1e9 / Num;
+	}
+
+	// Zero for the same rotation, sign of the quaternion doesn't matter
+	double QuatDifference(const FQuat& A, const FQuat& B)
+	{
+		return 1.0 - FMath::Abs(A | B);
+	}
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(
+	FHeliMathTwistAccuracyTest,
+	"Heli.Math.Twist.Accuracy",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter
+)
+
+bool FHeliMathTwistAccuracyTest::RunTest(const FString& Parameters)
+{
+	using namespace HeliMathTests;
+
+	FRandomStream Stream { 0 };
+	const FVector Axis = Stream.VRand();
+	const float Min = -0.25f * UE_PI;
+	const float Max = 0.5f * UE_PI;
+
+	const TArray<FCase> Cases = MakeCases(NumAccuracyCases, Stream);
+
+	double MaxRotatorSetError = 0.0;
+	double MaxRotatorClampError = 0.0;
+	double MaxSetError = 0.0;
+	double MaxClampError = 0.0;
+	double MaxTwistError = 0.0;
+
+	TArray<FQuat> Quats {};
+	TArray<float> Angles {};
+	TArray<FQuat> SetQuats {};
+	TArray<FQuat> ClampedQuats {};
+
+	for(const FCase& Case : Cases)
+	{
+		const FRotator Rotator = Case.Quat.Rotator();
+		const float AngleDegrees = FMath::RadiansToDegrees(Case.Angle);
+
+		FRotator NewRotator = Rotator;
+		UHeliMathLibrary::SetRotationAroundAxis(NewRotator, Axis, AngleDegrees);
+		MaxRotatorSetError = FMath::Max(MaxRotatorSetError,
+			NewRotator.Quaternion().AngularDistance(OldSetRotationAroundAxis(Rotator, Axis, AngleDegrees).Quaternion()));
+
+		FRotator ClampedRotator = Rotator;
+		UHeliMathLibrary::ClampVelocityAroundAxis(ClampedRotator, Axis, FMath::RadiansToDegrees(Min), FMath::RadiansToDegrees(Max));
+		MaxRotatorClampError = FMath::Max(MaxRotatorClampError, ClampedRotator.Quaternion().AngularDistance(
+			OldClampVelocityAroundAxis(Rotator, Axis, FMath::RadiansToDegrees(Min), FMath::RadiansToDegrees(Max)).Quaternion()));
+
+		const FQuat SetQuat = UHeliMathLibrary::SetTwistAngle(Case.Quat, Axis, Case.Angle);
+		MaxSetError = FMath::Max(MaxSetError, SetQuat.AngularDistance(OldSetTwistAngle(Case.Quat, Axis, Case.Angle)));
+		MaxTwistError = FMath::Max(MaxTwistError,
+			static_cast<double>(FMath::Abs(FMath::UnwindRadians(UHeliMathLibrary::GetTwistAngle(SetQuat, Axis) - Case.Angle))));
+
+		const FQuat ClampedQuat = UHeliMathLibrary::ClampTwistAngle(Case.Quat, Axis, Min, Max);
+		MaxClampError = FMath::Max(MaxClampError, ClampedQuat.AngularDistance(OldClampTwistAngle(Case.Quat, Axis, Min, Max)));
+
+		Quats.Add(Case.Quat);
+		Angles.Add(Case.Angle);
+		SetQuats.Add(SetQuat);
+		ClampedQuats.Add(ClampedQuat);
+	}
+
+	TestTrue(FString::Printf(TEXT("SetRotationAroundAxis matches old one, max error %g rad"), MaxRotatorSetError),
+		MaxRotatorSetError <= RotatorTolerance);
+	TestTrue(FString::Printf(TEXT("ClampVelocityAroundAxis matches old one, max error %g rad"), MaxRotatorClampError),
+		MaxRotatorClampError <= RotatorTolerance);
+	TestTrue(FString::Printf(TEXT("SetTwistAngle matches delta composition, max error %g rad"), MaxSetError),
+		MaxSetError <= QuatTolerance);
+	TestTrue(FString::Printf(TEXT("ClampTwistAngle matches delta composition, max error %g rad"), MaxClampError),
+		MaxClampError <= QuatTolerance);
+	TestTrue(FString::Printf(TEXT("SetTwistAngle sets the twist, max error %g rad"), MaxTwistError),
+		MaxTwistError <= QuatTolerance);
+
+	// Batches have to give what single calls give
+	TArray<float> BatchAngles {};
+	BatchAngles.SetNumZeroed(Quats.Num());
+	UHeliMathLibrary::GetTwistAngles(Quats, Axis, BatchAngles);
+
+	TArray<FQuat> BatchSetQuats = Quats;
+	UHeliMathLibrary::SetTwistAngles(BatchSetQuats, Axis, Angles);
+
+	TArray<FQuat> BatchClampedQuats = Quats;
+	UHeliMathLibrary::ClampTwistAngles(BatchClampedQuats, Axis, Min, Max);
+
+	double MaxBatchGetError = 0.0;
+	double MaxBatchSetError = 0.0;
+	double MaxBatchClampError = 0.0;
+
+	for(int32 Index = 0; Index < Quats.Num(); ++Index)
+	{
+		MaxBatchGetError = FMath::Max(MaxBatchGetError,
+			static_cast<double>(FMath::Abs(BatchAngles[Index] - UHeliMathLibrary::GetTwistAngle(Quats[Index], Axis))));
+		MaxBatchSetError = FMath::Max(MaxBatchSetError, QuatDifference(BatchSetQuats[Index], SetQuats[Index]));
+		MaxBatchClampError = FMath::Max(MaxBatchClampError, QuatDifference(BatchClampedQuats[Index], ClampedQuats[Index]));
+	}
+
+	TestTrue(FString::Printf(TEXT("GetTwistAngles matches GetTwistAngle, max error %g rad"), MaxBatchGetError),
+		MaxBatchGetError <= BatchTolerance);
+	TestTrue(FString::Printf(TEXT("SetTwistAngles matches SetTwistAngle, max 1 - |dot| %g"), MaxBatchSetError),
+		MaxBatchSetError <= BatchTolerance);
+	TestTrue(FString::Printf(TEXT("ClampTwistAngles matches ClampTwistAngle, max 1 - |dot| %g"), MaxBatchClampError),
+		MaxBatchClampError <= BatchTolerance);
+
+	// Twist of a 180 degree swing is undefined, setting it still has to give a valid rotation around the axis
+	const FQuat FlippedQuat = FQuat(FVector::CrossProduct(Axis, Axis.GetAbs().X < 0.9 ? FVector::XAxisVector : FVector::YAxisVector)
+		.GetSafeNormal(), UE_PI);
+	const FQuat FlippedSetQuat = UHeliMathLibrary::SetTwistAngle(FlippedQuat, Axis, 1.f);
+	TestTrue(TEXT("SetTwistAngle of a 180 degree swing is normalized"), FlippedSetQuat.IsNormalized());
+
+	return true;
+}
+
+IMPLEMENT_SIMPLE_AUTOMATION_TEST(
+	FHeliMathTwistSpeedTest,
+	"Heli.Math.Twist.Speed",
+	EAutomationTestFlags::ApplicationContextMask | EAutomationTestFlags::ProductFilter
+)
+
+bool FHeliMathTwistSpeedTest::RunTest(const FString& Parameters)
+{
+	using namespace HeliMathTests;
+
+	FRandomStream Stream { 1 };
+	const FVector Axis = Stream.VRand();
+	const float Min = -0.25f * UE_PI;
+	const float Max = 0.5f * UE_PI;
+
+	const TArray<FCase> Cases = MakeCases(NumSpeedCases, Stream);
+
+	TArray<FQuat> Quats {};
+	TArray<float> Angles {};
+	TArray<FRotator> Rotators {};
+
+	for(const FCase& Case : Cases)
+	{
+		Quats.Add(Case.Quat);
+		Angles.Add(Case.Angle);
+		Rotators.Add(Case.Quat.Rotator());
+	}
+
+	TArray<FQuat> Results {};
+	Results.SetNumUninitialized(NumSpeedCases);
+
+	TArray<FRotator> RotatorResults = Rotators;
+
+	// Results are summed at the end, so none of the loops can be optimized away
+	double Checksum = 0.0;
+
+	const double OldRotatorSet = Measure(NumSpeedCases, [&]
+	{
+		for(int32 Index = 0; Index < NumSpeedCases; ++Index)
+		{
+			RotatorResults[Index] = OldSetRotationAroundAxis(Rotators[Index], Axis, FMath::RadiansToDegrees(Angles[Index]));
+		}
+	});
+	Checksum += RotatorResults.Last().Yaw;
+
+	const double NewRotatorSet = Measure(NumSpeedCases, [&]
+	{
+		for(int32 Index = 0; Index < NumSpeedCases; ++Index)
+		{
+			RotatorResults[Index] = Rotators[Index];
+			UHeliMathLibrary::SetRotationAroundAxis(RotatorResults[Index], Axis, FMath::RadiansToDegrees(Angles[Index]));
+		}
+	});
+	Checksum += RotatorResults.Last().Yaw;
+
+	const double OldSet = Measure(NumSpeedCases, [&]
+	{
+		for(int32 Index = 0; Index < NumSpeedCases; ++Index)
+		{
+			Results[Index] = OldSetTwistAngle(Quats[Index], Axis, Angles[Index]);
+		}
+	});
+	Checksum += Results.Last().W;
+
+	const double NewSet = Measure(NumSpeedCases, [&]
+	{
+		for(int32 Index = 0; Index < NumSpeedCases; ++Index)
+		{
+			Results[Index] = UHeliMathLibrary::SetTwistAngle(Quats[Index], Axis, Angles[Index]);
+		}
+	});
+	Checksum += Results.Last().W;
+
+	// Batches work in place
+	Results = Quats;
+	const double BatchSet = Measure(NumSpeedCases, [&]
+	{
+		UHeliMathLibrary::SetTwistAngles(Results, Axis, Angles);
+	});
+	Checksum += Results.Last().W;
+
+	const double OldClamp = Measure(NumSpeedCases, [&]
+	{
+		for(int32 Index = 0; Index < NumSpeedCases; ++Index)
+		{
+			Results[Index] = OldClampTwistAngle(Quats[Index], Axis, Min, Max);
+		}
+	});
+	Checksum += Results.Last().W;
+
+	const double NewClamp = Measure(NumSpeedCases, [&]
+	{
+		for(int32 Index = 0; Index < NumSpeedCases; ++Index)
+		{
+			Results[Index] = UHeliMathLibrary::ClampTwistAngle(Quats[Index], Axis, Min, Max);
+		}
+	});
+	Checksum += Results.Last().W;
+
+	// Batches work in place
+	Results = Quats;
+	const double BatchClamp = Measure(NumSpeedCases, [&]
+	{
+		UHeliMathLibrary::ClampTwistAngles(Results, Axis, Min, Max);
+	});
+	Checksum += Results.Last().W;
+
+	AddInfo(FString::Printf(TEXT("Rotator set: old %.1f ns, new %.1f ns"), OldRotatorSet, NewRotatorSet));
+	AddInfo(FString::Printf(TEXT("Quat set: old %.1f ns, new %.1f ns, batch %.1f ns"), OldSet, NewSet, BatchSet));
+	AddInfo(FString::Printf(TEXT("Quat clamp: old %.1f ns, new %.1f ns, batch %.1f ns"), OldClamp, NewClamp, BatchClamp));
+
+	// Timings depend on the machine, only sanity of the results is checked
+	TestTrue(TEXT("Results are finite"), FMath::IsFinite(Checksum));
+
+	return true;
+}
+
+#endif
@@ -0,0 +1,158 @@
+﻿#include "HelicopterEnvelopeCommandlet.h"
+
+#include "Async/ParallelFor.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "Heli/LogHeli.h"
+#include "Heli/Vehicles/Helicopters/HelicopterDefinition.h"
+#include "Heli/Vehicles/Helicopters/HelicopterFlightModel.h"
+#include "Misc/PackageName.h"
+#include "UObject/SavePackage.h"
+
+UHelicopterEnvelopeCommandlet::UHelicopterEnvelopeCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 UHelicopterEnvelopeCommandlet::Main(const FString& Params)
+{
+	// Saving packages is possible only in editor builds
+#if WITH_EDITOR
+	FString DefinitionName {};
+	FParse::Value(*Params, TEXT("Definition="), DefinitionName);
+	
+	int32 NumMassSteps = 9;
+	FParse::Value(*Params, TEXT("MassSteps="), NumMassSteps);
+
+	int32 NumPitchSteps = 16;
+	FParse::Value(*Params, TEXT("PitchSteps="), NumPitchSteps);
+
+	float MaxPitch = 30.f;
+	FParse::Value(*Params, TEXT("MaxPitch="), MaxPitch);
+
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>(TEXT("AssetRegistry")).Get();
+	AssetRegistry.SearchAllAssets(true);
+
+	TArray<FAssetData> Assets {};
+	AssetRegistry.GetAssetsByClass(UHelicopterDefinition::StaticClass()->GetClassPathName(), Assets, true);
+
+	int32 NumFailed = 0;
+	
+	for(const FAssetData& Asset : Assets)
+	{
+		if(!DefinitionName.IsEmpty() && Asset.AssetName.ToString() != DefinitionName)
+			continue;
+
+		UHelicopterDefinition* Definition = Cast<UHelicopterDefinition>(Asset.GetAsset());
+		if(!Definition)
+		{
+			HELI_ERR("Can't load helicopter definition %s", *Asset.GetObjectPathString());
+			++NumFailed;
+			continue;
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+		
+		Definition->FlightEnvelope = BakeEnvelope(*Definition, NumMassSteps, NumPitchSteps, MaxPitch);
+		Definition->MarkPackageDirty();
+
+		UPackage* Package = Definition->GetPackage();
+		const FString Filename = FPackageName::LongPackageNameToFilename(
+			Package->GetName(),
+			FPackageName::GetAssetPackageExtension()
+		);
+
+		FSavePackageArgs SaveArgs {};
+		SaveArgs.TopLevelFlags = RF_Public | RF_Standalone;
+		
+		if(!UPackage::SavePackage(Package, Definition, *Filename, SaveArgs))
+		{
+			HELI_ERR("Can't save %s", *Filename);
+			++NumFailed;
+			continue;
+		}
+
+		HELI_WRN("Baked flight envelope of %s in %.2fs", *Definition->GetName(), FPlatformTime::Seconds() - StartTime);
+	}
+
+	return NumFailed == 0 ? 0 : 1;
+#else
+	HELI_ERR("Helicopter envelope can be baked only in editor builds");
+	return 1;
+#endif
+}
+
+FHelicopterFlightEnvelope UHelicopterEnvelopeCommandlet::BakeEnvelope(const UHelicopterDefinition& Definition,
+	int32 NumMassSteps, int32 NumPitchSteps, float MaxPitch)
+{
+	const FPhysicsData& PhysicsData = Definition.PhysicsData;
+	
+	FHelicopterFlightCurves Curves {};
+	Curves.Resolve(PhysicsData, Definition.RotationData, true);
+
+	const FHelicopterFlightModel Model { PhysicsData, Curves };
+
+	NumMassSteps = FMath::Max(NumMassSteps, 1);
+	NumPitchSteps = FMath::Max(NumPitchSteps, 2);
+	
+	FHelicopterFlightEnvelope Envelope {};
+	Envelope.MinMassKg = PhysicsData.MassKg;
+	Envelope.MassStepKg = NumMassSteps > 1 ? PhysicsData.MaxAdditionalMassKg / (NumMassSteps - 1) : 0.f;
+	Envelope.NumMassSteps = NumMassSteps;
+	Envelope.PitchStep = MaxPitch / (NumPitchSteps - 1);
+	Envelope.NumPitchSteps = NumPitchSteps;
+
+	Envelope.HoverCollective.SetNumZeroed(NumMassSteps);
+	Envelope.MaxClimbRate.SetNumZeroed(NumMassSteps);
+	Envelope.MaxForwardSpeed.SetNumZeroed(NumMassSteps);
+	Envelope.TrimCollective.SetNumZeroed(NumMassSteps * NumPitchSteps);
+	Envelope.TrimForwardSpeed.SetNumZeroed(NumMassSteps * NumPitchSteps);
+
+	// Rows don't depend on each other, model only reads curves
+	ParallelFor(NumMassSteps, [&](int32 Row)
+	{
+		const float MassKg = Envelope.MinMassKg + Envelope.MassStepKg * Row;
+		const FVector LevelUpVector = FHelicopterFlightModel::GetUpVectorForPitch(0.f);
+
+		// Negative when helicopter can't hover at the mass, like trim collective
+		Envelope.HoverCollective[Row] = Model.SolveLevelCollective(LevelUpVector, MassKg);
+		Envelope.MaxClimbRate[Row] = Model.SolveSteadyVelocity(LevelUpVector, 1.f, MassKg).Z;
+
+		float MaxForwardSpeed = 0.f;
+		
+		for(int32 Column = 0; Column < NumPitchSteps; ++Column)
+		{
+			const int32 Index = Row * NumPitchSteps + Column;
+			const FVector UpVector = FHelicopterFlightModel::GetUpVectorForPitch(Column * Envelope.PitchStep);
+			
+			const float Collective = Model.SolveLevelCollective(UpVector, MassKg);
+			
+			Envelope.TrimCollective[Index] = Collective;
+			Envelope.TrimForwardSpeed[Index] = Collective >= 0.f
+				? Model.SolveSteadyVelocity(UpVector, Collective, MassKg).X
+				: 0.f;
+
+			if(Collective >= 0.f)
+				MaxForwardSpeed = FMath::Max(MaxForwardSpeed, Envelope.TrimForwardSpeed[Index]);
+		}
+
+		Envelope.MaxForwardSpeed[Row] = MaxForwardSpeed;
+	});
+
+	// Rows are ordered by mass, helicopter that can't hover at one mass can't hover at any heavier one either
+	const int32 FirstRowWithoutHover = Envelope.HoverCollective.IndexOfByPredicate([](float Collective) { return Collective < 0.f; });
+
+	if(FirstRowWithoutHover != INDEX_NONE)
+	{
+		HELI_WRN("%s can't hover from %.0f kg, %d of %d masses have no hover collective",
+			*Definition.GetName(),
+			Envelope.MinMassKg + Envelope.MassStepKg * FirstRowWithoutHover,
+			NumMassSteps - FirstRowWithoutHover,
+			NumMassSteps
+		);
+	}
+
+	return Envelope;
+}
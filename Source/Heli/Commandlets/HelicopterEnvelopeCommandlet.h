@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "HelicopterEnvelopeCommandlet.generated.h"
+
+class UHelicopterDefinition;
+struct FHelicopterFlightEnvelope;
+
+/**
+ * Runs the flight model offline for every helicopter definition and saves baked FHelicopterFlightEnvelope into it.
+ *
+ * Usage: UnrealEditor-Cmd.exe Heli.uproject -run=HelicopterEnvelope [-Definition=Name] [-MassSteps=9]
+ *        [-PitchSteps=16] [-MaxPitch=30]
+ */
+UCLASS()
+class HELI_API UHelicopterEnvelopeCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UHelicopterEnvelopeCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+	static FHelicopterFlightEnvelope BakeEnvelope(
+		const UHelicopterDefinition& Definition,
+		int32 NumMassSteps,
+		int32 NumPitchSteps,
+		float MaxPitch
+	);
+};
@@ -0,0 +1,579 @@
+﻿#include "HelicopterTuningCommandlet.h"
+
+#include "Async/ParallelFor.h"
+#include "AssetRegistry/AssetRegistryModule.h"
+#include "Curves/CurveFloat.h"
+#include "Heli/LogHeli.h"
+#include "Heli/BFLs/HeliConversionsLibrary.h"
+#include "Heli/Vehicles/Helicopters/HelicopterDefinition.h"
+#include "Heli/Vehicles/Helicopters/HelicopterFlightModel.h"
+#include "Math/RandomStream.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "UObject/UObjectGlobals.h"
+
+namespace HelicopterTuning
+{
+	enum EParameter
+	{
+		LiftForce,
+		LiftCurveCollective,
+		HorizontalFriction,
+		VerticalFriction,
+		PitchAcceleration,
+		PitchMaxSpeed,
+		YawAcceleration,
+		YawMaxSpeed,
+		NumParameters
+	};
+
+	const TCHAR* ParameterNames[NumParameters] {
+		TEXT("LiftForceFromMaxCollective"),
+		TEXT("LiftForceScaleFromCollectiveCurve"),
+		TEXT("HorizontalAirFrictionDecelerationToVelocityCurve"),
+		TEXT("VerticalAirFrictionDecelerationToVelocityCurve"),
+		TEXT("PitchAcceleration"),
+		TEXT("PitchMaxSpeed"),
+		TEXT("YawAcceleration"),
+		TEXT("YawMaxSpeed")
+	};
+
+	// Names double as command line switches, so none of them may end with another one
+	enum EMetric
+	{
+		HoverCollective,
+		TopSpeed,
+		AccelerationTime,
+		TurnRate,
+		TurnSpinUpTime,
+		PitchTime,
+		NumMetrics
+	};
+
+	const TCHAR* MetricNames[NumMetrics] {
+		TEXT("HoverCollective"),
+		TEXT("TopSpeed"),
+		TEXT("AccelerationTime"),
+		TEXT("TurnRate"),
+		TEXT("TurnSpinUpTime"),
+		TEXT("PitchTime")
+	};
+
+	constexpr float ScenarioDeltaTime { 1.f / 30.f };
+	constexpr float ScenarioMaxTime { 120.f };
+
+	// Share of top speed that counts as reaching it, the last few percent take forever with air friction
+	constexpr float TopSpeedReachedShare { 0.9f };
+
+	struct FSettings
+	{
+		int32 NumSamples { 4096 };
+		int32 Seed { 0 };
+		// Every parameter is scaled by up to 1 + Spread in both directions, uniformly in log space
+		float Spread { 0.5f };
+		int32 NumBest { 16 };
+		// Nose down pitch helicopter accelerates with
+		float ScenarioPitch { 20.f };
+		float Targets[NumMetrics] { 0.45f, 0.f, 15.f, 30.f, 1.f, 1.f };
+	};
+
+	struct FCandidate
+	{
+		// Multipliers of the definition tuning, all ones for the definition itself
+		float Scales[NumParameters] {};
+		FPhysicsData PhysicsData {};
+		FRotationData RotationData {};
+		FHelicopterFlightCurves Curves {};
+		float Metrics[NumMetrics] {};
+		float Score { 0.f };
+		// Candidates that can't hover are not ranked, none of their scenarios can be flown as intended
+		bool bCanHover { false };
+	};
+
+	UCurveFloat* ScaleCurveValues(const UCurveFloat* Source, float Scale, TArray<TObjectPtr<UCurveFloat>>& TuningCurves)
+	{
+		if(!Source)
+			return nullptr;
+
+		UCurveFloat* Curve = NewObject<UCurveFloat>(GetTransientPackage());
+		Curve->FloatCurve = Source->FloatCurve;
+		TuningCurves.Add(Curve);
+
+		for(FRichCurveKey& Key : Curve->FloatCurve.Keys)
+		{
+			Key.Value *= Scale;
+			Key.ArriveTangent *= Scale;
+			Key.LeaveTangent *= Scale;
+		}
+
+		return Curve;
+	}
+
+	UCurveFloat* ScaleCurveTimes(const UCurveFloat* Source, float Scale, TArray<TObjectPtr<UCurveFloat>>& TuningCurves)
+	{
+		if(!Source)
+			return nullptr;
+
+		UCurveFloat* Curve = NewObject<UCurveFloat>(GetTransientPackage());
+		Curve->FloatCurve = Source->FloatCurve;
+		TuningCurves.Add(Curve);
+
+		// Positive scale keeps keys sorted
+		for(FRichCurveKey& Key : Curve->FloatCurve.Keys)
+		{
+			Key.Time *= Scale;
+			Key.ArriveTangent /= Scale;
+			Key.LeaveTangent /= Scale;
+		}
+
+		return Curve;
+	}
+
+	// Curves are UObjects, so candidates have to be made on game thread
+	void MakeCandidate(FCandidate& Candidate, const UHelicopterDefinition& Definition,
+		const FHelicopterFlightCurves& DefinitionCurves, TArray<TObjectPtr<UCurveFloat>>& TuningCurves)
+	{
+		const float* Scales = Candidate.Scales;
+
+		Candidate.PhysicsData = Definition.PhysicsData;
+		Candidate.PhysicsData.LiftForceFromMaxCollective *= Scales[LiftForce];
+
+		Candidate.RotationData = Definition.RotationData;
+		Candidate.RotationData.PitchAcceleration *= Scales[PitchAcceleration];
+		Candidate.RotationData.PitchMaxSpeed *= Scales[PitchMaxSpeed];
+		Candidate.RotationData.YawAcceleration *= Scales[YawAcceleration];
+		Candidate.RotationData.YawMaxSpeed *= Scales[YawMaxSpeed];
+
+		Candidate.Curves = DefinitionCurves;
+
+		// Stretching lift curve along collective moves the point where helicopter starts to climb
+		if(Scales[LiftCurveCollective] != 1.f)
+		{
+			Candidate.Curves.LiftForceScaleFromCollectiveCurve = ScaleCurveTimes(
+				DefinitionCurves.LiftForceScaleFromCollectiveCurve,
+				Scales[LiftCurveCollective],
+				TuningCurves
+			);
+		}
+
+		if(Scales[HorizontalFriction] != 1.f)
+		{
+			Candidate.Curves.HorizontalAirFrictionDecelerationToVelocityCurve = ScaleCurveValues(
+				DefinitionCurves.HorizontalAirFrictionDecelerationToVelocityCurve,
+				Scales[HorizontalFriction],
+				TuningCurves
+			);
+		}
+
+		if(Scales[VerticalFriction] != 1.f)
+		{
+			Candidate.Curves.VerticalAirFrictionDecelerationToVelocityCurve = ScaleCurveValues(
+				DefinitionCurves.VerticalAirFrictionDecelerationToVelocityCurve,
+				Scales[VerticalFriction],
+				TuningCurves
+			);
+		}
+	}
+
+	// Full input from rest, rotation speeds up with the acceleration until it hits max speed
+	float CalculateTimeToAngle(float Angle, float Acceleration, float MaxSpeed)
+	{
+		Acceleration = FMath::Max(Acceleration, UE_KINDA_SMALL_NUMBER);
+		MaxSpeed = FMath::Max(MaxSpeed, UE_KINDA_SMALL_NUMBER);
+
+		const float SpinUpAngle = FMath::Square(MaxSpeed) / (2.f * Acceleration);
+
+		if(Angle <= SpinUpAngle)
+			return FMath::Sqrt(2.f * Angle / Acceleration);
+
+		return MaxSpeed / Acceleration + (Angle - SpinUpAngle) / MaxSpeed;
+	}
+
+	// Safe to run on any thread, model only reads curves
+	void FlyScenarios(FCandidate& Candidate, const FSettings& Settings)
+	{
+		const FHelicopterFlightModel Model { Candidate.PhysicsData, Candidate.Curves };
+		const FRotationData& Rotation = Candidate.RotationData;
+		const float MassKg = Candidate.PhysicsData.MassKg;
+		float* Metrics = Candidate.Metrics;
+
+		// Negative when helicopter can't hover, it's written like that so the csv shows it
+		const float LevelCollective = Model.SolveLevelCollective(FHelicopterFlightModel::GetUpVectorForPitch(0.f), MassKg);
+		Metrics[HoverCollective] = LevelCollective;
+		Candidate.bCanHover = LevelCollective >= 0.f;
+
+		// Accelerate from hover nose down, holding altitude as well as collective allows
+		const FVector UpVector = FHelicopterFlightModel::GetUpVectorForPitch(Settings.ScenarioPitch);
+		const float TrimCollective = Model.SolveLevelCollective(UpVector, MassKg);
+		const float Collective = TrimCollective >= 0.f ? TrimCollective : 1.f;
+
+		const int32 NumSteps = FMath::CeilToInt32(ScenarioMaxTime / ScenarioDeltaTime);
+		const int32 NumAveragedSteps = FMath::Clamp(FMath::CeilToInt32(1.f / ScenarioDeltaTime), 1, NumSteps);
+
+		TArray<float> ForwardSpeeds {};
+		ForwardSpeeds.SetNumUninitialized(NumSteps);
+
+		FVector Velocity = FVector::ZeroVector;
+
+		for(int32 Step = 0; Step < NumSteps; ++Step)
+		{
+			Velocity = Model.StepVelocity(Velocity, UpVector, Collective, MassKg, ScenarioDeltaTime);
+			ForwardSpeeds[Step] = Velocity.X;
+		}
+
+		// Averaged like SolveSteadyVelocity does, so friction jitter doesn't move it
+		float SettledSpeed = 0.f;
+		for(int32 Step = NumSteps - NumAveragedSteps; Step < NumSteps; ++Step)
+		{
+			SettledSpeed += ForwardSpeeds[Step];
+		}
+		SettledSpeed /= NumAveragedSteps;
+
+		const int32 ReachedStep = SettledSpeed > UE_KINDA_SMALL_NUMBER
+			? ForwardSpeeds.IndexOfByPredicate([&](float Speed) { return Speed >= SettledSpeed * TopSpeedReachedShare; })
+			: INDEX_NONE;
+
+		Metrics[TopSpeed] = UHeliConversionsLibrary::CmsToKmh(FMath::Max(SettledSpeed, 0.f));
+		Metrics[AccelerationTime] = ReachedStep != INDEX_NONE ? (ReachedStep + 1) * ScenarioDeltaTime : ScenarioMaxTime;
+
+		// Turning at top speed, yaw limit is scaled by speed the same way movement component does it
+		const float YawMaxSpeedScale = Candidate.Curves.YawMaxSpeedScaleFromVelocityCurve
+			? Candidate.Curves.YawMaxSpeedScaleFromVelocityCurve->GetFloatValue(Metrics[TopSpeed])
+			: 1.f;
+
+		Metrics[TurnRate] = Rotation.YawMaxSpeed * YawMaxSpeedScale;
+		Metrics[TurnSpinUpTime] = Metrics[TurnRate] / FMath::Max(Rotation.YawAcceleration, UE_KINDA_SMALL_NUMBER);
+		Metrics[PitchTime] = CalculateTimeToAngle(Settings.ScenarioPitch, Rotation.PitchAcceleration, Rotation.PitchMaxSpeed);
+	}
+
+	// Sum of squared relative errors, metrics without target don't count
+	float CalculateScore(const float* Metrics, const FSettings& Settings)
+	{
+		float Score = 0.f;
+
+		for(int32 Metric = 0; Metric < NumMetrics; ++Metric)
+		{
+			const float Target = Settings.Targets[Metric];
+			if(Target > 0.f)
+				Score += FMath::Square((Metrics[Metric] - Target) / Target);
+		}
+
+		return Score;
+	}
+
+	// Pearson correlation, zero when either side doesn't change at all
+	double CalculateCorrelation(const TArray<double>& X, const TArray<double>& Y)
+	{
+		const int32 Num = X.Num();
+		if(Num < 2)
+			return 0.0;
+
+		double MeanX = 0.0;
+		double MeanY = 0.0;
+		for(int32 Index = 0; Index < Num; ++Index)
+		{
+			MeanX += X[Index];
+			MeanY += Y[Index];
+		}
+		MeanX /= Num;
+		MeanY /= Num;
+
+		double Covariance = 0.0;
+		double VarianceX = 0.0;
+		double VarianceY = 0.0;
+		for(int32 Index = 0; Index < Num; ++Index)
+		{
+			const double DeltaX = X[Index] - MeanX;
+			const double DeltaY = Y[Index] - MeanY;
+
+			Covariance += DeltaX * DeltaY;
+			VarianceX += DeltaX * DeltaX;
+			VarianceY += DeltaY * DeltaY;
+		}
+
+		const double Denominator = FMath::Sqrt(VarianceX * VarianceY);
+
+		return Denominator > UE_DOUBLE_SMALL_NUMBER ? Covariance / Denominator : 0.0;
+	}
+
+	FString MakeCandidateRow(const FString& Label, const FCandidate& Candidate)
+	{
+		FString Row = FString::Printf(TEXT("%s,%.6f"), *Label, Candidate.Score);
+
+		for(int32 Parameter = 0; Parameter < NumParameters; ++Parameter)
+		{
+			Row += FString::Printf(TEXT(",%.4f"), Candidate.Scales[Parameter]);
+		}
+
+		for(int32 Metric = 0; Metric < NumMetrics; ++Metric)
+		{
+			Row += FString::Printf(TEXT(",%.4f"), Candidate.Metrics[Metric]);
+		}
+
+		return Row + LINE_TERMINATOR;
+	}
+
+	bool WriteBestCandidates(const FString& Filename, const TArray<FCandidate>& Candidates,
+		const TArray<int32>& Ranking, int32 NumBest)
+	{
+		FString Csv = TEXT("Rank,Score");
+
+		for(int32 Parameter = 0; Parameter < NumParameters; ++Parameter)
+		{
+			Csv += FString::Printf(TEXT(",%sScale"), ParameterNames[Parameter]);
+		}
+
+		for(int32 Metric = 0; Metric < NumMetrics; ++Metric)
+		{
+			Csv += FString::Printf(TEXT(",%s"), MetricNames[Metric]);
+		}
+
+		Csv += LINE_TERMINATOR;
+
+		// Reference row to compare the best ones with
+		Csv += MakeCandidateRow(TEXT("Definition"), Candidates[0]);
+
+		for(int32 Rank = 0; Rank < FMath::Min(NumBest, Ranking.Num()); ++Rank)
+		{
+			Csv += MakeCandidateRow(FString::FromInt(Rank + 1), Candidates[Ranking[Rank]]);
+		}
+
+		return FFileHelper::SaveStringToFile(Csv, *Filename);
+	}
+
+	// Correlation of log scale of every parameter with score and every metric.
+	// Sign tells direction, magnitude tells how much the parameter matters compared to others
+	bool WriteSensitivity(const FString& Filename, const TArray<FCandidate>& Candidates)
+	{
+		const int32 NumCandidates = Candidates.Num();
+
+		auto Gather = [&](TFunctionRef<double(const FCandidate&)> Getter)
+		{
+			TArray<double> Values {};
+			Values.Reserve(NumCandidates);
+
+			for(const FCandidate& Candidate : Candidates)
+			{
+				if(Candidate.bCanHover)
+					Values.Add(Getter(Candidate));
+			}
+
+			return Values;
+		};
+
+		TArray<TArray<double>> Outputs {};
+		Outputs.Add(Gather([](const FCandidate& Candidate) { return static_cast<double>(Candidate.Score); }));
+
+		for(int32 Metric = 0; Metric < NumMetrics; ++Metric)
+		{
+			Outputs.Add(Gather([Metric](const FCandidate& Candidate) { return static_cast<double>(Candidate.Metrics[Metric]); }));
+		}
+
+		FString Csv = TEXT("Parameter,Score");
+
+		for(int32 Metric = 0; Metric < NumMetrics; ++Metric)
+		{
+			Csv += FString::Printf(TEXT(",%s"), MetricNames[Metric]);
+		}
+
+		Csv += LINE_TERMINATOR;
+
+		for(int32 Parameter = 0; Parameter < NumParameters; ++Parameter)
+		{
+			const TArray<double> Inputs = Gather([Parameter](const FCandidate& Candidate)
+			{
+				return FMath::Loge(static_cast<double>(Candidate.Scales[Parameter]));
+			});
+
+			Csv += ParameterNames[Parameter];
+
+			for(const TArray<double>& Output : Outputs)
+			{
+				Csv += FString::Printf(TEXT(",%.4f"), CalculateCorrelation(Inputs, Output));
+			}
+
+			Csv += LINE_TERMINATOR;
+		}
+
+		return FFileHelper::SaveStringToFile(Csv, *Filename);
+	}
+
+	bool TuneDefinition(const UHelicopterDefinition& Definition, const FSettings& Settings,
+		TArray<TObjectPtr<UCurveFloat>>& TuningCurves)
+	{
+		FHelicopterFlightCurves DefinitionCurves {};
+		DefinitionCurves.Resolve(Definition.PhysicsData, Definition.RotationData, true);
+
+		// Loaded through soft pointers, so nothing else holds them
+		for(UCurveFloat* Curve : {
+			DefinitionCurves.LiftForceScaleFromCollectiveCurve.Get(),
+			DefinitionCurves.LiftScaleFromRotationCurve.Get(),
+			DefinitionCurves.HorizontalAirFrictionDecelerationToVelocityCurve.Get(),
+			DefinitionCurves.VerticalAirFrictionDecelerationToVelocityCurve.Get(),
+			DefinitionCurves.YawMaxSpeedScaleFromVelocityCurve.Get()
+		})
+		{
+			if(Curve)
+				TuningCurves.Add(Curve);
+		}
+
+		const int32 NumCandidates = FMath::Max(Settings.NumSamples, 1);
+		const float LogSpread = FMath::Loge(1.f + FMath::Max(Settings.Spread, 0.f));
+
+		// Same seed gives same candidates, so a sweep can be reproduced
+		FRandomStream Stream { Settings.Seed };
+
+		TArray<FCandidate> Candidates {};
+		Candidates.SetNum(NumCandidates);
+
+		for(int32 Index = 0; Index < NumCandidates; ++Index)
+		{
+			FCandidate& Candidate = Candidates[Index];
+
+			for(float& Scale : Candidate.Scales)
+			{
+				Scale = Index == 0 ? 1.f : FMath::Exp(Stream.FRandRange(-LogSpread, LogSpread));
+			}
+
+			MakeCandidate(Candidate, Definition, DefinitionCurves, TuningCurves);
+		}
+
+		ParallelFor(NumCandidates, [&](int32 Index)
+		{
+			FCandidate& Candidate = Candidates[Index];
+
+			FlyScenarios(Candidate, Settings);
+			Candidate.Score = CalculateScore(Candidate.Metrics, Settings);
+		});
+
+		if(!Candidates[0].bCanHover)
+			HELI_WRN("%s can't hover at its mass, its score means nothing", *Definition.GetName());
+
+		TArray<int32> Ranking {};
+		Ranking.Reserve(NumCandidates);
+
+		for(int32 Index = 0; Index < NumCandidates; ++Index)
+		{
+			if(Candidates[Index].bCanHover)
+				Ranking.Add(Index);
+		}
+
+		if(Ranking.IsEmpty())
+		{
+			HELI_ERR("None of %d candidates of %s can hover, widen -Spread or fix lift of the definition",
+				NumCandidates, *Definition.GetName());
+			return false;
+		}
+
+		if(Ranking.Num() < NumCandidates)
+			HELI_WRN("%d of %d candidates of %s can't hover and are left out", NumCandidates - Ranking.Num(), NumCandidates, *Definition.GetName());
+
+		// Stable, so equal scores keep sampling order between runs
+		Ranking.StableSort([&](int32 A, int32 B) { return Candidates[A].Score < Candidates[B].Score; });
+
+		const FString Directory = FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Tuning"));
+		const FString BestFilename = FPaths::Combine(Directory, Definition.GetName() + TEXT("_Best.csv"));
+		const FString SensitivityFilename = FPaths::Combine(Directory, Definition.GetName() + TEXT("_Sensitivity.csv"));
+
+		if(!WriteBestCandidates(BestFilename, Candidates, Ranking, Settings.NumBest))
+		{
+			HELI_ERR("Can't write %s", *BestFilename);
+			return false;
+		}
+
+		if(!WriteSensitivity(SensitivityFilename, Candidates))
+		{
+			HELI_ERR("Can't write %s", *SensitivityFilename);
+			return false;
+		}
+
+		HELI_WRN("%s scores %.4f, best of %d candidates scores %.4f, see %s",
+			*Definition.GetName(),
+			Candidates[0].Score,
+			NumCandidates,
+			Candidates[Ranking[0]].Score,
+			*BestFilename
+		);
+
+		return true;
+	}
+}
+
+UHelicopterTuningCommandlet::UHelicopterTuningCommandlet()
+{
+	IsClient = false;
+	IsServer = false;
+	IsEditor = true;
+	LogToConsole = true;
+}
+
+int32 UHelicopterTuningCommandlet::Main(const FString& Params)
+{
+	using namespace HelicopterTuning;
+
+	FString DefinitionName {};
+	FParse::Value(*Params, TEXT("Definition="), DefinitionName);
+
+	TArray<FString> Tokens {};
+	TArray<FString> Switches {};
+	TMap<FString, FString> ParamValues {};
+	ParseCommandLine(*Params, Tokens, Switches, ParamValues);
+
+	TArray<FString> KnownParams { TEXT("Run"), TEXT("Definition"), TEXT("Samples"), TEXT("Seed"), TEXT("Spread"),
+		TEXT("Best"), TEXT("ScenarioPitch") };
+	KnownParams.Append(MetricNames, NumMetrics);
+
+	// Misspelled target would silently keep its default
+	for(const TPair<FString, FString>& Param : ParamValues)
+	{
+		if(!KnownParams.Contains(Param.Key))
+			HELI_WRN("Unknown parameter -%s=%s is ignored", *Param.Key, *Param.Value);
+	}
+
+	FSettings Settings {};
+	FParse::Value(*Params, TEXT("Samples="), Settings.NumSamples);
+	FParse::Value(*Params, TEXT("Seed="), Settings.Seed);
+	FParse::Value(*Params, TEXT("Spread="), Settings.Spread);
+	FParse::Value(*Params, TEXT("Best="), Settings.NumBest);
+	FParse::Value(*Params, TEXT("ScenarioPitch="), Settings.ScenarioPitch);
+
+	for(int32 Metric = 0; Metric < NumMetrics; ++Metric)
+	{
+		FParse::Value(*Params, *FString::Printf(TEXT("%s="), MetricNames[Metric]), Settings.Targets[Metric]);
+	}
+
+	IAssetRegistry& AssetRegistry = FModuleManager::LoadModuleChecked<FAssetRegistryModule>(TEXT("AssetRegistry")).Get();
+	AssetRegistry.SearchAllAssets(true);
+
+	TArray<FAssetData> Assets {};
+	AssetRegistry.GetAssetsByClass(UHelicopterDefinition::StaticClass()->GetClassPathName(), Assets, true);
+
+	int32 NumFailed = 0;
+
+	for(const FAssetData& Asset : Assets)
+	{
+		if(!DefinitionName.IsEmpty() && Asset.AssetName.ToString() != DefinitionName)
+			continue;
+
+		const UHelicopterDefinition* Definition = Cast<UHelicopterDefinition>(Asset.GetAsset());
+		if(!Definition)
+		{
+			HELI_ERR("Can't load helicopter definition %s", *Asset.GetObjectPathString());
+			++NumFailed;
+			continue;
+		}
+
+		const double StartTime = FPlatformTime::Seconds();
+
+		if(TuneDefinition(*Definition, Settings, TuningCurves))
+			HELI_WRN("Tuned %s in %.2fs", *Definition->GetName(), FPlatformTime::Seconds() - StartTime);
+		else
+			++NumFailed;
+
+		// Candidate curves aren't needed anymore, there may be thousands of them
+		TuningCurves.Reset();
+		CollectGarbage(GARBAGE_COLLECTION_KEEPFLAGS);
+	}
+
+	return NumFailed == 0 ? 0 : 1;
+}
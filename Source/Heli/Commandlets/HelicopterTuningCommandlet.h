@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Commandlets/Commandlet.h"
+#include "Curves/CurveFloat.h"
+#include "HelicopterTuningCommandlet.generated.h"
+
+/**
+ * Monte Carlo search over flight tuning of helicopter definitions.
+ * Every candidate randomly scales lift, air friction and rotation tuning of the definition, flies scripted scenarios
+ * with FHelicopterFlightModel and gets scored against target behaviour. Candidates are flown in parallel.
+ * Best candidates and sensitivity of every metric to every parameter are written to Saved/Tuning,
+ * definitions themselves are not modified.
+ *
+ * Usage: UnrealEditor-Cmd.exe Heli.uproject -run=HelicopterTuning [-Definition=Name] [-Samples=4096] [-Seed=0]
+ *        [-Spread=0.5] [-Best=16] [-ScenarioPitch=20] [-HoverCollective=0.45] [-TopSpeed=0] [-AccelerationTime=15]
+ *        [-TurnRate=30] [-TurnSpinUpTime=1] [-PitchTime=1]
+ * Speeds are in km/h, turn rate in deg/s, times in seconds. Target of 0 leaves the metric out of the score.
+ * Unknown parameters are reported and ignored. Candidates that can't hover are reported and left out of ranking
+ * and sensitivity, the definition row shows negative HoverCollective then.
+ */
+UCLASS()
+class HELI_API UHelicopterTuningCommandlet : public UCommandlet
+{
+	GENERATED_BODY()
+
+public:
+
+	UHelicopterTuningCommandlet();
+
+	virtual int32 Main(const FString& Params) override;
+
+private:
+
+	// Scaled curves of candidates and curves of the definition being tuned, referenced here so GC can't take them mid search
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<UCurveFloat>> TuningCurves {};
+};
@@ -62,6 +62,15 @@ void UCameraLookAroundComponent::SetIsLookAroundEnabled(bool bEnable)
 	}
 }
 
+void UCameraLookAroundComponent::ResetLookAround()
+{
+	const UCameraLookAroundComponent* Archetype = CastChecked<UCameraLookAroundComponent>(GetArchetype());
+	
+	bIsLookAroundEnabled = Archetype->bIsLookAroundEnabled;
+	CurrentPitch = 0.f;
+	CurrentYaw = 0.f;
+}
+
 void UCameraLookAroundComponent::TickComponent(float DeltaTime, ELevelTick TickType,FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
@@ -59,6 +59,10 @@ public:
 
 	UFUNCTION(BlueprintCallable)
 	void SetIsLookAroundEnabled(bool bEnable);
+
+	// Restores look around state and angles to the component defaults
+	UFUNCTION(BlueprintCallable)
+	void ResetLookAround();
 	
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
 
@@ -0,0 +1,226 @@
+﻿#include "HelicopterRouteComponent.h"
+
+UHelicopterRouteComponent::UHelicopterRouteComponent()
+{
+	PrimaryComponentTick.bCanEverTick = false;
+}
+
+void UHelicopterRouteComponent::OnRegister()
+{
+	Super::OnRegister();
+
+	// Construction script reruns register again, so edited routes are rebuilt as well
+	UpdateRouteTables();
+}
+
+void UHelicopterRouteComponent::UpdateRouteTables()
+{
+	RouteLength = GetSplineLength();
+
+	SampleLocations.Reset();
+	SampleDirections.Reset();
+	SampleCurvatures.Reset();
+	SampleSpeedLimits.Reset();
+
+	if(RouteLength <= UE_KINDA_SMALL_NUMBER)
+	{
+		TableSpacing = 0.f;
+		return;
+	}
+
+	// Spacing is adjusted so the last sample is exactly at the end of the route
+	const int32 NumIntervals = FMath::Max(FMath::CeilToInt32(RouteLength / SampleSpacing), 1);
+	TableSpacing = RouteLength / NumIntervals;
+
+	const int32 NumSamples = NumIntervals + 1;
+	SampleLocations.SetNumUninitialized(NumSamples);
+	SampleDirections.SetNumUninitialized(NumSamples);
+	SampleCurvatures.SetNumUninitialized(NumSamples);
+
+	for(int32 Index = 0; Index < NumSamples; ++Index)
+	{
+		const float Distance = Index * TableSpacing;
+		
+		SampleLocations[Index] = GetLocationAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::Local);
+		SampleDirections[Index] = GetDirectionAtDistanceAlongSpline(Distance, ESplineCoordinateSpace::Local);
+	}
+
+	// Curvature is how fast direction turns per distance
+	for(int32 Index = 0; Index < NumSamples; ++Index)
+	{
+		const int32 Previous = FMath::Max(Index - 1, 0);
+		const int32 Next = FMath::Min(Index + 1, NumSamples - 1);
+		const float Span = (Next - Previous) * TableSpacing;
+
+		SampleCurvatures[Index] = (SampleDirections[Next] - SampleDirections[Previous]).Size() / Span;
+	}
+
+	CalculateSpeedLimits();
+}
+
+void UHelicopterRouteComponent::CalculateSpeedLimits()
+{
+	const int32 NumSamples = SampleCurvatures.Num();
+	SampleSpeedLimits.SetNumUninitialized(NumSamples);
+
+	// Speed the turn allows: lateral acceleration is v^2 * curvature
+	for(int32 Index = 0; Index < NumSamples; ++Index)
+	{
+		const float Curvature = SampleCurvatures[Index];
+		
+		SampleSpeedLimits[Index] = Curvature > UE_KINDA_SMALL_NUMBER
+			? FMath::Min(FMath::Sqrt(MaxLateralAcceleration / Curvature), MaxRouteSpeed)
+			: MaxRouteSpeed;
+	}
+
+	// Backward pass, so helicopter can brake from any sample to the limit of the next ones.
+	// Closed loops need a second lap for turns right after the start to affect the end
+	const int32 NumPasses = IsClosedLoop() ? 2 : 1;
+	for(int32 Pass = 0; Pass < NumPasses; ++Pass)
+	{
+		for(int32 Index = NumSamples - 1; Index >= 0; --Index)
+		{
+			const int32 Next = Index + 1 < NumSamples ? Index + 1 : (IsClosedLoop() ? 1 : INDEX_NONE);
+			if(Next == INDEX_NONE)
+				continue;
+
+			const float ReachableSpeed = FMath::Sqrt(
+				FMath::Square(SampleSpeedLimits[Next]) + 2.f * MaxDeceleration * TableSpacing
+			);
+			SampleSpeedLimits[Index] = FMath::Min(SampleSpeedLimits[Index], ReachableSpeed);
+		}
+	}
+}
+
+float UHelicopterRouteComponent::GetRouteLength() const
+{
+	return RouteLength;
+}
+
+float UHelicopterRouteComponent::NormalizeRouteDistance(float Distance) const
+{
+	if(RouteLength <= 0.f)
+		return 0.f;
+
+	if(IsClosedLoop())
+	{
+		Distance = FMath::Fmod(Distance, RouteLength);
+		return Distance < 0.f ? Distance + RouteLength : Distance;
+	}
+
+	return FMath::Clamp(Distance, 0.f, RouteLength);
+}
+
+void UHelicopterRouteComponent::GetSampleAtDistance(float Distance, int32& OutIndex, float& OutAlpha) const
+{
+	const float Position = NormalizeRouteDistance(Distance) / TableSpacing;
+	
+	OutIndex = FMath::Clamp(FMath::FloorToInt32(Position), 0, SampleLocations.Num() - 2);
+	OutAlpha = FMath::Clamp(Position - OutIndex, 0.f, 1.f);
+}
+
+float UHelicopterRouteComponent::InterpolateTable(const TArray<float>& Table, float Distance) const
+{
+	if(Table.Num() < 2)
+		return Table.IsEmpty() ? 0.f : Table[0];
+
+	int32 Index = 0;
+	float Alpha = 0.f;
+	GetSampleAtDistance(Distance, Index, Alpha);
+
+	return FMath::Lerp(Table[Index], Table[Index + 1], Alpha);
+}
+
+FVector UHelicopterRouteComponent::GetRouteLocationAtDistance(float Distance) const
+{
+	if(SampleLocations.Num() < 2)
+		return GetComponentLocation();
+
+	int32 Index = 0;
+	float Alpha = 0.f;
+	GetSampleAtDistance(Distance, Index, Alpha);
+
+	const FVector Location = FMath::Lerp(SampleLocations[Index], SampleLocations[Index + 1], Alpha);
+
+	return GetComponentTransform().TransformPosition(Location);
+}
+
+FVector UHelicopterRouteComponent::GetRouteDirectionAtDistance(float Distance) const
+{
+	if(SampleDirections.Num() < 2)
+		return GetForwardVector();
+
+	int32 Index = 0;
+	float Alpha = 0.f;
+	GetSampleAtDistance(Distance, Index, Alpha);
+
+	const FVector Direction = FMath::Lerp(SampleDirections[Index], SampleDirections[Index + 1], Alpha);
+
+	return GetComponentTransform().TransformVectorNoScale(Direction.GetSafeNormal());
+}
+
+float UHelicopterRouteComponent::GetRouteCurvatureAtDistance(float Distance) const
+{
+	return InterpolateTable(SampleCurvatures, Distance);
+}
+
+float UHelicopterRouteComponent::GetRouteSpeedLimitAtDistance(float Distance) const
+{
+	return InterpolateTable(SampleSpeedLimits, Distance);
+}
+
+float UHelicopterRouteComponent::FindRouteDistanceClosestToLocation(const FVector& WorldLocation,
+	float PreviousDistance, float SearchRadius) const
+{
+	if(SampleLocations.Num() < 2)
+		return 0.f;
+
+	const FVector LocalLocation = GetComponentTransform().InverseTransformPosition(WorldLocation);
+	const int32 NumSamples = SampleLocations.Num();
+	const int32 CenterIndex = FMath::RoundToInt32(NormalizeRouteDistance(PreviousDistance) / TableSpacing);
+	const int32 SearchSamples = FMath::CeilToInt32(SearchRadius / TableSpacing) + 1;
+
+	int32 BestIndex = CenterIndex;
+	float BestDistanceSquared = TNumericLimits<float>::Max();
+
+	for(int32 Offset = -SearchSamples; Offset <= SearchSamples; ++Offset)
+	{
+		int32 Index = CenterIndex + Offset;
+		
+		if(IsClosedLoop())
+			Index = (Index % (NumSamples - 1) + NumSamples - 1) % (NumSamples - 1);
+		else if(Index < 0 || Index >= NumSamples)
+			continue;
+
+		const float DistanceSquared = FVector::DistSquared(SampleLocations[Index], LocalLocation);
+		if(DistanceSquared < BestDistanceSquared)
+		{
+			BestDistanceSquared = DistanceSquared;
+			BestIndex = Index;
+		}
+	}
+
+	// Refine between the best sample and its neighbours by projecting on the segments
+	float BestRouteDistance = BestIndex * TableSpacing;
+	BestDistanceSquared = TNumericLimits<float>::Max();
+
+	for(const int32 SegmentStart : { BestIndex - 1, BestIndex })
+	{
+		if(SegmentStart < 0 || SegmentStart + 1 >= NumSamples)
+			continue;
+
+		const FVector Start = SampleLocations[SegmentStart];
+		const FVector Segment = SampleLocations[SegmentStart + 1] - Start;
+		const float Projection = (LocalLocation - Start) | Segment;
+		const float Alpha = FMath::Clamp(Projection / FMath::Max(Segment.SizeSquared(), UE_KINDA_SMALL_NUMBER), 0.f, 1.f);
+		const float DistanceSquared = FVector::DistSquared(Start + Segment * Alpha, LocalLocation);
+
+		if(DistanceSquared < BestDistanceSquared)
+		{
+			BestDistanceSquared = DistanceSquared;
+			BestRouteDistance = (SegmentStart + Alpha) * TableSpacing;
+		}
+	}
+
+	return BestRouteDistance;
+}
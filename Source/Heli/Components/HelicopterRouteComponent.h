@@ -0,0 +1,90 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/SplineComponent.h"
+#include "Heli/BFLs/HeliConversionsLibrary.h"
+#include "HelicopterRouteComponent.generated.h"
+
+/**
+ * Spline route for AI and scripted flights.
+ * Spline is resampled once into tables evenly spaced by distance, so every lookup by distance is O(1)
+ * and followers never search the spline itself. Tables are in component space, moving the route is free.
+ * Speed limit comes from curvature and max lateral acceleration, then is lowered so helicopter
+ * has enough distance to slow down for the next turn.
+ */
+UCLASS(ClassGroup=(Custom), meta=(BlueprintSpawnableComponent))
+class HELI_API UHelicopterRouteComponent : public USplineComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	UHelicopterRouteComponent();
+
+	// Call it after changing spline points at runtime
+	UFUNCTION(BlueprintCallable)
+	void UpdateRouteTables();
+
+	UFUNCTION(BlueprintCallable)
+	float GetRouteLength() const;
+
+	UFUNCTION(BlueprintCallable)
+	FVector GetRouteLocationAtDistance(float Distance) const;
+
+	UFUNCTION(BlueprintCallable)
+	FVector GetRouteDirectionAtDistance(float Distance) const;
+
+	// 1 / radius of the turn, in 1/cm
+	UFUNCTION(BlueprintCallable)
+	float GetRouteCurvatureAtDistance(float Distance) const;
+
+	UFUNCTION(BlueprintCallable)
+	float GetRouteSpeedLimitAtDistance(float Distance) const;
+
+	// Searches samples within SearchRadius of route distance around PreviousDistance, not the whole route
+	UFUNCTION(BlueprintCallable)
+	float FindRouteDistanceClosestToLocation(const FVector& WorldLocation, float PreviousDistance, float SearchRadius) const;
+
+	// Wraps distance on closed loops and clamps it otherwise
+	float NormalizeRouteDistance(float Distance) const;
+
+	virtual void OnRegister() override;
+
+protected:
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=10.0))
+	float SampleSpacing { 200.f };
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float MaxRouteSpeed { UHeliConversionsLibrary::KmhToCms(250.f) };
+
+	// Sideways acceleration helicopter can make in a turn
+	UPROPERTY(EditAnywhere, meta=(ClampMin=1.0))
+	float MaxLateralAcceleration { UHeliConversionsLibrary::MsToCms(3.f) };
+
+	// Used to slow down before turns
+	UPROPERTY(EditAnywhere, meta=(ClampMin=1.0))
+	float MaxDeceleration { UHeliConversionsLibrary::MsToCms(2.f) };
+
+private:
+
+	TArray<FVector> SampleLocations {};
+
+	TArray<FVector> SampleDirections {};
+
+	TArray<float> SampleCurvatures {};
+
+	TArray<float> SampleSpeedLimits {};
+
+	float RouteLength { 0.f };
+
+	float TableSpacing { 0.f };
+
+	// Lower sample index and weight of the next one
+	void GetSampleAtDistance(float Distance, int32& OutIndex, float& OutAlpha) const;
+
+	float InterpolateTable(const TArray<float>& Table, float Distance) const;
+
+	void CalculateSpeedLimits();
+
+};
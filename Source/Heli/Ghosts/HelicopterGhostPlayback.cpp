@@ -0,0 +1,106 @@
+﻿#include "HelicopterGhostPlayback.h"
+
+#include "Async/ParallelFor.h"
+#include "Components/InstancedStaticMeshComponent.h"
+#include "Heli/HeliStats.h"
+
+// Below this interpolation is not worth waking worker threads
+static constexpr int32 GhostParallelBatchSize { 32 };
+
+AHelicopterGhostPlayback::AHelicopterGhostPlayback()
+{
+	PrimaryActorTick.bCanEverTick = true;
+	PrimaryActorTick.TickGroup = TG_PrePhysics;
+
+	GhostMeshComponent = CreateDefaultSubobject<UInstancedStaticMeshComponent>(GhostMeshComponentName);
+	GhostMeshComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	GhostMeshComponent->SetGenerateOverlapEvents(false);
+	GhostMeshComponent->SetCanEverAffectNavigation(false);
+	GhostMeshComponent->SetMobility(EComponentMobility::Movable);
+	SetRootComponent(GhostMeshComponent);
+}
+
+void AHelicopterGhostPlayback::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	if(!bPlaying || Ghosts.IsEmpty())
+		return;
+
+	PlaybackTime += DeltaTime * PlayRate;
+
+	UpdateGhostTransforms();
+}
+
+int32 AHelicopterGhostPlayback::LoadGhost(const FString& Name)
+{
+	FHelicopterGhostRecording Recording {};
+	if(!Recording.LoadFromFile(Name) || Recording.GetNumSamples() == 0)
+		return INDEX_NONE;
+
+	return AddGhost(MoveTemp(Recording));
+}
+
+int32 AHelicopterGhostPlayback::AddGhost(FHelicopterGhostRecording&& Recording)
+{
+	LLM_SCOPE_BYTAG(Heli_Ghosts);
+
+	const FTransform StartTransform = Recording.GetTransformAtTime(0.f);
+
+	const int32 GhostIndex = Ghosts.Add(MoveTemp(Recording));
+	GhostTransforms.Add(StartTransform);
+
+	// Instance index always matches ghost index, ghosts are only removed all at once
+	GhostMeshComponent->AddInstance(StartTransform, true);
+
+	return GhostIndex;
+}
+
+void AHelicopterGhostPlayback::RemoveAllGhosts()
+{
+	Ghosts.Empty();
+	GhostTransforms.Empty();
+	GhostMeshComponent->ClearInstances();
+}
+
+int32 AHelicopterGhostPlayback::GetNumGhosts() const
+{
+	return Ghosts.Num();
+}
+
+void AHelicopterGhostPlayback::SetPlaybackTime(float NewPlaybackTime)
+{
+	PlaybackTime = FMath::Max(NewPlaybackTime, 0.f);
+
+	if(!Ghosts.IsEmpty())
+		UpdateGhostTransforms();
+}
+
+float AHelicopterGhostPlayback::GetPlaybackTime() const
+{
+	return PlaybackTime;
+}
+
+void AHelicopterGhostPlayback::SetPlaying(bool bNewPlaying)
+{
+	bPlaying = bNewPlaying;
+}
+
+void AHelicopterGhostPlayback::UpdateGhostTransforms()
+{
+	const float Time = PlaybackTime;
+	const bool bShouldLoop = bLoop;
+
+	ParallelFor(TEXT("HelicopterGhostPlayback"), Ghosts.Num(), GhostParallelBatchSize,
+		[this, Time, bShouldLoop](int32 Index)
+		{
+			const FHelicopterGhostRecording& Ghost = Ghosts[Index];
+			const float Duration = Ghost.GetDuration();
+			const float GhostTime = bShouldLoop && Duration > 0.f ? FMath::Fmod(Time, Duration) : Time;
+
+			GhostTransforms[Index] = Ghost.GetTransformAtTime(GhostTime);
+		}
+	);
+
+	GhostMeshComponent->BatchUpdateInstancesTransforms(0, GhostTransforms, true, true, true);
+}
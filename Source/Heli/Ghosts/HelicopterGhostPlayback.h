@@ -0,0 +1,75 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "HelicopterGhostRecording.h"
+#include "HelicopterGhostPlayback.generated.h"
+
+class UInstancedStaticMeshComponent;
+
+/**
+ * Shows recorded flights as instances of one static mesh.
+ * Ghosts have no physics, collision or skeletal meshes, all of them are interpolated in parallel
+ * and sent to the instanced mesh in a single batch per frame.
+ */
+UCLASS(Blueprintable)
+class HELI_API AHelicopterGhostPlayback : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	inline static FName GhostMeshComponentName { TEXT("GhostMeshComponent") };
+
+	AHelicopterGhostPlayback();
+
+	virtual void Tick(float DeltaTime) override;
+
+	// Loads Saved/Ghosts/Name and adds it as a new ghost. Returns ghost index or INDEX_NONE
+	UFUNCTION(BlueprintCallable)
+	int32 LoadGhost(const FString& Name);
+
+	int32 AddGhost(FHelicopterGhostRecording&& Recording);
+
+	UFUNCTION(BlueprintCallable)
+	void RemoveAllGhosts();
+
+	UFUNCTION(BlueprintCallable)
+	int32 GetNumGhosts() const;
+
+	UFUNCTION(BlueprintCallable)
+	void SetPlaybackTime(float NewPlaybackTime);
+
+	UFUNCTION(BlueprintCallable)
+	float GetPlaybackTime() const;
+
+	UFUNCTION(BlueprintCallable)
+	void SetPlaying(bool bNewPlaying);
+
+protected:
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	TObjectPtr<UInstancedStaticMeshComponent> GhostMeshComponent {};
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float PlayRate { 1.f };
+
+	// Ghosts that are done start over, otherwise they stay at their last sample
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	bool bLoop { true };
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	bool bPlaying { true };
+
+private:
+
+	TArray<FHelicopterGhostRecording> Ghosts {};
+
+	// Kept between frames to not allocate it every update
+	TArray<FTransform> GhostTransforms {};
+
+	float PlaybackTime { 0.f };
+
+	void UpdateGhostTransforms();
+
+};
@@ -0,0 +1,81 @@
+﻿#include "HelicopterGhostRecorderComponent.h"
+
+#include "GameFramework/Actor.h"
+#include "Heli/LogHeli.h"
+
+UHelicopterGhostRecorderComponent::UHelicopterGhostRecorderComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	
+	// Record where physics has put helicopter this frame
+	PrimaryComponentTick.TickGroup = TG_PostPhysics;
+}
+
+void UHelicopterGhostRecorderComponent::TickComponent(float DeltaTime, ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	const double SampleInterval = 1.0 / Recording.SampleRate;
+	
+	// Samples are taken with fixed rate regardless of frame rate, current transform is close enough for each of them
+	SampleAccumulator += DeltaTime;
+	while(SampleAccumulator >= SampleInterval)
+	{
+		SampleAccumulator -= SampleInterval;
+		Recording.AddSample(GetOwner()->GetActorTransform());
+	}
+
+	if(MaxDurationSeconds > 0.f && Recording.GetDuration() >= MaxDurationSeconds)
+	{
+		HELI_WRN("Ghost recording of %s reached its limit of %.0f s", *GetOwner()->GetName(), MaxDurationSeconds);
+		SetComponentTickEnabled(false);
+	}
+}
+
+void UHelicopterGhostRecorderComponent::StartRecording()
+{
+	Recording.Reset();
+	Recording.SampleRate = SampleRate;
+
+	if(MaxDurationSeconds > 0.f)
+	{
+		const int32 ExpectedSamples = FMath::CeilToInt32(MaxDurationSeconds * SampleRate) + 1;
+		Recording.Locations.Reserve(ExpectedSamples);
+		Recording.Rotations.Reserve(ExpectedSamples);
+	}
+
+	// First sample right away, so recording starts exactly where helicopter is now
+	Recording.AddSample(GetOwner()->GetActorTransform());
+	SampleAccumulator = 0.0;
+
+	SetComponentTickEnabled(true);
+}
+
+bool UHelicopterGhostRecorderComponent::StopRecording(const FString& Name)
+{
+	SetComponentTickEnabled(false);
+
+	if(Name.IsEmpty())
+		return true;
+
+	return Recording.SaveToFile(Name);
+}
+
+bool UHelicopterGhostRecorderComponent::IsRecording() const
+{
+	return IsComponentTickEnabled();
+}
+
+const FHelicopterGhostRecording& UHelicopterGhostRecorderComponent::GetRecording() const
+{
+	return Recording;
+}
+
+void UHelicopterGhostRecorderComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	SetComponentTickEnabled(false);
+	
+	Super::EndPlay(EndPlayReason);
+}
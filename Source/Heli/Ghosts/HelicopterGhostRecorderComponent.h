@@ -0,0 +1,56 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "HelicopterGhostRecording.h"
+#include "HelicopterGhostRecorderComponent.generated.h"
+
+/**
+ * Records owner transform with a fixed rate, so the flight can be replayed by AHelicopterGhostPlayback.
+ * Does nothing until recording is started.
+ */
+UCLASS(
+	ClassGroup=(Custom),
+	meta=(BlueprintSpawnableComponent),
+	HideCategories=(ComponentReplication, Replication, ComponentTick, Activation)
+)
+class HELI_API UHelicopterGhostRecorderComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	UHelicopterGhostRecorderComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	UFUNCTION(BlueprintCallable)
+	void StartRecording();
+
+	// Saves recording to Saved/Ghosts/Name when Name is not empty
+	UFUNCTION(BlueprintCallable)
+	bool StopRecording(const FString& Name);
+
+	UFUNCTION(BlueprintCallable)
+	bool IsRecording() const;
+
+	const FHelicopterGhostRecording& GetRecording() const;
+
+protected:
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=1.0, ClampMax=60.0))
+	float SampleRate { 10.f };
+
+	// Recording stops on its own after this, 0 means no limit
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float MaxDurationSeconds { 30.f * 60.f };
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+
+	FHelicopterGhostRecording Recording {};
+
+	double SampleAccumulator { 0.0 };
+
+};
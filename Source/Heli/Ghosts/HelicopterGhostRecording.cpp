@@ -0,0 +1,155 @@
+﻿#include "HelicopterGhostRecording.h"
+
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+#include "Misc/FileHelper.h"
+#include "Misc/Paths.h"
+#include "Serialization/MemoryReader.h"
+#include "Serialization/MemoryWriter.h"
+
+int32 FHelicopterGhostRecording::GetNumSamples() const
+{
+	return Locations.Num();
+}
+
+float FHelicopterGhostRecording::GetDuration() const
+{
+	return GetNumSamples() > 1 ? (GetNumSamples() - 1) / SampleRate : 0.f;
+}
+
+void FHelicopterGhostRecording::AddSample(const FTransform& Transform)
+{
+	LLM_SCOPE_BYTAG(Heli_Ghosts);
+
+	if(Locations.IsEmpty())
+		Origin = Transform.GetLocation();
+
+	Locations.Add(FVector3f(Transform.GetLocation() - Origin));
+	Rotations.Add(FQuat4f(Transform.GetRotation()));
+}
+
+FTransform FHelicopterGhostRecording::GetTransformAtTime(float Time) const
+{
+	const int32 NumSamples = GetNumSamples();
+	if(NumSamples == 0)
+		return FTransform::Identity;
+
+	const float SamplePosition = FMath::Clamp(Time * SampleRate, 0.f, static_cast<float>(NumSamples - 1));
+	const int32 Index = FMath::Min(FMath::FloorToInt32(SamplePosition), NumSamples - 2);
+
+	if(Index < 0)
+		return FTransform(FQuat(Rotations[0]), Origin + FVector(Locations[0]));
+
+	const float Alpha = SamplePosition - Index;
+
+	const FVector3f Location = FMath::Lerp(Locations[Index], Locations[Index + 1], Alpha);
+	const FQuat4f Rotation = FQuat4f::Slerp(Rotations[Index], Rotations[Index + 1], Alpha);
+
+	return FTransform(FQuat(Rotation), Origin + FVector(Location));
+}
+
+void FHelicopterGhostRecording::Reset()
+{
+	Origin = FVector::ZeroVector;
+	Locations.Reset();
+	Rotations.Reset();
+}
+
+FString FHelicopterGhostRecording::GetFilePath(const FString& Name)
+{
+	return FPaths::ProjectSavedDir() / TEXT("Ghosts") / Name + TEXT(".heghost");
+}
+
+bool FHelicopterGhostRecording::SaveToFile(const FString& Name) const
+{
+	TArray<uint8> Bytes {};
+	FMemoryWriter Writer { Bytes };
+
+	// Serialize doesn't change anything when saving
+	const_cast<FHelicopterGhostRecording*>(this)->Serialize(Writer);
+
+	if(!FFileHelper::SaveArrayToFile(Bytes, *GetFilePath(Name)))
+	{
+		HELI_ERR("Failed to save ghost %s", *GetFilePath(Name));
+		return false;
+	}
+
+	return true;
+}
+
+bool FHelicopterGhostRecording::LoadFromFile(const FString& Name)
+{
+	LLM_SCOPE_BYTAG(Heli_Ghosts);
+
+	TArray<uint8> Bytes {};
+	if(!FFileHelper::LoadFileToArray(Bytes, *GetFilePath(Name)))
+	{
+		HELI_ERR("Failed to load ghost %s", *GetFilePath(Name));
+		return false;
+	}
+
+	FMemoryReader Reader { Bytes };
+	Serialize(Reader);
+
+	if(Reader.IsError())
+	{
+		HELI_ERR("Ghost %s is corrupted or has unknown version", *GetFilePath(Name));
+		Reset();
+		return false;
+	}
+
+	return true;
+}
+
+void FHelicopterGhostRecording::Serialize(FArchive& Ar)
+{
+	uint32 Magic = FileMagic;
+	uint32 Version = FileVersion;
+	Ar << Magic;
+	Ar << Version;
+
+	if(Ar.IsLoading() && (Magic != FileMagic || Version != FileVersion))
+	{
+		Ar.SetError();
+		return;
+	}
+
+	int32 NumSamples = GetNumSamples();
+	Ar << SampleRate;
+	Ar << Origin;
+	Ar << NumSamples;
+
+	if(Ar.IsLoading())
+	{
+		// Every sample takes 18 bytes, don't trust a count the file can't hold
+		if(NumSamples < 0 || NumSamples > (Ar.TotalSize() - Ar.Tell()) / 18 || SampleRate <= 0.f)
+		{
+			Ar.SetError();
+			return;
+		}
+
+		Locations.SetNumUninitialized(NumSamples);
+		Rotations.SetNumUninitialized(NumSamples);
+	}
+
+	for(int32 Index = 0; Index < NumSamples; ++Index)
+	{
+		Ar << Locations[Index];
+
+		FRotator3f Rotator = Ar.IsSaving() ? Rotations[Index].Rotator() : FRotator3f::ZeroRotator;
+		uint16 Pitch = FRotator3f::CompressAxisToShort(Rotator.Pitch);
+		uint16 Yaw = FRotator3f::CompressAxisToShort(Rotator.Yaw);
+		uint16 Roll = FRotator3f::CompressAxisToShort(Rotator.Roll);
+		Ar << Pitch << Yaw << Roll;
+
+		if(Ar.IsLoading())
+		{
+			Rotator = FRotator3f(
+				FRotator3f::DecompressAxisFromShort(Pitch),
+				FRotator3f::DecompressAxisFromShort(Yaw),
+				FRotator3f::DecompressAxisFromShort(Roll)
+			);
+			Rotations[Index] = Rotator.Quaternion();
+		}
+	}
+}
@@ -0,0 +1,45 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Trajectory of one recorded flight sampled with a fixed rate.
+ * On disk locations are floats relative to the first sample and rotations are compressed to shorts,
+ * which is 18 bytes per sample. In memory rotations are kept as quaternions, so playback does no decompression.
+ */
+struct HELI_API FHelicopterGhostRecording
+{
+	float SampleRate { 10.f };
+
+	// Everything is relative to it, keeps float precision in large worlds
+	FVector Origin { FVector::ZeroVector };
+
+	TArray<FVector3f> Locations {};
+
+	TArray<FQuat4f> Rotations {};
+
+	int32 GetNumSamples() const;
+
+	float GetDuration() const;
+
+	void AddSample(const FTransform& Transform);
+
+	// Time is clamped to the recorded range
+	FTransform GetTransformAtTime(float Time) const;
+
+	void Reset();
+
+	// Files are placed in Saved/Ghosts, Name is file name without extension
+	static FString GetFilePath(const FString& Name);
+
+	bool SaveToFile(const FString& Name) const;
+
+	bool LoadFromFile(const FString& Name);
+
+	void Serialize(FArchive& Ar);
+
+private:
+
+	inline static constexpr uint32 FileMagic { 0x48474853 }; // HGHS
+	inline static constexpr uint32 FileVersion { 1 };
+};
@@ -12,7 +12,12 @@ public class Heli : ModuleRules
 			"CoreUObject",
 			"Engine",
 			"InputCore",
-			"PhysicsCore"
+			"PhysicsCore",
+			"Chaos",
+			"AssetRegistry",
+			"FieldNotification",
+			"ModelViewViewModel",
+			"ReplicationGraph"
 		});
 
 		// Do not include editor-only dependencies for non editor builds
@@ -1,4 +1,20 @@
 #include "Heli.h"
 #include "Modules/ModuleManager.h"
+#include "Heli/Net/HeliReplicationGraph.h"
 
-IMPLEMENT_PRIMARY_GAME_MODULE(FDefaultGameModuleImpl, Heli, "Heli");
\ No newline at end of file
+class FHeliModule : public FDefaultGameModuleImpl
+{
+public:
+
+	virtual void StartupModule() override
+	{
+		UHeliReplicationGraph::RegisterReplicationDriver();
+	}
+
+	virtual void ShutdownModule() override
+	{
+		UReplicationDriver::CreateReplicationDriverDelegate().Unbind();
+	}
+};
+
+IMPLEMENT_PRIMARY_GAME_MODULE(FHeliModule, Heli, "Heli");
\ No newline at end of file
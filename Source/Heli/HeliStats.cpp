@@ -0,0 +1,6 @@
+﻿#include "HeliStats.h"
+
+LLM_DEFINE_TAG(Heli);
+LLM_DEFINE_TAG(Heli_Helicopters, NAME_None, TEXT("Heli"));
+LLM_DEFINE_TAG(Heli_Subsystems, NAME_None, TEXT("Heli"));
+LLM_DEFINE_TAG(Heli_Ghosts, NAME_None, TEXT("Heli"));
@@ -0,0 +1,14 @@
+﻿#pragma once
+
+#include "HAL/LowLevelMemTracker.h"
+#include "Stats/Stats.h"
+
+// Per helicopter costs, compare "stat Heli" between client and server builds
+DECLARE_STATS_GROUP(TEXT("Heli"), STATGROUP_Heli, STATCAT_Advanced);
+
+// Memory of the module, run with -llm and look at "stat LLMFULL". The other tags are children of Heli,
+// Heli itself is the total of them
+LLM_DECLARE_TAG_API(Heli, HELI_API);
+LLM_DECLARE_TAG_API(Heli_Helicopters, HELI_API);
+LLM_DECLARE_TAG_API(Heli_Subsystems, HELI_API);
+LLM_DECLARE_TAG_API(Heli_Ghosts, HELI_API);
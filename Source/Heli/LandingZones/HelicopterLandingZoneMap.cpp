@@ -0,0 +1,354 @@
+﻿#include "HelicopterLandingZoneMap.h"
+
+#include "Algo/BinarySearch.h"
+#include "Components/BoxComponent.h"
+#include "Engine/World.h"
+#include "Heli/LogHeli.h"
+#include "Heli/Subsystems/HelicopterLandingZoneSubsystem.h"
+#include "Misc/ScopedSlowTask.h"
+
+namespace HelicopterLandingZones
+{
+	void InsertZone(TArray<FHelicopterLandingZone>& Zones, const FHelicopterLandingZone& Zone, int32 MaxResults,
+		float MinSeparation)
+	{
+		const float MinSeparationSquared = FMath::Square(MinSeparation);
+
+		const auto IsSameSpot = [&Zone, MinSeparationSquared](const FHelicopterLandingZone& Other)
+		{
+			return FVector::DistSquared2D(Other.Location, Zone.Location) < MinSeparationSquared;
+		};
+
+		// The same spot, keep its better cell. Checked before anything is removed, a better zone nearby
+		// must not cost the worse ones that are near the new zone but not near the better one
+		for(const FHelicopterLandingZone& Other : Zones)
+		{
+			if(Other.Score <= Zone.Score && IsSameSpot(Other))
+				return;
+		}
+
+		Zones.RemoveAll(IsSameSpot);
+
+		if(Zones.Num() >= MaxResults && Zone.Score >= Zones.Last().Score)
+			return;
+
+		const int32 InsertIndex = Algo::UpperBoundBy(Zones, Zone.Score, &FHelicopterLandingZone::Score);
+		Zones.Insert(Zone, InsertIndex);
+
+		if(Zones.Num() > MaxResults)
+			Zones.Pop(false);
+	}
+}
+
+AHelicopterLandingZoneMap::AHelicopterLandingZoneMap()
+{
+	PrimaryActorTick.bCanEverTick = false;
+
+	BoundsComponent = CreateDefaultSubobject<UBoxComponent>(BoundsComponentName);
+	BoundsComponent->SetBoxExtent(FVector(25000.f, 25000.f, 10000.f));
+	BoundsComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+	BoundsComponent->SetGenerateOverlapEvents(false);
+	BoundsComponent->SetCanEverAffectNavigation(false);
+	BoundsComponent->SetHiddenInGame(true);
+	SetRootComponent(BoundsComponent);
+
+#if WITH_EDITORONLY_DATA
+	// Queries may reach anywhere in the map, not only around streaming sources
+	bIsSpatiallyLoaded = false;
+#endif
+}
+
+void AHelicopterLandingZoneMap::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if(!HasBakedData())
+		HELI_WRN("Landing zone map %s is not baked", *GetName());
+
+	if(UHelicopterLandingZoneSubsystem* LandingZones = GetWorld()->GetSubsystem<UHelicopterLandingZoneSubsystem>())
+		LandingZones->RegisterMap(this);
+}
+
+void AHelicopterLandingZoneMap::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if(UHelicopterLandingZoneSubsystem* LandingZones = GetWorld()->GetSubsystem<UHelicopterLandingZoneSubsystem>())
+		LandingZones->UnregisterMap(this);
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void AHelicopterLandingZoneMap::BakeLandingZones()
+{
+	UWorld* World = GetWorld();
+	if(!World)
+		return;
+
+	const FVector Center = BoundsComponent->GetComponentLocation();
+	const FVector Extent = BoundsComponent->GetScaledBoxExtent();
+
+	GridSize = FIntPoint(
+		FMath::Max(FMath::CeilToInt32(2.f * Extent.X / CellSize), 1),
+		FMath::Max(FMath::CeilToInt32(2.f * Extent.Y / CellSize), 1)
+	);
+
+	GridOrigin = FVector2D(Center.X - 0.5f * GridSize.X * CellSize, Center.Y - 0.5f * GridSize.Y * CellSize);
+	BakedCellSize = CellSize;
+
+	const int32 NumCells = GridSize.X * GridSize.Y;
+
+	Modify();
+
+	CellHeights.SetNumUninitialized(NumCells);
+	CellSlopes.SetNumUninitialized(NumCells);
+	CellClearances.SetNumUninitialized(NumCells);
+
+	// Cells without ground or with something standing in them, nothing lands there and they limit clearance around
+	TBitArray<> Blocked { false, NumCells };
+
+	FScopedSlowTask SlowTask(3.f, FText::FromString(TEXT("Baking landing zones")));
+	SlowTask.MakeDialog();
+
+	// Only static geometry is baked, whatever moves is left to the confirmation probe
+	const FCollisionObjectQueryParams ObjectQueryParams { FCollisionObjectQueryParams::AllStaticObjects };
+	const FCollisionQueryParams QueryParams { SCENE_QUERY_STAT(HelicopterLandingZoneBake), true, this };
+
+	const float HalfObstacleHeight = 0.5f * FMath::Max(RotorHeight - SkidClearance, 1.f);
+	const FCollisionShape CellShape = FCollisionShape::MakeBox(FVector(0.5f * CellSize, 0.5f * CellSize, HalfObstacleHeight));
+
+	SlowTask.EnterProgressFrame();
+
+	for(int32 Y = 0; Y < GridSize.Y; ++Y)
+	{
+		for(int32 X = 0; X < GridSize.X; ++X)
+		{
+			const int32 Index = Y * GridSize.X + X;
+			const FVector2D CellCenter = GetCellCenter(X, Y);
+
+			const FVector Start { CellCenter, Center.Z + Extent.Z };
+			const FVector End { CellCenter, Center.Z - Extent.Z };
+
+			FHitResult Hit {};
+			if(!World->LineTraceSingleByObjectType(Hit, Start, End, ObjectQueryParams, QueryParams))
+			{
+				CellHeights[Index] = End.Z;
+				CellSlopes[Index] = 90.f;
+				Blocked[Index] = true;
+				continue;
+			}
+
+			CellHeights[Index] = Hit.ImpactPoint.Z;
+			CellSlopes[Index] = FMath::RadiansToDegrees(FMath::Acos(FMath::Clamp(Hit.ImpactNormal.Z, -1.f, 1.f)));
+
+			const FVector BoxCenter { CellCenter, Hit.ImpactPoint.Z + SkidClearance + HalfObstacleHeight };
+			Blocked[Index] = World->OverlapAnyTestByObjectType(BoxCenter, FQuat::Identity, ObjectQueryParams, CellShape, QueryParams);
+		}
+	}
+
+	SlowTask.EnterProgressFrame();
+
+	// Surface normal misses bumps between cells, terrain gradient over the neighbours catches them
+	const auto GetHeight = [this, &Blocked](int32 X, int32 Y, int32 FallbackIndex)
+	{
+		const int32 Index = Y * GridSize.X + X;
+		const bool bValid = X >= 0 && X < GridSize.X && Y >= 0 && Y < GridSize.Y && !Blocked[Index];
+
+		return CellHeights[bValid ? Index : FallbackIndex];
+	};
+
+	TArray<float> GradientSlopes {};
+	GradientSlopes.SetNumUninitialized(NumCells);
+
+	for(int32 Y = 0; Y < GridSize.Y; ++Y)
+	{
+		for(int32 X = 0; X < GridSize.X; ++X)
+		{
+			const int32 Index = Y * GridSize.X + X;
+
+			const float GradientX = (GetHeight(X + 1, Y, Index) - GetHeight(X - 1, Y, Index)) / (2.f * CellSize);
+			const float GradientY = (GetHeight(X, Y + 1, Index) - GetHeight(X, Y - 1, Index)) / (2.f * CellSize);
+
+			GradientSlopes[Index] = FMath::RadiansToDegrees(FMath::Atan(FMath::Sqrt(FMath::Square(GradientX) + FMath::Square(GradientY))));
+		}
+	}
+
+	SlowTask.EnterProgressFrame();
+
+	const int32 SearchCells = FMath::CeilToInt32(MaxClearance / CellSize) + 1;
+	int32 NumBlocked = 0;
+
+	for(int32 Y = 0; Y < GridSize.Y; ++Y)
+	{
+		for(int32 X = 0; X < GridSize.X; ++X)
+		{
+			const int32 Index = Y * GridSize.X + X;
+
+			if(Blocked[Index])
+			{
+				CellSlopes[Index] = 90.f;
+				CellClearances[Index] = 0.f;
+				++NumBlocked;
+				continue;
+			}
+
+			CellSlopes[Index] = FMath::Max(CellSlopes[Index], GradientSlopes[Index]);
+
+			// Ground beyond the map is unknown, its edge counts as an obstacle
+			const float EdgeDistance = CellSize * (FMath::Min(FMath::Min(X, GridSize.X - 1 - X), FMath::Min(Y, GridSize.Y - 1 - Y)) + 0.5f);
+			float Clearance = FMath::Min(MaxClearance, EdgeDistance);
+
+			// Terrain rising above the rotor is an obstacle as much as anything standing on it
+			const float MaxGroundHeight = CellHeights[Index] + RotorHeight;
+
+			for(int32 OtherY = FMath::Max(Y - SearchCells, 0); OtherY <= FMath::Min(Y + SearchCells, GridSize.Y - 1); ++OtherY)
+			{
+				for(int32 OtherX = FMath::Max(X - SearchCells, 0); OtherX <= FMath::Min(X + SearchCells, GridSize.X - 1); ++OtherX)
+				{
+					// To the near side of the other cell, roughly
+					const float Distance = CellSize * FMath::Max(FMath::Sqrt(static_cast<float>(FMath::Square(OtherX - X) + FMath::Square(OtherY - Y))) - 0.5f, 0.f);
+					if(Distance >= Clearance)
+						continue;
+
+					const int32 OtherIndex = OtherY * GridSize.X + OtherX;
+
+					if(Blocked[OtherIndex] || CellHeights[OtherIndex] > MaxGroundHeight)
+						Clearance = Distance;
+				}
+			}
+
+			CellClearances[Index] = Clearance;
+		}
+	}
+
+	BakeBlocks();
+
+	HELI_LOG("Baked landing zone map %s, %d x %d cells, %d of them blocked", *GetName(), GridSize.X, GridSize.Y, NumBlocked);
+}
+
+bool AHelicopterLandingZoneMap::HasBakedData() const
+{
+	return BakedCellSize > 0.f && CellHeights.Num() == GridSize.X * GridSize.Y && !CellHeights.IsEmpty();
+}
+
+void AHelicopterLandingZoneMap::FindLandingZones(const FVector& Location, float Radius,
+	const FHelicopterLandingZoneRequirements& Requirements, int32 MaxResults, TArray<FHelicopterLandingZone>& InOutZones) const
+{
+	if(!HasBakedData() || MaxResults <= 0 || Radius <= 0.f)
+		return;
+
+	const float MaxSlope = FMath::Max(Requirements.MaxSlopeDegrees, UE_KINDA_SMALL_NUMBER);
+	const float InvRadius = 1.f / Radius;
+	const float SlopeScale = Requirements.SlopeWeight / MaxSlope;
+	const float MinSeparation = 2.f * Requirements.RotorRadius;
+
+	const FVector2D Location2D { Location };
+	const float BlockExtent = BakedCellSize * BlockSize;
+
+	const FIntPoint MinBlock {
+		FMath::Max(FMath::FloorToInt32((Location2D.X - Radius - GridOrigin.X) / BlockExtent), 0),
+		FMath::Max(FMath::FloorToInt32((Location2D.Y - Radius - GridOrigin.Y) / BlockExtent), 0)
+	};
+
+	const FIntPoint MaxBlock {
+		FMath::Min(FMath::FloorToInt32((Location2D.X + Radius - GridOrigin.X) / BlockExtent), BlockGridSize.X - 1),
+		FMath::Min(FMath::FloorToInt32((Location2D.Y + Radius - GridOrigin.Y) / BlockExtent), BlockGridSize.Y - 1)
+	};
+
+	// Blocks that may hold a zone with the best score any of their cells could have, best first
+	TArray<TPair<float, int32>, TInlineAllocator<64>> Blocks {};
+
+	for(int32 BlockY = MinBlock.Y; BlockY <= MaxBlock.Y; ++BlockY)
+	{
+		for(int32 BlockX = MinBlock.X; BlockX <= MaxBlock.X; ++BlockX)
+		{
+			const int32 BlockIndex = BlockY * BlockGridSize.X + BlockX;
+
+			if(BlockMinSlopes[BlockIndex] > MaxSlope || BlockMaxClearances[BlockIndex] < Requirements.RotorRadius)
+				continue;
+
+			const FVector2D BlockMin = GridOrigin + FVector2D(BlockX * BlockExtent, BlockY * BlockExtent);
+			const FBox2D BlockBox { BlockMin, BlockMin + FVector2D(BlockExtent) };
+
+			const float DistanceSquared = BlockBox.ComputeSquaredDistanceToPoint(Location2D);
+			if(DistanceSquared > FMath::Square(Radius))
+				continue;
+
+			Blocks.Emplace(FMath::Sqrt(DistanceSquared) * InvRadius + BlockMinSlopes[BlockIndex] * SlopeScale, BlockIndex);
+		}
+	}
+
+	Blocks.Sort([](const TPair<float, int32>& A, const TPair<float, int32>& B)
+	{
+		return A.Key < B.Key;
+	});
+
+	for(const TPair<float, int32>& Block : Blocks)
+	{
+		// Neither this block nor the ones after it can beat the worst zone found
+		if(InOutZones.Num() >= MaxResults && Block.Key >= InOutZones.Last().Score)
+			break;
+
+		const int32 FirstX = (Block.Value % BlockGridSize.X) * BlockSize;
+		const int32 FirstY = (Block.Value / BlockGridSize.X) * BlockSize;
+
+		for(int32 Y = FirstY; Y < FMath::Min(FirstY + BlockSize, GridSize.Y); ++Y)
+		{
+			for(int32 X = FirstX; X < FMath::Min(FirstX + BlockSize, GridSize.X); ++X)
+			{
+				const int32 Index = Y * GridSize.X + X;
+
+				if(CellSlopes[Index] > MaxSlope || CellClearances[Index] < Requirements.RotorRadius)
+					continue;
+
+				const FVector2D CellCenter = GetCellCenter(X, Y);
+
+				const float DistanceSquared = FVector2D::DistSquared(CellCenter, Location2D);
+				if(DistanceSquared > FMath::Square(Radius))
+					continue;
+
+				FHelicopterLandingZone Zone {};
+				Zone.Distance = FMath::Sqrt(DistanceSquared);
+				Zone.Score = Zone.Distance * InvRadius + CellSlopes[Index] * SlopeScale;
+
+				if(InOutZones.Num() >= MaxResults && Zone.Score >= InOutZones.Last().Score)
+					continue;
+
+				Zone.Location = FVector(CellCenter, CellHeights[Index]);
+				Zone.SlopeDegrees = CellSlopes[Index];
+				Zone.Clearance = CellClearances[Index];
+				Zone.SkidClearance = SkidClearance;
+
+				HelicopterLandingZones::InsertZone(InOutZones, Zone, MaxResults, MinSeparation);
+			}
+		}
+	}
+}
+
+FVector2D AHelicopterLandingZoneMap::GetCellCenter(int32 X, int32 Y) const
+{
+	return GridOrigin + FVector2D(X + 0.5f, Y + 0.5f) * BakedCellSize;
+}
+
+void AHelicopterLandingZoneMap::BakeBlocks()
+{
+	BlockGridSize = FIntPoint(
+		FMath::DivideAndRoundUp(GridSize.X, BlockSize),
+		FMath::DivideAndRoundUp(GridSize.Y, BlockSize)
+	);
+
+	const int32 NumBlocks = BlockGridSize.X * BlockGridSize.Y;
+
+	BlockMinSlopes.Init(90.f, NumBlocks);
+	BlockMaxClearances.Init(0.f, NumBlocks);
+
+	for(int32 Y = 0; Y < GridSize.Y; ++Y)
+	{
+		for(int32 X = 0; X < GridSize.X; ++X)
+		{
+			const int32 Index = Y * GridSize.X + X;
+			const int32 BlockIndex = (Y / BlockSize) * BlockGridSize.X + X / BlockSize;
+
+			BlockMinSlopes[BlockIndex] = FMath::Min(BlockMinSlopes[BlockIndex], CellSlopes[Index]);
+			BlockMaxClearances[BlockIndex] = FMath::Max(BlockMaxClearances[BlockIndex], CellClearances[Index]);
+		}
+	}
+}
@@ -0,0 +1,161 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "GameFramework/Actor.h"
+#include "HelicopterLandingZoneMap.generated.h"
+
+class UBoxComponent;
+
+USTRUCT(BlueprintType)
+struct FHelicopterLandingZoneRequirements
+{
+	GENERATED_BODY()
+
+	// The steepest ground skids can stand on
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin=0.0, ClampMax=90.0))
+	float MaxSlopeDegrees { 8.f };
+
+	// Free space needed around the zone, in cm
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin=0.0))
+	float RotorRadius { 800.f };
+
+	// Height of the rotor disc above ground, in cm. Used by the confirmation probe
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin=0.0))
+	float RotorHeight { 400.f };
+
+	// How much a flat zone further away is preferred over a sloped one nearby, 1 weighs them the same
+	UPROPERTY(EditAnywhere, BlueprintReadWrite, meta=(ClampMin=0.0))
+	float SlopeWeight { 1.f };
+};
+
+USTRUCT(BlueprintType)
+struct FHelicopterLandingZone
+{
+	GENERATED_BODY()
+
+	// Center of the zone on the ground
+	UPROPERTY(BlueprintReadOnly)
+	FVector Location { FVector::ZeroVector };
+
+	UPROPERTY(BlueprintReadOnly)
+	float SlopeDegrees { 0.f };
+
+	// Horizontal distance to the nearest obstacle at bake time
+	UPROPERTY(BlueprintReadOnly)
+	float Clearance { 0.f };
+
+	// Obstacles lower than this were not obstacles for the bake, the confirmation probe ignores them too
+	UPROPERTY(BlueprintReadOnly)
+	float SkidClearance { 0.f };
+
+	// Horizontal distance from the query location
+	UPROPERTY(BlueprintReadOnly)
+	float Distance { 0.f };
+
+	// Distance relative to the radius plus weighted slope relative to the max slope, lower is better
+	UPROPERTY(BlueprintReadOnly)
+	float Score { 0.f };
+};
+
+/**
+ * Baked slope and obstacle clearance of a level area, for finding landing zones without traces.
+ * Place it over the area, size the box and press Bake Landing Zones, bake again whenever the level
+ * or the actor changes. Grid is aligned with world axes, rotation of the actor is ignored.
+ * Every cell keeps ground height, slope and distance to the nearest obstacle reaching into the rotor disc.
+ * Blocks of cells keep their best slope and clearance, so queries skip whole blocks that can't hold a zone
+ * or can't beat zones found so far. Queries go through UHelicopterLandingZoneSubsystem.
+ */
+UCLASS()
+class HELI_API AHelicopterLandingZoneMap : public AActor
+{
+	GENERATED_BODY()
+
+public:
+
+	inline static FName BoundsComponentName { TEXT("BoundsComponent") };
+
+	// Side of a block in cells
+	static constexpr int32 BlockSize { 8 };
+
+	AHelicopterLandingZoneMap();
+
+	// Traces the area covered by the box, takes a while for big areas
+	UFUNCTION(CallInEditor, Category="Utils")
+	void BakeLandingZones();
+
+	UFUNCTION(BlueprintCallable)
+	bool HasBakedData() const;
+
+	// Adds zones within Radius around Location to InOutZones, which stays sorted by score and at most MaxResults long.
+	// Zones closer to each other than rotor diameter are the same spot, only the better one is kept
+	void FindLandingZones(
+		const FVector& Location,
+		float Radius,
+		const FHelicopterLandingZoneRequirements& Requirements,
+		int32 MaxResults,
+		TArray<FHelicopterLandingZone>& InOutZones
+	) const;
+
+protected:
+
+	UPROPERTY(VisibleAnywhere)
+	TObjectPtr<UBoxComponent> BoundsComponent {};
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=50.0))
+	float CellSize { 400.f };
+
+	// Rotor height of the tallest helicopter that lands here, anything standing lower than that is an obstacle
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float RotorHeight { 400.f };
+
+	// Grass, curbs and debris lower than this are not obstacles
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float SkidClearance { 50.f };
+
+	// Clearance is searched up to this distance, more than rotor radius of any helicopter is wasted bake time
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float MaxClearance { 2000.f };
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+
+	UPROPERTY(VisibleAnywhere)
+	FIntPoint GridSize { FIntPoint::ZeroValue };
+
+	UPROPERTY()
+	FIntPoint BlockGridSize { FIntPoint::ZeroValue };
+
+	// World location of the grid corner with the lowest X and Y
+	UPROPERTY()
+	FVector2D GridOrigin { FVector2D::ZeroVector };
+
+	UPROPERTY()
+	float BakedCellSize { 0.f };
+
+	// Per cell data, row by row. Kept in separate arrays so queries only touch what they compare
+
+	UPROPERTY()
+	TArray<float> CellHeights {};
+
+	// Steepest of the surface under the cell and the terrain around it, 90 where nothing can land
+	UPROPERTY()
+	TArray<float> CellSlopes {};
+
+	// Zero where something stands in the cell itself
+	UPROPERTY()
+	TArray<float> CellClearances {};
+
+	UPROPERTY()
+	TArray<float> BlockMinSlopes {};
+
+	UPROPERTY()
+	TArray<float> BlockMaxClearances {};
+
+	FVector2D GetCellCenter(int32 X, int32 Y) const;
+
+	void BakeBlocks();
+
+};
@@ -0,0 +1,506 @@
+﻿#include "HeliReplicationGraph.h"
+
+#include "Engine/ChildConnection.h"
+#include "Engine/NetDriver.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Heli/HeliStats.h"
+#include "Heli/Vehicles/Helicopters/Helicopter.h"
+
+DECLARE_CYCLE_STAT(TEXT("Replication Graph Helicopters"), STAT_HeliRepGraphHelicopters, STATGROUP_Heli);
+
+static TAutoConsoleVariable<bool> CVarHeliRepGraphEnabled(
+	TEXT("heli.RepGraph.Enabled"),
+	false,
+	TEXT("Replicate through UHeliReplicationGraph instead of the default net driver replication. Read when the net driver starts"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliRepGraphCellSize(
+	TEXT("heli.RepGraph.CellSize"),
+	10000.f,
+	TEXT("Cell size in cm of the grid everything except helicopters is spatialized in. Read when the net driver starts"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliRepGraphSpatialBias(
+	TEXT("heli.RepGraph.SpatialBias"),
+	-2000000.f,
+	TEXT("Lowest X and Y in cm the grid expects, locations below it share the border cells. Read when the net driver starts"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliRepGraphFullRateDistance(
+	TEXT("heli.RepGraph.FullRateDistance"),
+	30000.f,
+	TEXT("Helicopters closer to the viewer than this in cm are replicated every frame, every doubling of it halves the rate"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliRepGraphMaxAngularError(
+	TEXT("heli.RepGraph.MaxAngularError"),
+	0.5f,
+	TEXT("Degrees a helicopter may move in the view between replications, faster ones get a higher rate than their distance gives"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliRepGraphThreatHorizon(
+	TEXT("heli.RepGraph.ThreatHorizon"),
+	5.f,
+	TEXT("Seconds ahead a helicopter is checked for collision course with the viewer"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliRepGraphThreatDistance(
+	TEXT("heli.RepGraph.ThreatDistance"),
+	5000.f,
+	TEXT("Helicopters predicted to get closer to the viewer than this in cm are replicated every frame"),
+	ECVF_Default
+);
+
+namespace HeliReplicationGraph
+{
+	EHeliClassRepPolicy MakeClassRepPolicy(const UClass* Class)
+	{
+		const AActor* DefaultActor = Class->GetDefaultObject<AActor>();
+
+		if(!DefaultActor || !DefaultActor->GetIsReplicated())
+			return EHeliClassRepPolicy::NotRouted;
+
+		if(Class->IsChildOf<AHelicopter>())
+			return EHeliClassRepPolicy::Helicopter;
+
+		// The connection node replicates player controllers to their owner
+		if(Class->IsChildOf<APlayerController>())
+			return EHeliClassRepPolicy::NotRouted;
+
+		if(DefaultActor->bOnlyRelevantToOwner)
+			return EHeliClassRepPolicy::RelevantOwnerConnection;
+
+		if(DefaultActor->bAlwaysRelevant)
+			return EHeliClassRepPolicy::RelevantAllConnections;
+
+		if(!DefaultActor->IsReplicatingMovement())
+			return EHeliClassRepPolicy::SpatializeStatic;
+
+		if(DefaultActor->NetDormancy > DORM_Awake)
+			return EHeliClassRepPolicy::SpatializeDormancy;
+
+		return EHeliClassRepPolicy::SpatializeDynamic;
+	}
+
+	// Split screen players own actors through child connections, the graph has nodes for their parents
+	UNetConnection* GetOwningConnection(const AActor* Actor)
+	{
+		UNetConnection* Connection = IsValid(Actor) ? Actor->GetNetConnection() : nullptr;
+		const UChildConnection* ChildConnection = Connection ? Connection->GetUChildConnection() : nullptr;
+
+		return ChildConnection ? ChildConnection->Parent : Connection;
+	}
+}
+
+UHeliReplicationGraphNode_Helicopters::UHeliReplicationGraphNode_Helicopters()
+{
+	bRequiresPrepareForReplicationCall = true;
+}
+
+void UHeliReplicationGraphNode_Helicopters::NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo)
+{
+	Helicopters.AddUnique(ActorInfo.Actor);
+}
+
+bool UHeliReplicationGraphNode_Helicopters::NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo,
+	bool bWarnIfNotFound)
+{
+	// Order doesn't matter, tiers are spread over frames by index anyway
+	return Helicopters.RemoveSingleSwap(ActorInfo.Actor, false) > 0;
+}
+
+void UHeliReplicationGraphNode_Helicopters::NotifyResetAllNetworkActors()
+{
+	Helicopters.Reset();
+	Snapshots.Reset();
+}
+
+void UHeliReplicationGraphNode_Helicopters::PrepareForReplication()
+{
+	SCOPE_CYCLE_COUNTER(STAT_HeliRepGraphHelicopters);
+
+	const UWorld* World = GraphGlobals.IsValid() ? GraphGlobals->World : nullptr;
+	FrameDeltaTime = World ? World->GetDeltaSeconds() : 0.f;
+
+	Snapshots.Reset(Helicopters.Num());
+
+	for(AActor* Actor : Helicopters)
+	{
+		// Pooled helicopters are hidden and frozen, their channels time out and close
+		const AHelicopter* Helicopter = Cast<AHelicopter>(Actor);
+		if(!IsValid(Helicopter) || Helicopter->IsInPool())
+			continue;
+
+		FHelicopterSnapshot& Snapshot = Snapshots.AddDefaulted_GetRef();
+		Snapshot.Actor = Actor;
+		Snapshot.Location = Actor->GetActorLocation();
+		Snapshot.Velocity = Actor->GetVelocity();
+		Snapshot.CullDistanceSquared = Actor->NetCullDistanceSquared;
+	}
+}
+
+void UHeliReplicationGraphNode_Helicopters::GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params)
+{
+	SCOPE_CYCLE_COUNTER(STAT_HeliRepGraphHelicopters);
+
+	DueHelicopters.Reset(Snapshots.Num());
+	FastSharedHelicopters.Reset(Snapshots.Num());
+
+	for(int32& Count : LastTierCounts)
+	{
+		Count = 0;
+	}
+
+	TArray<FVector, TInlineAllocator<4>> ViewerVelocities {};
+	for(const FNetViewer& Viewer : Params.Viewers)
+	{
+		ViewerVelocities.Add(Viewer.ViewTarget ? Viewer.ViewTarget->GetVelocity() : FVector::ZeroVector);
+	}
+
+	for(int32 Index = 0; Index < Snapshots.Num(); ++Index)
+	{
+		const FHelicopterSnapshot& Snapshot = Snapshots[Index];
+
+		// Split screen has several viewers, the closest one decides
+		int32 Tier = INDEX_NONE;
+		for(int32 ViewerIndex = 0; ViewerIndex < Params.Viewers.Num(); ++ViewerIndex)
+		{
+			const int32 ViewerTier = GetTier(Snapshot, Params.Viewers[ViewerIndex], ViewerVelocities[ViewerIndex]);
+
+			if(ViewerTier != INDEX_NONE && (Tier == INDEX_NONE || ViewerTier < Tier))
+				Tier = ViewerTier;
+		}
+
+		if(Tier == INDEX_NONE)
+			continue;
+
+		++LastTierCounts[Tier];
+
+		// Offset by index, so helicopters of a tier take turns instead of all replicating on the same frame
+		const uint32 Period = 1u << Tier;
+		if((Params.ReplicationFrameNum + Index) % Period == 0)
+			DueHelicopters.Add(Snapshot.Actor);
+		else
+			FastSharedHelicopters.Add(Snapshot.Actor);
+	}
+
+	if(DueHelicopters.Num() > 0)
+		Params.OutGatheredReplicationLists.AddReplicationActorList(DueHelicopters);
+
+	if(FastSharedHelicopters.Num() > 0)
+		Params.OutGatheredReplicationLists.AddReplicationActorList(FastSharedHelicopters, EActorRepListTypeFlags::FastShared);
+}
+
+void UHeliReplicationGraphNode_Helicopters::LogNode(FReplicationGraphDebugInfo& DebugInfo, const FString& NodeName) const
+{
+	DebugInfo.Log(NodeName);
+	DebugInfo.PushIndent();
+
+	DebugInfo.Log(FString::Printf(TEXT("%d helicopters, %d active. Tiers of the last connection: %d, %d, %d, %d"),
+		Helicopters.Num(),
+		Snapshots.Num(),
+		LastTierCounts[0],
+		LastTierCounts[1],
+		LastTierCounts[2],
+		LastTierCounts[3]
+	));
+
+	DebugInfo.PopIndent();
+}
+
+uint32 UHeliReplicationGraphNode_Helicopters::GetMaxReplicationPeriodFrame()
+{
+	return 1u << (NumTiers - 1);
+}
+
+int32 UHeliReplicationGraphNode_Helicopters::GetTier(const FHelicopterSnapshot& Snapshot, const FNetViewer& Viewer,
+	const FVector& ViewerVelocity) const
+{
+	// Helicopter the client flies or watches
+	if(Snapshot.Actor == Viewer.ViewTarget || (Viewer.InViewer && Snapshot.Actor == Viewer.InViewer->GetPawn()))
+		return 0;
+
+	const FVector RelativeLocation = Snapshot.Location - Viewer.ViewLocation;
+	const float DistanceSquared = RelativeLocation.SizeSquared();
+
+	if(Snapshot.CullDistanceSquared > 0.f && DistanceSquared > Snapshot.CullDistanceSquared)
+		return INDEX_NONE;
+
+	const FVector RelativeVelocity = Snapshot.Velocity - ViewerVelocity;
+	const float RelativeSpeedSquared = RelativeVelocity.SizeSquared();
+
+	// Closest approach with both keeping their velocities, the same prediction conflicts of the spatial hash use
+	const float ThreatHorizon = FMath::Max(CVarHeliRepGraphThreatHorizon.GetValueOnGameThread(), 0.f);
+	const float Time = RelativeSpeedSquared > UE_KINDA_SMALL_NUMBER
+		? FMath::Clamp(-RelativeLocation.Dot(RelativeVelocity) / RelativeSpeedSquared, 0.f, ThreatHorizon)
+		: 0.f;
+
+	const float ThreatDistance = CVarHeliRepGraphThreatDistance.GetValueOnGameThread();
+	if((RelativeLocation + RelativeVelocity * Time).SizeSquared() < FMath::Square(ThreatDistance))
+		return 0;
+
+	const float Distance = FMath::Sqrt(DistanceSquared);
+	const float FullRateDistance = FMath::Max(CVarHeliRepGraphFullRateDistance.GetValueOnGameThread(), 1.f);
+
+	const int32 DistanceTier = Distance > FullRateDistance
+		? FMath::FloorToInt32(FMath::Log2(Distance / FullRateDistance)) + 1
+		: 0;
+
+	// Frames helicopter can go without an update before it jumps more than the max angle in the view
+	const float MaxAngle = FMath::DegreesToRadians(CVarHeliRepGraphMaxAngularError.GetValueOnGameThread());
+	const float MovePerFrame = FMath::Sqrt(RelativeSpeedSquared) * FrameDeltaTime;
+
+	const int32 SpeedTier = MovePerFrame > UE_KINDA_SMALL_NUMBER
+		? FMath::FloorToInt32(FMath::Log2(FMath::Max(MaxAngle * Distance / MovePerFrame, 1.f)))
+		: NumTiers - 1;
+
+	return FMath::Min3(DistanceTier, SpeedTier, NumTiers - 1);
+}
+
+void UHeliReplicationGraph::RegisterReplicationDriver()
+{
+	UReplicationDriver::CreateReplicationDriverDelegate().BindLambda(
+		[](UNetDriver* ForNetDriver, const FURL& URL, UWorld* World) -> UReplicationDriver*
+		{
+			// Demo and beacon drivers keep the default replication
+			if(!ForNetDriver || ForNetDriver->NetDriverName != NAME_GameNetDriver)
+				return nullptr;
+
+			if(!CVarHeliRepGraphEnabled.GetValueOnGameThread())
+				return nullptr;
+
+			return NewObject<UHeliReplicationGraph>(GetTransientPackage());
+		}
+	);
+}
+
+void UHeliReplicationGraph::InitGlobalActorClassSettings()
+{
+	Super::InitGlobalActorClassSettings();
+
+	ClassRepPolicies.InitNewElement = [](UClass* Class, EHeliClassRepPolicy& Policy)
+	{
+		Policy = HeliReplicationGraph::MakeClassRepPolicy(Class);
+		return true;
+	};
+
+	GlobalActorReplicationInfoMap.SetInitClassInfoFunc([this](UClass* Class, FClassReplicationInfo& ClassInfo)
+	{
+		return InitClassReplicationInfo(Class, ClassInfo);
+	});
+}
+
+void UHeliReplicationGraph::InitGlobalGraphNodes()
+{
+	GridNode = CreateNewNode<UReplicationGraphNode_GridSpatialization2D>();
+	GridNode->CellSize = FMath::Max(CVarHeliRepGraphCellSize.GetValueOnGameThread(), 100.f);
+	GridNode->SpatialBias = FVector2D(CVarHeliRepGraphSpatialBias.GetValueOnGameThread());
+	AddGlobalGraphNode(GridNode);
+
+	AlwaysRelevantNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddGlobalGraphNode(AlwaysRelevantNode);
+
+	HelicopterNode = CreateNewNode<UHeliReplicationGraphNode_Helicopters>();
+	AddGlobalGraphNode(HelicopterNode);
+}
+
+void UHeliReplicationGraph::InitConnectionGraphNodes(UNetReplicationGraphConnection* ConnectionManager)
+{
+	Super::InitConnectionGraphNodes(ConnectionManager);
+
+	// Player controller of the connection and its view target
+	UReplicationGraphNode_AlwaysRelevant_ForConnection* ConnectionNode =
+		CreateNewNode<UReplicationGraphNode_AlwaysRelevant_ForConnection>();
+
+	AddConnectionGraphNode(ConnectionNode, ConnectionManager);
+
+	// Actors the connection owns, filled by RouteOwnerOnlyActors
+	UReplicationGraphNode_ActorList* OwnerOnlyNode = CreateNewNode<UReplicationGraphNode_ActorList>();
+	AddConnectionGraphNode(OwnerOnlyNode, ConnectionManager);
+	OwnerOnlyNodes.Add(ConnectionManager->NetConnection, OwnerOnlyNode);
+}
+
+void UHeliReplicationGraph::RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo,
+	FGlobalActorReplicationInfo& GlobalInfo)
+{
+	switch(GetClassRepPolicy(ActorInfo.Class))
+	{
+	case EHeliClassRepPolicy::RelevantAllConnections:
+		AlwaysRelevantNode->NotifyAddNetworkActor(ActorInfo);
+		break;
+
+	case EHeliClassRepPolicy::RelevantOwnerConnection:
+	{
+		// Owner is often set after spawn, the actor waits for it in the list
+		FOwnerOnlyActor& OwnerOnlyActor = OwnerOnlyActors.AddDefaulted_GetRef();
+		OwnerOnlyActor.Actor = ActorInfo.Actor;
+		SetOwnerOnlyActorConnection(OwnerOnlyActor, HeliReplicationGraph::GetOwningConnection(ActorInfo.Actor));
+		break;
+	}
+
+	case EHeliClassRepPolicy::Helicopter:
+		HelicopterNode->NotifyAddNetworkActor(ActorInfo);
+		break;
+
+	case EHeliClassRepPolicy::SpatializeStatic:
+		GridNode->AddActor_Static(ActorInfo, GlobalInfo);
+		break;
+
+	case EHeliClassRepPolicy::SpatializeDynamic:
+		GridNode->AddActor_Dynamic(ActorInfo, GlobalInfo);
+		break;
+
+	case EHeliClassRepPolicy::SpatializeDormancy:
+		GridNode->AddActor_Dormancy(ActorInfo, GlobalInfo);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void UHeliReplicationGraph::RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo)
+{
+	switch(GetClassRepPolicy(ActorInfo.Class))
+	{
+	case EHeliClassRepPolicy::RelevantAllConnections:
+		AlwaysRelevantNode->NotifyRemoveNetworkActor(ActorInfo);
+		break;
+
+	case EHeliClassRepPolicy::RelevantOwnerConnection:
+	{
+		const int32 Index = OwnerOnlyActors.IndexOfByPredicate([&ActorInfo](const FOwnerOnlyActor& OwnerOnlyActor)
+		{
+			return OwnerOnlyActor.Actor == ActorInfo.Actor;
+		});
+
+		if(Index != INDEX_NONE)
+		{
+			SetOwnerOnlyActorConnection(OwnerOnlyActors[Index], nullptr);
+			OwnerOnlyActors.RemoveAtSwap(Index);
+		}
+		break;
+	}
+
+	case EHeliClassRepPolicy::Helicopter:
+		HelicopterNode->NotifyRemoveNetworkActor(ActorInfo);
+		break;
+
+	case EHeliClassRepPolicy::SpatializeStatic:
+		GridNode->RemoveActor_Static(ActorInfo);
+		break;
+
+	case EHeliClassRepPolicy::SpatializeDynamic:
+		GridNode->RemoveActor_Dynamic(ActorInfo);
+		break;
+
+	case EHeliClassRepPolicy::SpatializeDormancy:
+		GridNode->RemoveActor_Dormancy(ActorInfo);
+		break;
+
+	default:
+		break;
+	}
+}
+
+void UHeliReplicationGraph::RemoveClientConnection(UNetConnection* NetConnection)
+{
+	// Node goes away with the connection, actors wait for a new owner
+	for(FOwnerOnlyActor& OwnerOnlyActor : OwnerOnlyActors)
+	{
+		if(OwnerOnlyActor.Connection == NetConnection)
+			OwnerOnlyActor.Connection = nullptr;
+	}
+
+	OwnerOnlyNodes.Remove(NetConnection);
+
+	Super::RemoveClientConnection(NetConnection);
+}
+
+int32 UHeliReplicationGraph::ServerReplicateActors(float DeltaSeconds)
+{
+	RouteOwnerOnlyActors();
+
+	return Super::ServerReplicateActors(DeltaSeconds);
+}
+
+void UHeliReplicationGraph::RouteOwnerOnlyActors()
+{
+	for(FOwnerOnlyActor& OwnerOnlyActor : OwnerOnlyActors)
+	{
+		UNetConnection* Connection = HeliReplicationGraph::GetOwningConnection(OwnerOnlyActor.Actor);
+
+		if(Connection != OwnerOnlyActor.Connection)
+			SetOwnerOnlyActorConnection(OwnerOnlyActor, Connection);
+	}
+}
+
+void UHeliReplicationGraph::SetOwnerOnlyActorConnection(FOwnerOnlyActor& OwnerOnlyActor, UNetConnection* Connection)
+{
+	if(OwnerOnlyActor.Connection)
+	{
+		if(const TObjectPtr<UReplicationGraphNode_ActorList>* Node = OwnerOnlyNodes.Find(OwnerOnlyActor.Connection))
+			(*Node)->NotifyRemoveNetworkActor(FNewReplicatedActorInfo(OwnerOnlyActor.Actor));
+	}
+
+	// Connection may not have its nodes yet or be closing already
+	const TObjectPtr<UReplicationGraphNode_ActorList>* NewNode = Connection ? OwnerOnlyNodes.Find(Connection) : nullptr;
+	OwnerOnlyActor.Connection = NewNode ? Connection : nullptr;
+
+	if(NewNode)
+		(*NewNode)->NotifyAddNetworkActor(FNewReplicatedActorInfo(OwnerOnlyActor.Actor));
+}
+
+EHeliClassRepPolicy UHeliReplicationGraph::GetClassRepPolicy(UClass* Class)
+{
+	const EHeliClassRepPolicy* Policy = ClassRepPolicies.Get(Class);
+
+	return Policy ? *Policy : EHeliClassRepPolicy::NotRouted;
+}
+
+bool UHeliReplicationGraph::InitClassReplicationInfo(UClass* Class, FClassReplicationInfo& ClassInfo)
+{
+	const AActor* DefaultActor = Class->GetDefaultObject<AActor>();
+	if(!DefaultActor)
+		return false;
+
+	const EHeliClassRepPolicy Policy = GetClassRepPolicy(Class);
+
+	if(Policy == EHeliClassRepPolicy::Helicopter)
+	{
+		// Helicopter node decides how often they replicate, every gathered helicopter is sent
+		ClassInfo.ReplicationPeriodFrame = 1;
+
+		// Movement on the frames a connection doesn't get the full helicopter
+		ClassInfo.FastSharedReplicationFunc = [](AActor* Actor)
+		{
+			AHelicopter* Helicopter = Cast<AHelicopter>(Actor);
+			return Helicopter && Helicopter->UpdateSharedReplication();
+		};
+		ClassInfo.FastSharedReplicationFuncName = GET_FUNCTION_NAME_CHECKED(AHelicopter, FastSharedReplication);
+
+		// Channels of the slowest tier must survive the frames it's not gathered on
+		const uint32 ChannelTimeout = 2 * UHeliReplicationGraphNode_Helicopters::GetMaxReplicationPeriodFrame() + 4;
+		ClassInfo.ActorChannelFrameTimeout = static_cast<uint8>(FMath::Min(ChannelTimeout, 255u));
+	}
+	else
+	{
+		ClassInfo.ReplicationPeriodFrame = GetReplicationPeriodFrameForFrequency(FMath::Max(DefaultActor->NetUpdateFrequency, 0.1f));
+	}
+
+	const bool bIgnoresDistance = Policy == EHeliClassRepPolicy::NotRouted
+		|| Policy == EHeliClassRepPolicy::RelevantAllConnections
+		|| Policy == EHeliClassRepPolicy::RelevantOwnerConnection;
+
+	if(!bIgnoresDistance)
+		ClassInfo.SetCullDistanceSquared(DefaultActor->NetCullDistanceSquared);
+
+	return true;
+}
@@ -0,0 +1,159 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "ReplicationGraph.h"
+#include "HeliReplicationGraph.generated.h"
+
+class UReplicationGraphNode_ActorList;
+class UReplicationGraphNode_GridSpatialization2D;
+
+// How an actor class is routed to the nodes of UHeliReplicationGraph
+enum class EHeliClassRepPolicy : uint8
+{
+	// Not replicated, or a player controller which the connection node takes care of
+	NotRouted,
+	RelevantAllConnections,
+	// Replicated only to the owner, kept in the node of the owning connection
+	RelevantOwnerConnection,
+	Helicopter,
+	// Put into the grid once, their replicated location never changes
+	SpatializeStatic,
+	SpatializeDynamic,
+	SpatializeDormancy
+};
+
+/**
+ * Replicates helicopters outside of the spatial grid, fast movers would skip cells between grid updates.
+ * Location and velocity of every helicopter are read once per frame and shared by all connections.
+ * For each connection helicopters are put into tiers replicated every 1, 2, 4 or 8 frames. Tier is picked
+ * by distance and by how far helicopter moves in the view between updates, so a fast one far away
+ * replicates as often as a slow one nearby. Helicopter the connection flies or looks at and helicopters
+ * on collision course with it are replicated every frame.
+ * Helicopters within a tier are spread over frames, so a tier doesn't replicate all at once.
+ * On the frames between, helicopters the connection still sees get only their movement through the fast shared
+ * path. AHelicopter::FastSharedReplication is serialized once per frame and the same bunch goes to every connection.
+ */
+UCLASS()
+class HELI_API UHeliReplicationGraphNode_Helicopters : public UReplicationGraphNode
+{
+	GENERATED_BODY()
+
+public:
+
+	static constexpr int32 NumTiers { 4 };
+
+	UHeliReplicationGraphNode_Helicopters();
+
+	virtual void NotifyAddNetworkActor(const FNewReplicatedActorInfo& ActorInfo) override;
+
+	virtual bool NotifyRemoveNetworkActor(const FNewReplicatedActorInfo& ActorInfo, bool bWarnIfNotFound = true) override;
+
+	virtual void NotifyResetAllNetworkActors() override;
+
+	virtual void PrepareForReplication() override;
+
+	virtual void GatherActorListsForConnection(const FConnectionGatherActorListParameters& Params) override;
+
+	virtual void LogNode(FReplicationGraphDebugInfo& DebugInfo, const FString& NodeName) const override;
+
+	// Frames between replications of the slowest tier, channels of helicopters must stay open that long
+	static uint32 GetMaxReplicationPeriodFrame();
+
+private:
+
+	struct FHelicopterSnapshot
+	{
+		AActor* Actor { nullptr };
+		FVector Location { FVector::ZeroVector };
+		FVector Velocity { FVector::ZeroVector };
+		float CullDistanceSquared { 0.f };
+	};
+
+	TArray<AActor*> Helicopters {};
+
+	// Taken once per frame in PrepareForReplication
+	TArray<FHelicopterSnapshot> Snapshots {};
+
+	// Rebuilt for every connection, gathered lists are replicated before the next connection is gathered
+	FActorRepListRefView DueHelicopters {};
+
+	// Relevant but not due helicopters of the connection, they get shared movement only
+	FActorRepListRefView FastSharedHelicopters {};
+
+	float FrameDeltaTime { 0.f };
+
+	// Tiers gathered for the last connection, for "Net.RepGraph.PrintGraph"
+	TStaticArray<int32, NumTiers> LastTierCounts { InPlace, 0 };
+
+	int32 GetTier(const FHelicopterSnapshot& Snapshot, const FNetViewer& Viewer, const FVector& ViewerVelocity) const;
+
+};
+
+/**
+ * Replication graph of the project. Opt-in with heli.RepGraph.Enabled, e.g. -dpcvars=heli.RepGraph.Enabled=1,
+ * until it's benchmarked against the default replication. Game net drivers without it replicate as before.
+ * Always relevant actors are in one list for all connections, helicopters in their own node and everything
+ * else spatialized in a 2D grid. Player controllers and their view targets come from the connection node,
+ * other actors relevant only to their owner from a list node of the owning connection.
+ */
+UCLASS(Transient, Config=Engine)
+class HELI_API UHeliReplicationGraph : public UReplicationGraph
+{
+	GENERATED_BODY()
+
+public:
+
+	// Makes game net drivers create this graph when heli.RepGraph.Enabled is set, called on module startup
+	static void RegisterReplicationDriver();
+
+	virtual void InitGlobalActorClassSettings() override;
+
+	virtual void InitGlobalGraphNodes() override;
+
+	virtual void InitConnectionGraphNodes(UNetReplicationGraphConnection* ConnectionManager) override;
+
+	virtual void RouteAddNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo, FGlobalActorReplicationInfo& GlobalInfo) override;
+
+	virtual void RouteRemoveNetworkActorToNodes(const FNewReplicatedActorInfo& ActorInfo) override;
+
+	virtual void RemoveClientConnection(UNetConnection* NetConnection) override;
+
+	virtual int32 ServerReplicateActors(float DeltaSeconds) override;
+
+private:
+
+	struct FOwnerOnlyActor
+	{
+		AActor* Actor { nullptr };
+		// Connection whose node has the actor, null while actor has no owning connection
+		UNetConnection* Connection { nullptr };
+	};
+
+	UPROPERTY(Transient)
+	TObjectPtr<UReplicationGraphNode_GridSpatialization2D> GridNode {};
+
+	UPROPERTY(Transient)
+	TObjectPtr<UReplicationGraphNode_ActorList> AlwaysRelevantNode {};
+
+	UPROPERTY(Transient)
+	TObjectPtr<UHeliReplicationGraphNode_Helicopters> HelicopterNode {};
+
+	UPROPERTY(Transient)
+	TMap<TObjectPtr<UNetConnection>, TObjectPtr<UReplicationGraphNode_ActorList>> OwnerOnlyNodes {};
+
+	// Owner may be set after the actor is added and may change, they are few so they are checked every frame
+	TArray<FOwnerOnlyActor> OwnerOnlyActors {};
+
+	// Filled lazily as classes show up, blueprints may be loaded long after the graph starts
+	TClassMap<EHeliClassRepPolicy> ClassRepPolicies {};
+
+	EHeliClassRepPolicy GetClassRepPolicy(UClass* Class);
+
+	bool InitClassReplicationInfo(UClass* Class, FClassReplicationInfo& ClassInfo);
+
+	// Moves owner-only actors to the node of their current owning connection
+	void RouteOwnerOnlyActors();
+
+	void SetOwnerOnlyActorConnection(FOwnerOnlyActor& OwnerOnlyActor, UNetConnection* Connection);
+
+};
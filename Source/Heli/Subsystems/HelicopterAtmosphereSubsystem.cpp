@@ -0,0 +1,69 @@
+﻿#include "HelicopterAtmosphereSubsystem.h"
+
+#include "Heli/BFLs/HeliConversionsLibrary.h"
+#include "Heli/HeliStats.h"
+
+static TAutoConsoleVariable<bool> CVarHeliAtmosphereEnabled(
+	TEXT("heli.Atmosphere.Enabled"),
+	false,
+	TEXT("Scale helicopter lift with air density and engine power by altitude. Set heli.Atmosphere.SeaLevelZ for the map, ")
+	TEXT("envelope and trim tables are baked at sea level. Read when the world starts"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliAtmosphereTemperatureOffset(
+	TEXT("heli.Atmosphere.TemperatureOffset"),
+	0.f,
+	TEXT("Temperature offset from standard day in Kelvin, positive is hot. Read when the world starts"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliAtmosphereSeaLevelZ(
+	TEXT("heli.Atmosphere.SeaLevelZ"),
+	0.f,
+	TEXT("World Z of sea level in cm. Read when the world starts"),
+	ECVF_Default
+);
+
+FHelicopterAtmosphereSample UHelicopterAtmosphereSubsystem::GetSample(const FVector& Location) const
+{
+	return Table.GetSample(UHeliConversionsLibrary::CmToM(Location.Z - SeaLevelZ));
+}
+
+void UHelicopterAtmosphereSubsystem::SetTemperatureOffset(float TemperatureOffset)
+{
+	LLM_SCOPE_BYTAG(Heli_Subsystems);
+
+	Table.Bake(TemperatureOffset);
+}
+
+float UHelicopterAtmosphereSubsystem::GetTemperatureOffset() const
+{
+	return Table.GetTemperatureOffset();
+}
+
+float UHelicopterAtmosphereSubsystem::GetDensityRatioAtLocation(const FVector& Location) const
+{
+	return GetSample(Location).DensityRatio;
+}
+
+bool UHelicopterAtmosphereSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	return Super::ShouldCreateSubsystem(Outer) && CVarHeliAtmosphereEnabled.GetValueOnGameThread();
+}
+
+void UHelicopterAtmosphereSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	LLM_SCOPE_BYTAG(Heli_Subsystems);
+
+	Super::Initialize(Collection);
+
+	SeaLevelZ = CVarHeliAtmosphereSeaLevelZ.GetValueOnGameThread();
+
+	Table.Bake(CVarHeliAtmosphereTemperatureOffset.GetValueOnGameThread());
+}
+
+bool UHelicopterAtmosphereSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
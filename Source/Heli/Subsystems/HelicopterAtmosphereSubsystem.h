@@ -0,0 +1,49 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "Heli/Vehicles/Helicopters/HelicopterAtmosphere.h"
+#include "HelicopterAtmosphereSubsystem.generated.h"
+
+/**
+ * Air of the world for UHelicopterMovementComponent. Keeps ISA table baked for the current temperature offset,
+ * so every helicopter looks its air up by altitude without any math of its own.
+ * Without the subsystem helicopters fly in standard sea level air, that's the default: baked envelope and trim
+ * tables assume it, and a map away from heli.Atmosphere.SeaLevelZ would fly differently than it was tuned.
+ */
+UCLASS()
+class HELI_API UHelicopterAtmosphereSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// World location to conditions at its altitude above sea level
+	FHelicopterAtmosphereSample GetSample(const FVector& Location) const;
+
+	// Kelvin relative to standard day. Rebakes the table, don't call it every frame
+	UFUNCTION(BlueprintCallable)
+	void SetTemperatureOffset(float TemperatureOffset);
+
+	UFUNCTION(BlueprintPure)
+	float GetTemperatureOffset() const;
+
+	UFUNCTION(BlueprintPure)
+	float GetDensityRatioAtLocation(const FVector& Location) const;
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+protected:
+
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+
+	FHelicopterAtmosphereTable Table {};
+
+	// World Z of sea level in cm
+	float SeaLevelZ { 0.f };
+
+};
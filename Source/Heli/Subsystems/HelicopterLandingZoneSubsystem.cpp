@@ -0,0 +1,96 @@
+﻿#include "HelicopterLandingZoneSubsystem.h"
+
+#include "Engine/World.h"
+#include "Heli/HeliStats.h"
+
+DECLARE_CYCLE_STAT(TEXT("Landing Zone Query"), STAT_HeliLandingZoneQuery, STATGROUP_Heli);
+DECLARE_CYCLE_STAT(TEXT("Landing Zone Confirmation"), STAT_HeliLandingZoneConfirmation, STATGROUP_Heli);
+
+void UHelicopterLandingZoneSubsystem::RegisterMap(AHelicopterLandingZoneMap* Map)
+{
+	LLM_SCOPE_BYTAG(Heli_Subsystems);
+
+	if(Map && Map->HasBakedData())
+		Maps.AddUnique(Map);
+}
+
+void UHelicopterLandingZoneSubsystem::UnregisterMap(AHelicopterLandingZoneMap* Map)
+{
+	Maps.Remove(Map);
+}
+
+bool UHelicopterLandingZoneSubsystem::FindLandingZones(const FVector& Location, float Radius,
+	const FHelicopterLandingZoneRequirements& Requirements, int32 MaxResults, TArray<FHelicopterLandingZone>& OutZones) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_HeliLandingZoneQuery);
+
+	OutZones.Reset();
+
+	for(const AHelicopterLandingZoneMap* Map : Maps)
+	{
+		if(IsValid(Map))
+			Map->FindLandingZones(Location, Radius, Requirements, MaxResults, OutZones);
+	}
+
+	return !OutZones.IsEmpty();
+}
+
+bool UHelicopterLandingZoneSubsystem::ConfirmLandingZone(const FHelicopterLandingZone& Zone,
+	const FHelicopterLandingZoneRequirements& Requirements, const AActor* IgnoredActor) const
+{
+	SCOPE_CYCLE_COUNTER(STAT_HeliLandingZoneConfirmation);
+
+	const UWorld* World = GetWorld();
+	if(!World)
+		return false;
+
+	const FCollisionObjectQueryParams ObjectQueryParams { FCollisionObjectQueryParams::AllObjects };
+	const FCollisionQueryParams QueryParams { SCENE_QUERY_STAT(HelicopterLandingZoneConfirmation), false, IgnoredActor };
+
+	// Ground allowed by the max slope rises this much at the given distance, probes start above it
+	// plus the skid clearance the zone was baked with
+	const float SlopeTangent = FMath::Tan(FMath::DegreesToRadians(Requirements.MaxSlopeDegrees));
+	const auto GetGroundRise = [SlopeTangent, &Zone](float Distance)
+	{
+		return Distance * SlopeTangent + Zone.SkidClearance;
+	};
+
+	// From the ground at rotor tips to just above the rotor disc
+	const float RotorBottom = FMath::Min(GetGroundRise(Requirements.RotorRadius), Requirements.RotorHeight);
+	const float RotorHalfHeight = 0.5f * (Requirements.RotorHeight + 50.f - RotorBottom);
+	const FVector RotorCenter = Zone.Location + FVector(0.f, 0.f, RotorBottom + RotorHalfHeight);
+	const FCollisionShape RotorShape = FCollisionShape::MakeBox(FVector(Requirements.RotorRadius, Requirements.RotorRadius, RotorHalfHeight));
+
+	if(World->OverlapAnyTestByObjectType(RotorCenter, FQuat::Identity, ObjectQueryParams, RotorShape, QueryParams))
+		return false;
+
+	// Under the disc only the spot of fuselage and skids matters
+	const FVector BodyExtent { 0.4f * Requirements.RotorRadius, 0.2f * Requirements.RotorRadius, 0.f };
+	const float BodyBottom = FMath::Min(GetGroundRise(BodyExtent.X), RotorBottom);
+	const float BodyHalfHeight = 0.5f * (RotorBottom - BodyBottom);
+
+	if(BodyHalfHeight <= 0.f)
+		return true;
+
+	const FVector BodyCenter = Zone.Location + FVector(0.f, 0.f, BodyBottom + BodyHalfHeight);
+	const FCollisionShape BodyShape = FCollisionShape::MakeBox(FVector(BodyExtent.X, BodyExtent.Y, BodyHalfHeight));
+
+	return !World->OverlapAnyTestByObjectType(BodyCenter, FQuat::Identity, ObjectQueryParams, BodyShape, QueryParams);
+}
+
+int32 UHelicopterLandingZoneSubsystem::GetNumMaps() const
+{
+	return Maps.Num();
+}
+
+void UHelicopterLandingZoneSubsystem::Deinitialize()
+{
+	Maps.Empty();
+
+	Super::Deinitialize();
+}
+
+bool UHelicopterLandingZoneSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
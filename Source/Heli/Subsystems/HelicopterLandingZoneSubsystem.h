@@ -0,0 +1,57 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Heli/LandingZones/HelicopterLandingZoneMap.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "HelicopterLandingZoneSubsystem.generated.h"
+
+/**
+ * Finds landing zones for AI and pilot assistance in baked AHelicopterLandingZoneMap actors of the world.
+ * Finding is lookups only, confirm the chosen zone with ConfirmLandingZone right before landing,
+ * it's the only query that traces and it catches whatever moved in after the bake.
+ */
+UCLASS()
+class HELI_API UHelicopterLandingZoneSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	void RegisterMap(AHelicopterLandingZoneMap* Map);
+
+	void UnregisterMap(AHelicopterLandingZoneMap* Map);
+
+	// Best zones within Radius around Location from all maps, best first. Returns false when none was found
+	UFUNCTION(BlueprintCallable)
+	bool FindLandingZones(
+		const FVector& Location,
+		float Radius,
+		const FHelicopterLandingZoneRequirements& Requirements,
+		int32 MaxResults,
+		TArray<FHelicopterLandingZone>& OutZones
+	) const;
+
+	// Checks rotor disc and the space under it for anything, dynamic objects included.
+	// IgnoredActor is usually the helicopter that is going to land
+	UFUNCTION(BlueprintCallable)
+	bool ConfirmLandingZone(
+		const FHelicopterLandingZone& Zone,
+		const FHelicopterLandingZoneRequirements& Requirements,
+		const AActor* IgnoredActor = nullptr
+	) const;
+
+	UFUNCTION(BlueprintCallable)
+	int32 GetNumMaps() const;
+
+	virtual void Deinitialize() override;
+
+protected:
+
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<AHelicopterLandingZoneMap>> Maps {};
+
+};
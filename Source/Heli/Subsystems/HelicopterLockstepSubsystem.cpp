@@ -0,0 +1,205 @@
+﻿#include "HelicopterLockstepSubsystem.h"
+
+#include "Algo/BinarySearch.h"
+#include "Engine/World.h"
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+#include "Heli/Vehicles/Helicopters/HelicopterMovementComponent.h"
+
+// Hashes are logged every step, keep them out of LogHeli
+DEFINE_LOG_CATEGORY_STATIC(LogHeliLockstep, Log, All);
+
+static TAutoConsoleVariable<bool> CVarHeliLockstepEnabled(
+	TEXT("heli.Lockstep.Enabled"),
+	false,
+	TEXT("Step helicopters with fixed timestep in deterministic order. Read when world is created"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliLockstepFixedDeltaTime(
+	TEXT("heli.Lockstep.FixedDeltaTime"),
+	1.f / 60.f,
+	TEXT("Seconds simulated by one lockstep step"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<int32> CVarHeliLockstepMaxStepsPerFrame(
+	TEXT("heli.Lockstep.MaxStepsPerFrame"),
+	4,
+	TEXT("Time that needs more steps than this in one frame is dropped, so a hitch doesn't snowball"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<bool> CVarHeliLockstepLogHashes(
+	TEXT("heli.Lockstep.LogHashes"),
+	false,
+	TEXT("Log state hash of every helicopter on every step"),
+	ECVF_Default
+);
+
+void FHelicopterLockstepTickFunction::ExecuteTick(float DeltaTime, ELevelTick TickType,
+	ENamedThreads::Type CurrentThread, const FGraphEventRef& MyCompletionGraphEvent)
+{
+	if(Subsystem && TickType != LEVELTICK_ViewportsOnly)
+		Subsystem->Advance(DeltaTime);
+}
+
+FString FHelicopterLockstepTickFunction::DiagnosticMessage()
+{
+	return TEXT("FHelicopterLockstepTickFunction");
+}
+
+void UHelicopterLockstepSubsystem::RegisterHelicopter(UHelicopterMovementComponent* HelicopterMovement)
+{
+	LLM_SCOPE_BYTAG(Heli_Subsystems);
+
+	if(!HelicopterMovement || Helicopters.Contains(HelicopterMovement))
+		return;
+
+	// Registration order depends on streaming and spawn timing, names don't as long as spawn order is the same.
+	// Number of the name is compared as a number, so Heli_10 comes after Heli_9
+	const FName OwnerName = HelicopterMovement->GetOwner()->GetFName();
+	
+	const int32 Index = Algo::LowerBound(Helicopters, OwnerName,
+		[](const UHelicopterMovementComponent* Helicopter, FName Name)
+		{
+			return Helicopter->GetOwner()->GetFName().Compare(Name) < 0;
+		}
+	);
+	
+	Helicopters.Insert(HelicopterMovement, Index);
+
+	HelicopterMovement->SetDrivenByLockstep(true);
+}
+
+void UHelicopterLockstepSubsystem::UnregisterHelicopter(UHelicopterMovementComponent* HelicopterMovement)
+{
+	// Keep order of the others
+	if(Helicopters.Remove(HelicopterMovement) > 0)
+		HelicopterMovement->SetDrivenByLockstep(false);
+}
+
+void UHelicopterLockstepSubsystem::Advance(float DeltaTime)
+{
+	const float FixedDeltaTime = GetFixedDeltaTime();
+	const int32 MaxSteps = GetMaxStepsPerFrame();
+
+	Accumulator += DeltaTime;
+
+	int32 NumSteps = 0;
+	while(Accumulator >= FixedDeltaTime)
+	{
+		if(NumSteps == MaxSteps)
+		{
+			HELI_WRN("Lockstep is %.3f s behind, dropping it", Accumulator);
+			Accumulator = FMath::Fmod(Accumulator, FixedDeltaTime);
+			break;
+		}
+
+		Accumulator -= FixedDeltaTime;
+		++NumSteps;
+
+		StepHelicopters(FixedDeltaTime);
+	}
+
+	// Every step of the frame flew with the same input. Frame without a step keeps it for the next one
+	if(NumSteps == 0)
+		return;
+
+	for(UHelicopterMovementComponent* Helicopter : Helicopters)
+	{
+		if(IsValid(Helicopter) && !Helicopter->IsDrivenByPhysicsStep())
+			Helicopter->ClearFrameInput();
+	}
+}
+
+void UHelicopterLockstepSubsystem::StepHelicopters(float FixedDeltaTime)
+{
+	++Step;
+
+	const bool bLogHashes = CVarHeliLockstepLogHashes.GetValueOnGameThread();
+
+	for(UHelicopterMovementComponent* Helicopter : Helicopters)
+	{
+		// Pooled helicopters have their tick disabled, they are frozen in lockstep as well.
+		// Physics steps fly helicopters while time is compressed, they queue themselves in their own tick then
+		if(!IsValid(Helicopter) || !Helicopter->IsComponentTickEnabled() || Helicopter->IsDrivenByPhysicsStep())
+			continue;
+
+		Helicopter->StepSimulation(FixedDeltaTime);
+
+		const uint32 HelicopterHash = Helicopter->UpdateStateHash();
+		StateHash = FCrc::MemCrc32(&HelicopterHash, sizeof(HelicopterHash), StateHash);
+
+		if(bLogHashes)
+		{
+			UE_LOG(LogHeliLockstep, Log, TEXT("Step %lld %s %08x"),
+				Step, *Helicopter->GetOwner()->GetName(), HelicopterHash);
+		}
+	}
+
+	if(bLogHashes)
+		UE_LOG(LogHeliLockstep, Log, TEXT("Step %lld world %08x"), Step, StateHash);
+
+	OnStepHashed.Broadcast(Step, StateHash);
+}
+
+int64 UHelicopterLockstepSubsystem::GetStep() const
+{
+	return Step;
+}
+
+int32 UHelicopterLockstepSubsystem::GetStateHash() const
+{
+	// Blueprints have no unsigned integers
+	return static_cast<int32>(StateHash);
+}
+
+float UHelicopterLockstepSubsystem::GetFixedDeltaTime() const
+{
+	return FMath::Max(CVarHeliLockstepFixedDeltaTime.GetValueOnGameThread(), UE_KINDA_SMALL_NUMBER);
+}
+
+int32 UHelicopterLockstepSubsystem::GetMaxStepsPerFrame() const
+{
+	return FMath::Max(CVarHeliLockstepMaxStepsPerFrame.GetValueOnGameThread(), 1);
+}
+
+bool UHelicopterLockstepSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	return Super::ShouldCreateSubsystem(Outer) && CVarHeliLockstepEnabled.GetValueOnGameThread();
+}
+
+void UHelicopterLockstepSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	Super::OnWorldBeginPlay(InWorld);
+
+	// Steps before physics like helicopter movement components do on their own
+	TickFunction.Subsystem = this;
+	TickFunction.bCanEverTick = true;
+	TickFunction.TickGroup = TG_PrePhysics;
+	TickFunction.RegisterTickFunction(InWorld.PersistentLevel);
+}
+
+void UHelicopterLockstepSubsystem::Deinitialize()
+{
+	if(TickFunction.IsTickFunctionRegistered())
+		TickFunction.UnRegisterTickFunction();
+
+	TickFunction.Subsystem = nullptr;
+
+	for(UHelicopterMovementComponent* Helicopter : Helicopters)
+	{
+		if(IsValid(Helicopter))
+			Helicopter->SetDrivenByLockstep(false);
+	}
+
+	Helicopters.Empty();
+
+	Super::Deinitialize();
+}
+
+bool UHelicopterLockstepSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
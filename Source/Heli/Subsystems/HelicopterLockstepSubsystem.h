@@ -0,0 +1,97 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/EngineBaseTypes.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "HelicopterLockstepSubsystem.generated.h"
+
+class UHelicopterLockstepSubsystem;
+class UHelicopterMovementComponent;
+
+DECLARE_MULTICAST_DELEGATE_TwoParams(FOnHelicopterLockstepStep, int64 /* Step */, uint32 /* StateHash */);
+
+USTRUCT()
+struct FHelicopterLockstepTickFunction : public FTickFunction
+{
+	GENERATED_BODY()
+
+	UHelicopterLockstepSubsystem* Subsystem { nullptr };
+
+	virtual void ExecuteTick(
+		float DeltaTime,
+		ELevelTick TickType,
+		ENamedThreads::Type CurrentThread,
+		const FGraphEventRef& MyCompletionGraphEvent
+	) override;
+
+	virtual FString DiagnosticMessage() override;
+};
+
+template<>
+struct TStructOpsTypeTraits<FHelicopterLockstepTickFunction> : public TStructOpsTypeTraitsBase2<FHelicopterLockstepTickFunction>
+{
+	enum { WithCopy = false };
+};
+
+/**
+ * Steps all helicopters with a fixed timestep in a stable order, so the same input stream gives the same result.
+ * Exists only when heli.Lockstep.Enabled is set, helicopters then stop ticking on their own and are stepped from here.
+ * Every step each helicopter hashes its state into a rolling hash, and all of them are combined into a world hash,
+ * compare it between replays or machines to catch divergence on the step it happens.
+ */
+UCLASS()
+class HELI_API UHelicopterLockstepSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Called after every step with the world state hash
+	FOnHelicopterLockstepStep OnStepHashed {};
+
+	void RegisterHelicopter(UHelicopterMovementComponent* HelicopterMovement);
+
+	void UnregisterHelicopter(UHelicopterMovementComponent* HelicopterMovement);
+
+	// Consumes frame time by fixed steps, what is left is carried to the next frame.
+	// Input of the frame is held for all its steps and cleared after them
+	void Advance(float DeltaTime);
+
+	UFUNCTION(BlueprintCallable)
+	int64 GetStep() const;
+
+	UFUNCTION(BlueprintCallable)
+	int32 GetStateHash() const;
+
+	UFUNCTION(BlueprintCallable)
+	float GetFixedDeltaTime() const;
+
+	int32 GetMaxStepsPerFrame() const;
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+
+	virtual void Deinitialize() override;
+
+protected:
+
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+
+	// Sorted by owner name, see RegisterHelicopter
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<UHelicopterMovementComponent>> Helicopters {};
+
+	FHelicopterLockstepTickFunction TickFunction {};
+
+	double Accumulator { 0.0 };
+
+	int64 Step { 0 };
+
+	uint32 StateHash { 0 };
+
+	void StepHelicopters(float FixedDeltaTime);
+
+};
@@ -0,0 +1,349 @@
+﻿#include "HelicopterMemorySubsystem.h"
+
+#include "EngineUtils.h"
+#include "Components/SkeletalMeshComponent.h"
+#include "Engine/World.h"
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+#include "Heli/Vehicles/Helicopters/Helicopter.h"
+#include "Heli/Vehicles/Helicopters/HelicopterMovementComponent.h"
+#include "PhysicsEngine/BodyInstance.h"
+#include "PhysicsEngine/ConstraintInstance.h"
+#include "Serialization/ArchiveCountMem.h"
+#include "UObject/UObjectIterator.h"
+
+static TAutoConsoleVariable<int32> CVarHeliMemBudgetHelicopterKB(
+	TEXT("heli.MemBudget.HelicopterKB"),
+	0,
+	TEXT("Instance memory a single helicopter may take in KB, 0 disables the budget"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<int32> CVarHeliMemBudgetTotalMB(
+	TEXT("heli.MemBudget.TotalMB"),
+	0,
+	TEXT("Memory all helicopters of a world may take together in MB, shared memory included. 0 disables the budget"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<bool> CVarHeliMemBudgetCheckOnSpawn(
+	TEXT("heli.MemBudget.CheckOnSpawn"),
+	false,
+	TEXT("Measure every spawned helicopter and warn when budgets are exceeded. Read when the world starts"),
+	ECVF_Default
+);
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice HeliMemReportCommand(
+	TEXT("heli.MemReport"),
+	TEXT("Reports memory of live helicopters per class. Add Detailed to list every helicopter and its components"),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+		[](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+		{
+			const UHelicopterMemorySubsystem* Memory = World ? World->GetSubsystem<UHelicopterMemorySubsystem>() : nullptr;
+			if(!Memory)
+			{
+				Ar.Log(TEXT("Helicopter memory can be reported only in game worlds"));
+				return;
+			}
+
+			const bool bDetailed = Args.ContainsByPredicate([](const FString& Arg)
+			{
+				return Arg.Equals(TEXT("Detailed"), ESearchCase::IgnoreCase);
+			});
+
+			Memory->ReportMemory(Ar, bDetailed);
+		}
+	)
+);
+
+namespace HelicopterMemory
+{
+	// Property memory counted the way "obj list" does, plus resources object owns outside of its properties
+	int64 MeasureObject(UObject* Object)
+	{
+		FArchiveCountMem CountMem { Object };
+
+		int64 Bytes = CountMem.GetMax() + Object->GetResourceSizeBytes(EResourceSizeMode::Exclusive);
+
+		// Bone transforms and bodies of a skeletal mesh are not properties, the archive doesn't see them
+		if(const USkeletalMeshComponent* SkeletalMesh = Cast<USkeletalMeshComponent>(Object))
+		{
+			Bytes += SkeletalMesh->GetComponentSpaceTransforms().GetAllocatedSize();
+			Bytes += SkeletalMesh->GetBoneSpaceTransforms().GetAllocatedSize();
+			Bytes += SkeletalMesh->Bodies.Num() * sizeof(FBodyInstance) + SkeletalMesh->Bodies.GetAllocatedSize();
+			Bytes += SkeletalMesh->Constraints.Num() * sizeof(FConstraintInstance) + SkeletalMesh->Constraints.GetAllocatedSize();
+		}
+
+		return Bytes;
+	}
+
+	double ToKB(int64 Bytes)
+	{
+		return Bytes / 1024.0;
+	}
+
+	int64 GetHelicopterBudget()
+	{
+		return CVarHeliMemBudgetHelicopterKB.GetValueOnGameThread() * 1024ll;
+	}
+
+	int64 GetTotalBudget()
+	{
+		return CVarHeliMemBudgetTotalMB.GetValueOnGameThread() * 1024ll * 1024ll;
+	}
+
+	struct FClassReport
+	{
+		int32 NumHelicopters { 0 };
+		int64 InstanceBytes { 0 };
+		int64 MaxInstanceBytes { 0 };
+		TSet<UObject*> SharedObjects {};
+	};
+}
+
+FHelicopterMemoryUsage UHelicopterMemorySubsystem::MeasureHelicopter(AHelicopter* Helicopter) const
+{
+	using namespace HelicopterMemory;
+
+	FHelicopterMemoryUsage Usage {};
+
+	if(!IsValid(Helicopter))
+		return Usage;
+
+	Usage.InstanceBytes = MeasureObject(Helicopter);
+
+	const TInlineComponentArray<UActorComponent*> Components(Helicopter);
+
+	for(UActorComponent* Component : Components)
+	{
+		Usage.InstanceBytes += MeasureObject(Component);
+	}
+
+	if(const UHelicopterMovementComponent* Movement = Helicopter->GetHelicopterMovementComponent())
+	{
+		TArray<UObject*> SharedObjects {};
+		Movement->GetSharedFlightObjects(SharedObjects);
+
+		for(UObject* Object : SharedObjects)
+		{
+			Usage.SharedBytes += MeasureObject(Object);
+		}
+	}
+
+	return Usage;
+}
+
+void UHelicopterMemorySubsystem::ReportMemory(FOutputDevice& Ar, bool bDetailed) const
+{
+	using namespace HelicopterMemory;
+
+	const int64 HelicopterBudget = GetHelicopterBudget();
+	const int64 TotalBudget = GetTotalBudget();
+
+	TMap<UClass*, FClassReport> ClassReports {};
+	int32 NumOverBudget = 0;
+
+	for(TActorIterator<AHelicopter> It { GetWorld() }; It; ++It)
+	{
+		AHelicopter* Helicopter = *It;
+		FClassReport& ClassReport = ClassReports.FindOrAdd(Helicopter->GetClass());
+
+		int64 InstanceBytes = MeasureObject(Helicopter);
+
+		TArray<TPair<UActorComponent*, int64>, TInlineAllocator<16>> ComponentBytes {};
+
+		const TInlineComponentArray<UActorComponent*> Components(Helicopter);
+
+		for(UActorComponent* Component : Components)
+		{
+			const int64 Bytes = MeasureObject(Component);
+
+			InstanceBytes += Bytes;
+			ComponentBytes.Emplace(Component, Bytes);
+		}
+
+		if(const UHelicopterMovementComponent* Movement = Helicopter->GetHelicopterMovementComponent())
+		{
+			TArray<UObject*> SharedObjects {};
+			Movement->GetSharedFlightObjects(SharedObjects);
+
+			ClassReport.SharedObjects.Append(SharedObjects);
+		}
+
+		++ClassReport.NumHelicopters;
+		ClassReport.InstanceBytes += InstanceBytes;
+		ClassReport.MaxInstanceBytes = FMath::Max(ClassReport.MaxInstanceBytes, InstanceBytes);
+
+		const bool bOverBudget = HelicopterBudget > 0 && InstanceBytes > HelicopterBudget;
+		if(bOverBudget)
+			++NumOverBudget;
+
+		if(!bDetailed)
+			continue;
+
+		Ar.Logf(TEXT("  %s: %.1f KB%s"), *Helicopter->GetName(), ToKB(InstanceBytes), bOverBudget ? TEXT(" OVER BUDGET") : TEXT(""));
+
+		// The biggest first, skeletal mesh and physics bodies are usually on top
+		ComponentBytes.Sort([](const TPair<UActorComponent*, int64>& A, const TPair<UActorComponent*, int64>& B)
+		{
+			return A.Value > B.Value;
+		});
+
+		for(const TPair<UActorComponent*, int64>& Pair : ComponentBytes)
+		{
+			Ar.Logf(TEXT("    %s (%s): %.1f KB"), *Pair.Key->GetName(), *Pair.Key->GetClass()->GetName(), ToKB(Pair.Value));
+		}
+	}
+
+	int64 TotalBytes = 0;
+	TSet<UObject*> AllSharedObjects {};
+
+	for(const TPair<UClass*, FClassReport>& Pair : ClassReports)
+	{
+		const FClassReport& ClassReport = Pair.Value;
+
+		int64 SharedBytes = 0;
+		for(UObject* Object : ClassReport.SharedObjects)
+		{
+			SharedBytes += MeasureObject(Object);
+		}
+
+		Ar.Logf(TEXT("%s: %d helicopters, %.1f KB total, %.1f KB average, %.1f KB max, %.1f KB shared"),
+			*Pair.Key->GetName(),
+			ClassReport.NumHelicopters,
+			ToKB(ClassReport.InstanceBytes),
+			ToKB(ClassReport.InstanceBytes / ClassReport.NumHelicopters),
+			ToKB(ClassReport.MaxInstanceBytes),
+			ToKB(SharedBytes)
+		);
+
+		TotalBytes += ClassReport.InstanceBytes;
+		AllSharedObjects.Append(ClassReport.SharedObjects);
+	}
+
+	// Classes may share a definition, count its memory once
+	for(UObject* Object : AllSharedObjects)
+	{
+		TotalBytes += MeasureObject(Object);
+	}
+
+	Ar.Logf(TEXT("All helicopters: %.1f KB"), ToKB(TotalBytes));
+
+	if(NumOverBudget > 0)
+	{
+		HELI_WRN("%d helicopters are over budget of %.1f KB", NumOverBudget, ToKB(HelicopterBudget));
+		Ar.Logf(TEXT("%d helicopters are over budget of %.1f KB"), NumOverBudget, ToKB(HelicopterBudget));
+	}
+
+	if(TotalBudget > 0 && TotalBytes > TotalBudget)
+	{
+		HELI_WRN("Helicopters take %.1f KB, budget is %.1f KB", ToKB(TotalBytes), ToKB(TotalBudget));
+		Ar.Logf(TEXT("Helicopters are over budget of %.1f KB"), ToKB(TotalBudget));
+	}
+
+	if(const int32 NumStale = CountStaleHelicopters(); NumStale > 0)
+	{
+		Ar.Logf(TEXT("%d destroyed helicopters are still in memory, the ones left after \"obj gc\" are leaked"), NumStale);
+	}
+}
+
+int32 UHelicopterMemorySubsystem::CountStaleHelicopters() const
+{
+	int32 NumStale = 0;
+
+	// Class defaults are excluded by the iterator, archetypes of blueprints aren't
+	for(TObjectIterator<AHelicopter> It {}; It; ++It)
+	{
+		const AHelicopter* Helicopter = *It;
+
+		if(Helicopter->HasAnyFlags(RF_ArchetypeObject))
+			continue;
+
+		if(!IsValid(Helicopter) || !Helicopter->GetWorld())
+			++NumStale;
+	}
+
+	return NumStale;
+}
+
+void UHelicopterMemorySubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	if(CVarHeliMemBudgetCheckOnSpawn.GetValueOnGameThread())
+	{
+		ActorSpawnedHandle = GetWorld()->AddOnActorSpawnedHandler(
+			FOnActorSpawned::FDelegate::CreateUObject(this, &ThisClass::OnActorSpawned)
+		);
+	}
+}
+
+void UHelicopterMemorySubsystem::Deinitialize()
+{
+	if(ActorSpawnedHandle.IsValid())
+	{
+		GetWorld()->RemoveOnActorSpawnedHandler(ActorSpawnedHandle);
+		ActorSpawnedHandle.Reset();
+	}
+
+	SpawnedHelicopterBytes.Empty();
+
+	Super::Deinitialize();
+}
+
+bool UHelicopterMemorySubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UHelicopterMemorySubsystem::OnActorSpawned(AActor* Actor)
+{
+	using namespace HelicopterMemory;
+
+	LLM_SCOPE_BYTAG(Heli_Subsystems);
+
+	AHelicopter* Helicopter = Cast<AHelicopter>(Actor);
+	if(!Helicopter)
+		return;
+
+	const FHelicopterMemoryUsage Usage = MeasureHelicopter(Helicopter);
+
+	const int64 HelicopterBudget = GetHelicopterBudget();
+	if(HelicopterBudget > 0 && Usage.InstanceBytes > HelicopterBudget)
+	{
+		HELI_WRN("Spawned helicopter %s takes %.1f KB, budget is %.1f KB",
+			*Helicopter->GetName(),
+			ToKB(Usage.InstanceBytes),
+			ToKB(HelicopterBudget)
+		);
+	}
+
+	// Destroyed helicopters don't count anymore
+	for(auto It = SpawnedHelicopterBytes.CreateIterator(); It; ++It)
+	{
+		if(!It.Key().IsValid())
+			It.RemoveCurrent();
+	}
+
+	SpawnedHelicopterBytes.Add(Helicopter, Usage.InstanceBytes);
+
+	const int64 TotalBudget = GetTotalBudget();
+	if(TotalBudget <= 0)
+		return;
+
+	// Shared memory of the new helicopter stands for all of them, most worlds have a single model anyway
+	int64 TotalBytes = Usage.SharedBytes;
+	for(const TPair<TWeakObjectPtr<AHelicopter>, int64>& Pair : SpawnedHelicopterBytes)
+	{
+		TotalBytes += Pair.Value;
+	}
+
+	if(TotalBytes > TotalBudget)
+	{
+		HELI_WRN("%d spawned helicopters take %.1f KB, budget is %.1f KB",
+			SpawnedHelicopterBytes.Num(),
+			ToKB(TotalBytes),
+			ToKB(TotalBudget)
+		);
+	}
+}
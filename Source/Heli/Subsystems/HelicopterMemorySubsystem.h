@@ -0,0 +1,64 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "HelicopterMemorySubsystem.generated.h"
+
+class AHelicopter;
+
+USTRUCT(BlueprintType)
+struct FHelicopterMemoryUsage
+{
+	GENERATED_BODY()
+
+	// Actor and its components: properties, resources, bone transforms and physics body instances.
+	// Chaos particles on the physics thread are not counted
+	UPROPERTY(BlueprintReadOnly)
+	int64 InstanceBytes { 0 };
+
+	// Definition and curves, paid once per helicopter model no matter how many helicopters use them
+	UPROPERTY(BlueprintReadOnly)
+	int64 SharedBytes { 0 };
+};
+
+/**
+ * Measures memory of live helicopters for "heli.MemReport" and checks it against heli.MemBudget.* budgets.
+ * Measuring walks properties of every object, it's meant for reports and spawn checks, not for every frame.
+ * Run with -llm to see the same memory split by Heli tags in "stat LLMFULL".
+ */
+UCLASS()
+class HELI_API UHelicopterMemorySubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	UFUNCTION(BlueprintCallable)
+	FHelicopterMemoryUsage MeasureHelicopter(AHelicopter* Helicopter) const;
+
+	// Per class totals of all helicopters in the world, per instance lines with bDetailed. Warns about budgets
+	void ReportMemory(FOutputDevice& Ar, bool bDetailed) const;
+
+	// Helicopters still in memory but destroyed or outside of any world.
+	// They are fine right after destroy, ones that survive garbage collection are leaked
+	UFUNCTION(BlueprintCallable)
+	int32 CountStaleHelicopters() const;
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+protected:
+
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+
+	FDelegateHandle ActorSpawnedHandle {};
+
+	// Instance memory of helicopters measured on spawn, to check total budget without measuring all of them again
+	TMap<TWeakObjectPtr<AHelicopter>, int64> SpawnedHelicopterBytes {};
+
+	void OnActorSpawned(AActor* Actor);
+
+};
@@ -0,0 +1,187 @@
+﻿#include "HelicopterPoolSubsystem.h"
+
+#include "Engine/AssetManager.h"
+#include "Engine/World.h"
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+#include "Heli/Vehicles/Helicopters/Helicopter.h"
+#include "Heli/Vehicles/Helicopters/HelicopterDefinition.h"
+#include "Heli/Vehicles/Helicopters/HelicopterMovementComponent.h"
+
+static TAutoConsoleVariable<int32> CVarHeliPoolPrewarmSpawnsPerFrame(
+	TEXT("heli.Pool.PrewarmSpawnsPerFrame"),
+	1,
+	TEXT("How many pooled helicopters can be spawned by prewarm in a single frame"),
+	ECVF_Default
+);
+
+void UHelicopterPoolSubsystem::PrewarmHelicopters(TSubclassOf<AHelicopter> HelicopterClass, int32 Count)
+{
+	if(!HelicopterClass)
+	{
+		HELI_ERR("Can't prewarm helicopters of null class");
+		return;
+	}
+
+	FHelicopterPool& Pool = Pools.FindOrAdd(HelicopterClass);
+	Pool.PendingPrewarmCount = FMath::Max(Pool.PendingPrewarmCount, Count - Pool.Available.Num());
+
+	// Start loading shared tuning right away, so prewarmed helicopters don't wait for it
+	const AHelicopter* DefaultHelicopter = HelicopterClass->GetDefaultObject<AHelicopter>();
+	const UHelicopterMovementComponent* DefaultMovement = DefaultHelicopter->GetHelicopterMovementComponent();
+	
+	if(!Pool.DefinitionHandle.IsValid() && DefaultMovement && DefaultMovement->GetHelicopterDefinitionId().IsValid())
+	{
+		Pool.DefinitionHandle = UAssetManager::Get().LoadPrimaryAsset(
+			DefaultMovement->GetHelicopterDefinitionId(),
+			{ UHelicopterDefinition::FlightBundleName }
+		);
+	}
+}
+
+AHelicopter* UHelicopterPoolSubsystem::AcquireHelicopter(TSubclassOf<AHelicopter> HelicopterClass,
+	const FTransform& SpawnTransform)
+{
+	if(!HelicopterClass)
+	{
+		HELI_ERR("Can't acquire helicopter of null class");
+		return nullptr;
+	}
+
+	AHelicopter* Helicopter = nullptr;
+
+	if(FHelicopterPool* Pool = Pools.Find(HelicopterClass))
+	{
+		Helicopter = PopAvailableHelicopter(*Pool);
+	}
+
+	if(!Helicopter)
+	{
+		HELI_LOG("Pool of %s is empty, spawning a new helicopter", *HelicopterClass->GetName());
+
+		Helicopter = SpawnPooledHelicopter(HelicopterClass);
+		if(!Helicopter)
+			return nullptr;
+	}
+
+	Helicopter->ActivateFromPool(SpawnTransform);
+
+	return Helicopter;
+}
+
+void UHelicopterPoolSubsystem::ReleaseHelicopter(AHelicopter* Helicopter)
+{
+	if(!IsValid(Helicopter))
+		return;
+
+	if(Helicopter->IsInPool())
+	{
+		HELI_WRN("Helicopter %s is already in pool", *Helicopter->GetName());
+		return;
+	}
+
+	if(Helicopter->GetWorld() != GetWorld())
+	{
+		HELI_ERR("Helicopter %s belongs to another world and can't be pooled", *Helicopter->GetName());
+		return;
+	}
+
+	Helicopter->DeactivateToPool();
+
+	Pools.FindOrAdd(Helicopter->GetClass()).Available.Add(Helicopter);
+}
+
+int32 UHelicopterPoolSubsystem::GetNumAvailableHelicopters(TSubclassOf<AHelicopter> HelicopterClass) const
+{
+	const FHelicopterPool* Pool = Pools.Find(HelicopterClass);
+
+	return Pool ? Pool->Available.Num() : 0;
+}
+
+void UHelicopterPoolSubsystem::Tick(float DeltaTime)
+{
+	int32 SpawnsLeft = CVarHeliPoolPrewarmSpawnsPerFrame.GetValueOnGameThread();
+
+	for(TPair<TSubclassOf<AHelicopter>, FHelicopterPool>& Pair : Pools)
+	{
+		FHelicopterPool& Pool = Pair.Value;
+
+		while(SpawnsLeft > 0 && Pool.PendingPrewarmCount > 0)
+		{
+			--SpawnsLeft;
+			--Pool.PendingPrewarmCount;
+
+			AHelicopter* Helicopter = SpawnPooledHelicopter(Pair.Key);
+			if(!Helicopter)
+			{
+				Pool.PendingPrewarmCount = 0;
+				break;
+			}
+
+			Helicopter->DeactivateToPool();
+			Pool.Available.Add(Helicopter);
+		}
+
+		if(SpawnsLeft <= 0)
+			break;
+	}
+}
+
+TStatId UHelicopterPoolSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UHelicopterPoolSubsystem, STATGROUP_Tickables);
+}
+
+void UHelicopterPoolSubsystem::Deinitialize()
+{
+	Pools.Empty();
+
+	Super::Deinitialize();
+}
+
+bool UHelicopterPoolSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+AHelicopter* UHelicopterPoolSubsystem::SpawnPooledHelicopter(TSubclassOf<AHelicopter> HelicopterClass) const
+{
+	LLM_SCOPE_BYTAG(Heli_Helicopters);
+
+	UWorld* World = GetWorld();
+	if(!World)
+		return nullptr;
+
+	AHelicopter* Helicopter = World->SpawnActorDeferred<AHelicopter>(
+		HelicopterClass,
+		FTransform::Identity,
+		nullptr,
+		nullptr,
+		ESpawnActorCollisionHandlingMethod::AlwaysSpawn
+	);
+
+	if(!Helicopter)
+	{
+		HELI_ERR("Failed to spawn pooled helicopter of class %s", *HelicopterClass->GetName());
+		return nullptr;
+	}
+
+	// Controller is given on activation, there is no reason to have it while helicopter is in pool
+	Helicopter->AutoPossessAI = EAutoPossessAI::Disabled;
+	Helicopter->FinishSpawning(FTransform::Identity);
+
+	return Helicopter;
+}
+
+AHelicopter* UHelicopterPoolSubsystem::PopAvailableHelicopter(FHelicopterPool& Pool) const
+{
+	// Pooled helicopters may be destroyed by level unload or someone else, skip them
+	while(!Pool.Available.IsEmpty())
+	{
+		AHelicopter* Helicopter = Pool.Available.Pop(false);
+		if(IsValid(Helicopter))
+			return Helicopter;
+	}
+
+	return nullptr;
+}
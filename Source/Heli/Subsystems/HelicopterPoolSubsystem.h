@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "HelicopterPoolSubsystem.generated.h"
+
+class AHelicopter;
+struct FStreamableHandle;
+
+USTRUCT()
+struct FHelicopterPool
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TArray<TObjectPtr<AHelicopter>> Available {};
+
+	// How many helicopters are still waiting to be spawned by prewarm
+	int32 PendingPrewarmCount { 0 };
+
+	// Keeps helicopter definition of the class loaded while the pool exists
+	TSharedPtr<FStreamableHandle> DefinitionHandle {};
+};
+
+/**
+ * Keeps deactivated helicopters around so they can be handed out without spawning.
+ * Prewarm is spread across frames to not hitch on it as well.
+ */
+UCLASS()
+class HELI_API UHelicopterPoolSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Spawns helicopters of the class in background, a few per frame, until pool has at least Count of them
+	UFUNCTION(BlueprintCallable)
+	void PrewarmHelicopters(TSubclassOf<AHelicopter> HelicopterClass, int32 Count);
+
+	// Returns pooled helicopter placed at the transform with reset state.
+	// Spawns a new one if the pool is empty
+	UFUNCTION(BlueprintCallable)
+	AHelicopter* AcquireHelicopter(TSubclassOf<AHelicopter> HelicopterClass, const FTransform& SpawnTransform);
+
+	// Use it instead of Destroy to keep helicopter for next acquire
+	UFUNCTION(BlueprintCallable)
+	void ReleaseHelicopter(AHelicopter* Helicopter);
+
+	UFUNCTION(BlueprintCallable)
+	int32 GetNumAvailableHelicopters(TSubclassOf<AHelicopter> HelicopterClass) const;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	virtual void Deinitialize() override;
+
+protected:
+
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+
+	UPROPERTY()
+	TMap<TSubclassOf<AHelicopter>, FHelicopterPool> Pools {};
+
+	AHelicopter* SpawnPooledHelicopter(TSubclassOf<AHelicopter> HelicopterClass) const;
+
+	AHelicopter* PopAvailableHelicopter(FHelicopterPool& Pool) const;
+
+};
@@ -0,0 +1,244 @@
+﻿#include "HelicopterSchedulerSubsystem.h"
+
+#include "Engine/World.h"
+#include "GameFramework/Pawn.h"
+#include "GameFramework/PlayerController.h"
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+
+DECLARE_CYCLE_STAT(TEXT("Scheduled Jobs"), STAT_HeliScheduledJobs, STATGROUP_Heli);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scheduled Jobs Run"), STAT_HeliScheduledJobsRun, STATGROUP_Heli);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scheduled Jobs Deferred"), STAT_HeliScheduledJobsDeferred, STATGROUP_Heli);
+DECLARE_DWORD_COUNTER_STAT(TEXT("Scheduled Jobs Overdue"), STAT_HeliScheduledJobsOverdue, STATGROUP_Heli);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Scheduled Jobs Max Staleness"), STAT_HeliScheduledJobsMaxStaleness, STATGROUP_Heli);
+
+static TAutoConsoleVariable<bool> CVarHeliSchedulerEnabled(
+	TEXT("heli.Scheduler.Enabled"),
+	true,
+	TEXT("Run deferrable helicopter work within a frame budget. When off, components do it every tick. Read when the world starts"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliSchedulerBudgetMs(
+	TEXT("heli.Scheduler.BudgetMs"),
+	0.5f,
+	TEXT("Milliseconds per frame scheduled helicopter jobs may take. The most urgent job runs even when it's exceeded"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliSchedulerPlayerPriority(
+	TEXT("heli.Scheduler.PlayerPriority"),
+	4.f,
+	TEXT("How many times more often jobs of player controlled helicopters are due"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliSchedulerNearPriority(
+	TEXT("heli.Scheduler.NearPriority"),
+	2.f,
+	TEXT("How many times more often jobs of helicopters right next to the view are due, it falls off to 1 at NearDistance"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliSchedulerNearDistance(
+	TEXT("heli.Scheduler.NearDistance"),
+	50000.f,
+	TEXT("Distance from the view in cm beyond which helicopter jobs get no priority"),
+	ECVF_Default
+);
+
+int32 UHelicopterSchedulerSubsystem::RegisterJob(AActor* Owner, float MaxStaleness, FHelicopterScheduledWork&& Work)
+{
+	LLM_SCOPE_BYTAG(Heli_Subsystems);
+
+	if(!Owner || !Work)
+	{
+		HELI_ERR("Can't schedule a job without owner or work");
+		return INDEX_NONE;
+	}
+
+	TUniquePtr<FJob> Job = MakeUnique<FJob>();
+	Job->Owner = Owner;
+	Job->Work = MoveTemp(Work);
+	Job->MaxStaleness = FMath::Max(MaxStaleness, UE_KINDA_SMALL_NUMBER);
+	Job->LastRunTime = GetWorld()->GetTimeSeconds();
+
+	return Jobs.Add(MoveTemp(Job));
+}
+
+void UHelicopterSchedulerSubsystem::UnregisterJob(int32 Handle)
+{
+	if(!Jobs.IsValidIndex(Handle))
+		return;
+
+	if(bIsRunningJobs)
+	{
+		Jobs[Handle]->bPendingRemoval = true;
+		PendingRemovals.AddUnique(Handle);
+		return;
+	}
+
+	Jobs.RemoveAt(Handle);
+}
+
+void UHelicopterSchedulerSubsystem::MarkJobStale(int32 Handle)
+{
+	if(Jobs.IsValidIndex(Handle))
+		Jobs[Handle]->bForced = true;
+}
+
+const FHelicopterSchedulerStats& UHelicopterSchedulerSubsystem::GetLastFrameStats() const
+{
+	return LastFrameStats;
+}
+
+void UHelicopterSchedulerSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	SCOPE_CYCLE_COUNTER(STAT_HeliScheduledJobs);
+
+	const double StartSeconds = FPlatformTime::Seconds();
+	const double BudgetSeconds = CVarHeliSchedulerBudgetMs.GetValueOnGameThread() / 1000.0;
+	const double Now = GetWorld()->GetTimeSeconds();
+
+	FVector ViewLocation { FVector::ZeroVector };
+	bool bHasViewLocation = false;
+
+	if(const APlayerController* PlayerController = GetWorld()->GetFirstPlayerController())
+	{
+		FRotator ViewRotation {};
+		PlayerController->GetPlayerViewPoint(ViewLocation, ViewRotation);
+		bHasViewLocation = true;
+	}
+
+	DueJobs.Reset();
+
+	for(auto It = Jobs.CreateIterator(); It; ++It)
+	{
+		const FJob& Job = **It;
+		const AActor* Owner = Job.Owner.Get();
+
+		if(!Owner)
+		{
+			It.RemoveCurrent();
+			continue;
+		}
+
+		// Pooled helicopters have nothing to catch up with
+		if(!Owner->IsActorTickEnabled())
+			continue;
+
+		if(Job.bForced)
+		{
+			DueJobs.Add({ It.GetIndex(), TNumericLimits<float>::Max() });
+			continue;
+		}
+
+		const float Staleness = Now - Job.LastRunTime;
+		const float Urgency = Staleness * CalculatePriority(Owner, ViewLocation, bHasViewLocation) / Job.MaxStaleness;
+
+		if(Urgency >= 1.f)
+			DueJobs.Add({ It.GetIndex(), Urgency });
+	}
+
+	// The most urgent first, so whatever gets deferred is the freshest
+	DueJobs.Sort([](const FDueJob& A, const FDueJob& B)
+	{
+		return A.Urgency > B.Urgency;
+	});
+
+	FHelicopterSchedulerStats Stats {};
+	Stats.NumJobs = Jobs.Num();
+
+	float StalenessRatioSum = 0.f;
+
+	bIsRunningJobs = true;
+
+	for(const FDueJob& DueJob : DueJobs)
+	{
+		// At least one job runs every frame, so even a zero budget makes progress
+		if(Stats.NumRun > 0 && FPlatformTime::Seconds() - StartSeconds >= BudgetSeconds)
+		{
+			Stats.NumDeferred = DueJobs.Num() - Stats.NumRun;
+			break;
+		}
+
+		FJob* Job = Jobs[DueJob.Handle].Get();
+		if(Job->bPendingRemoval)
+			continue;
+
+		const float Staleness = Now - Job->LastRunTime;
+		const float StalenessRatio = Staleness / Job->MaxStaleness;
+
+		Job->LastRunTime = Now;
+		Job->bForced = false;
+		Job->Work(Staleness);
+
+		++Stats.NumRun;
+		StalenessRatioSum += StalenessRatio;
+		Stats.MaxStalenessRatio = FMath::Max(Stats.MaxStalenessRatio, StalenessRatio);
+
+		if(StalenessRatio > 1.f)
+			++Stats.NumOverdue;
+	}
+
+	bIsRunningJobs = false;
+
+	for(const int32 Handle : PendingRemovals)
+	{
+		Jobs.RemoveAt(Handle);
+	}
+
+	PendingRemovals.Reset();
+
+	Stats.AverageStalenessRatio = Stats.NumRun > 0 ? StalenessRatioSum / Stats.NumRun : 0.f;
+	Stats.TimeSpentMs = (FPlatformTime::Seconds() - StartSeconds) * 1000.0;
+
+	LastFrameStats = Stats;
+
+	SET_DWORD_STAT(STAT_HeliScheduledJobsRun, Stats.NumRun);
+	SET_DWORD_STAT(STAT_HeliScheduledJobsDeferred, Stats.NumDeferred);
+	SET_DWORD_STAT(STAT_HeliScheduledJobsOverdue, Stats.NumOverdue);
+	SET_FLOAT_STAT(STAT_HeliScheduledJobsMaxStaleness, Stats.MaxStalenessRatio);
+}
+
+TStatId UHelicopterSchedulerSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UHelicopterSchedulerSubsystem, STATGROUP_Tickables);
+}
+
+bool UHelicopterSchedulerSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	return Super::ShouldCreateSubsystem(Outer) && CVarHeliSchedulerEnabled.GetValueOnGameThread();
+}
+
+void UHelicopterSchedulerSubsystem::Deinitialize()
+{
+	Jobs.Empty();
+	DueJobs.Empty();
+	PendingRemovals.Empty();
+
+	Super::Deinitialize();
+}
+
+bool UHelicopterSchedulerSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+float UHelicopterSchedulerSubsystem::CalculatePriority(const AActor* Owner, const FVector& ViewLocation,
+	bool bHasViewLocation) const
+{
+	const APawn* Pawn = Cast<APawn>(Owner);
+	if(Pawn && Pawn->IsPlayerControlled())
+		return FMath::Max(CVarHeliSchedulerPlayerPriority.GetValueOnGameThread(), 1.f);
+
+	if(!bHasViewLocation)
+		return 1.f;
+
+	const float NearDistance = FMath::Max(CVarHeliSchedulerNearDistance.GetValueOnGameThread(), 1.f);
+	const float Nearness = 1.f - FMath::Min(FVector::Dist(Owner->GetActorLocation(), ViewLocation) / NearDistance, 1.f);
+
+	return FMath::Lerp(1.f, FMath::Max(CVarHeliSchedulerNearPriority.GetValueOnGameThread(), 1.f), Nearness);
+}
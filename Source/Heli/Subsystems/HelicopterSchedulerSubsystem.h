@@ -0,0 +1,113 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "HelicopterSchedulerSubsystem.generated.h"
+
+// Gets seconds since the job ran last time
+using FHelicopterScheduledWork = TFunction<void(float /* TimeSinceLastRun */)>;
+
+USTRUCT(BlueprintType)
+struct FHelicopterSchedulerStats
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumJobs { 0 };
+
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumRun { 0 };
+
+	// Jobs that were due but didn't fit into the budget
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumDeferred { 0 };
+
+	// Jobs that ran later than their max staleness
+	UPROPERTY(BlueprintReadOnly)
+	int32 NumOverdue { 0 };
+
+	// The worst staleness of jobs that ran, relative to their max staleness. Above 1 budget is too small
+	UPROPERTY(BlueprintReadOnly)
+	float MaxStalenessRatio { 0.f };
+
+	UPROPERTY(BlueprintReadOnly)
+	float AverageStalenessRatio { 0.f };
+
+	UPROPERTY(BlueprintReadOnly)
+	float TimeSpentMs { 0.f };
+};
+
+/**
+ * Runs per helicopter work that tolerates being late, like altitude traces, AI decisions and route lookups,
+ * within a fixed time budget per frame. Job is due once it's stale enough for its priority and due jobs run
+ * the most urgent first until the budget is spent, the rest wait for the next frame and only get more urgent.
+ * Jobs of player helicopters and helicopters near the player are allowed to go stale less.
+ * Jobs of actors with disabled tick, e.g. pooled helicopters, are skipped.
+ */
+UCLASS()
+class HELI_API UHelicopterSchedulerSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Job runs at least every MaxStaleness seconds while the budget allows it, the first time on the next frame.
+	// Returns handle for UnregisterJob, the job is dropped on its own when the owner is destroyed
+	int32 RegisterJob(AActor* Owner, float MaxStaleness, FHelicopterScheduledWork&& Work);
+
+	// Safe to call from a running job
+	void UnregisterJob(int32 Handle);
+
+	// Next frame runs the job before others, no matter how fresh it is
+	void MarkJobStale(int32 Handle);
+
+	UFUNCTION(BlueprintCallable)
+	const FHelicopterSchedulerStats& GetLastFrameStats() const;
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void Deinitialize() override;
+
+protected:
+
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+
+	struct FJob
+	{
+		TWeakObjectPtr<AActor> Owner {};
+		FHelicopterScheduledWork Work {};
+		float MaxStaleness { 0.f };
+		double LastRunTime { 0.0 };
+		bool bForced { true };
+		bool bPendingRemoval { false };
+	};
+
+	struct FDueJob
+	{
+		int32 Handle { INDEX_NONE };
+		float Urgency { 0.f };
+	};
+
+	// Jobs are kept by pointer, so the one that runs stays in place when others are registered from it
+	TSparseArray<TUniquePtr<FJob>> Jobs {};
+
+	// Reused every frame to not allocate
+	TArray<FDueJob> DueJobs {};
+
+	// Jobs unregistered while jobs are running, removed after that
+	TArray<int32> PendingRemovals {};
+
+	bool bIsRunningJobs { false };
+
+	FHelicopterSchedulerStats LastFrameStats {};
+
+	// How many times sooner than its max staleness the owner's job becomes due
+	float CalculatePriority(const AActor* Owner, const FVector& ViewLocation, bool bHasViewLocation) const;
+
+};
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+// Layout of the shared memory region written by UHelicopterSharedStateSubsystem.
+// Kept free of engine types, so external cockpit and motion platform tools can include it as is.
+//
+// Region is a header followed by NumSlots slots. Every slot is guarded by a seqlock:
+// writer makes Sequence odd, writes payload and makes it even again. Reader copies payload
+// between two reads of Sequence and retries if they differ or are odd.
+
+#include <cstdint>
+
+namespace HeliSharedState
+{
+	constexpr uint32_t Magic = 0x48454C49; // HELI
+	constexpr uint32_t Version = 1;
+
+	struct FHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t HeaderSize;
+		uint32_t SlotSize;
+		uint32_t NumSlots;
+		// Publish rate of the writer in Hz, 0 when it follows the variable physics step rate like it does now
+		float PublishRate;
+		uint8_t Reserved[40];
+	};
+
+	// World space, centimeters, degrees and seconds like the rest of the game
+	struct FPayload
+	{
+		// Zero when nobody controls a helicopter in the slot
+		uint32_t bValid;
+		uint32_t HelicopterId;
+		double Time;
+		double Location[3];
+		// Pitch, yaw, roll
+		float Rotation[3];
+		float LinearVelocity[3];
+		// Roll, pitch, yaw rates in helicopter axes
+		float AngularVelocity[3];
+		float LinearAcceleration[3];
+		float Altitude;
+		float Collective;
+		float MassKg;
+		float WeightOnWheels;
+	};
+
+	struct FSlot
+	{
+		volatile uint32_t Sequence;
+		uint32_t Reserved;
+		FPayload Payload;
+	};
+
+	static_assert(sizeof(FHeader) == 64, "Header size is a part of the protocol");
+	static_assert(sizeof(FPayload) == 104, "Payload size is a part of the protocol, bump Version when changing it");
+	static_assert(sizeof(FSlot) % 8 == 0, "Slots must keep doubles aligned");
+}
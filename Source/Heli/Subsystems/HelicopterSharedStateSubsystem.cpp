@@ -0,0 +1,372 @@
+﻿#include "HelicopterSharedStateSubsystem.h"
+
+#include "HelicopterSharedStateLayout.h"
+#include "Chaos/SimCallbackInput.h"
+#include "Chaos/SimCallbackObject.h"
+#include "Engine/World.h"
+#include "GameFramework/PlayerController.h"
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+#include "Heli/Vehicles/Helicopters/Helicopter.h"
+#include "Heli/Vehicles/Helicopters/HelicopterMovementComponent.h"
+#include "PBDRigidsSolver.h"
+#include "Physics/Experimental/PhysScene_Chaos.h"
+#include "PhysicsProxy/SingleParticlePhysicsProxy.h"
+
+static TAutoConsoleVariable<bool> CVarHeliSharedStateEnabled(
+	TEXT("heli.SharedState.Enabled"),
+	false,
+	TEXT("Publish state of locally controlled helicopters to shared memory. Read when world is created"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<FString> CVarHeliSharedStateName(
+	TEXT("heli.SharedState.Name"),
+	TEXT("HeliSharedState"),
+	TEXT("Name of the shared memory region readers open, PIE instances after the first one add _<instance> to it"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<int32> CVarHeliSharedStateNumSlots(
+	TEXT("heli.SharedState.NumSlots"),
+	4,
+	TEXT("How many helicopters the region has room for"),
+	ECVF_Default
+);
+
+namespace HeliSharedStatePublishing
+{
+	// Regions mapped by worlds of this process, a second world mapping the same name would clear slots of the first one
+	TSet<FString> MappedRegionNames {};
+
+	HeliSharedState::FSlot* GetSlot(uint8* RegionAddress, int32 SlotIndex)
+	{
+		return reinterpret_cast<HeliSharedState::FSlot*>(
+			RegionAddress + sizeof(HeliSharedState::FHeader) + SlotIndex * sizeof(HeliSharedState::FSlot)
+		);
+	}
+
+	void WriteSlot(HeliSharedState::FSlot* Slot, const HeliSharedState::FPayload& Payload)
+	{
+		// Seqlock, odd sequence tells readers the payload is being written. Interlocked ops are full barriers
+		volatile int32* Sequence = reinterpret_cast<volatile int32*>(&Slot->Sequence);
+		FPlatformAtomics::InterlockedIncrement(Sequence);
+		FMemory::Memcpy(&Slot->Payload, &Payload, sizeof(Payload));
+		FPlatformAtomics::InterlockedIncrement(Sequence);
+	}
+
+	void InvalidateSlot(HeliSharedState::FSlot* Slot)
+	{
+		if(Slot->Payload.bValid == 0)
+			return;
+
+		volatile int32* Sequence = reinterpret_cast<volatile int32*>(&Slot->Sequence);
+		FPlatformAtomics::InterlockedIncrement(Sequence);
+		Slot->Payload.bValid = 0;
+		FPlatformAtomics::InterlockedIncrement(Sequence);
+	}
+}
+
+// Game thread part of a slot, physics thread adds the body state of every step
+struct FHelicopterSharedStateSource
+{
+	Chaos::FSingleParticlePhysicsProxy* Proxy { nullptr };
+	uint32 HelicopterId { 0 };
+	float Altitude { 0.f };
+	float Collective { 0.f };
+	float MassKg { 0.f };
+	float WeightOnWheels { 0.f };
+};
+
+struct FHelicopterSharedStateInput : public Chaos::FSimCallbackInput
+{
+	uint8* RegionAddress { nullptr };
+
+	int32 NumSlots { 0 };
+
+	// World time the physics steps of the frame start at
+	double FrameStartTime { 0.0 };
+
+	TArray<FHelicopterSharedStateSource> Sources {};
+
+	void Reset()
+	{
+		RegionAddress = nullptr;
+		NumSlots = 0;
+		FrameStartTime = 0.0;
+		Sources.Reset();
+	}
+};
+
+/**
+ * Writes slots before every physics step from the body state the previous step left.
+ * The last step of a frame is published before the first step of the next one.
+ */
+class FHelicopterSharedStatePublisher : public Chaos::TSimCallbackObject<FHelicopterSharedStateInput>
+{
+public:
+
+	virtual void OnPreSimulate_Internal() override;
+
+private:
+
+	struct FSlotHistory
+	{
+		uint32 HelicopterId { 0 };
+		FVector Velocity { FVector::ZeroVector };
+		// Negative before the first sample
+		double Time { -1.0 };
+	};
+
+	double FrameStartTime { -1.0 };
+
+	// Step time of the frame already simulated before the current step
+	double FrameElapsedTime { 0.0 };
+
+	// To derive accelerations, per slot
+	TArray<FSlotHistory> History {};
+
+	bool PublishSlot(HeliSharedState::FSlot* Slot, FSlotHistory& SlotHistory, const FHelicopterSharedStateSource& Source, double Time);
+
+};
+
+void FHelicopterSharedStatePublisher::OnPreSimulate_Internal()
+{
+	using namespace HeliSharedStatePublishing;
+
+	const FHelicopterSharedStateInput* Input = GetConsumerInput_Internal();
+	if(!Input || !Input->RegionAddress)
+		return;
+
+	// Substeps of a frame share the input
+	if(Input->FrameStartTime != FrameStartTime)
+	{
+		FrameStartTime = Input->FrameStartTime;
+		FrameElapsedTime = 0.0;
+	}
+
+	const double Time = FrameStartTime + FrameElapsedTime;
+	FrameElapsedTime += GetDeltaTime_Internal();
+
+	History.SetNum(Input->NumSlots);
+
+	int32 SlotIndex = 0;
+
+	for(const FHelicopterSharedStateSource& Source : Input->Sources)
+	{
+		if(SlotIndex == Input->NumSlots)
+			break;
+
+		if(PublishSlot(GetSlot(Input->RegionAddress, SlotIndex), History[SlotIndex], Source, Time))
+			++SlotIndex;
+	}
+
+	for(; SlotIndex < Input->NumSlots; ++SlotIndex)
+	{
+		InvalidateSlot(GetSlot(Input->RegionAddress, SlotIndex));
+		History[SlotIndex] = {};
+	}
+}
+
+bool FHelicopterSharedStatePublisher::PublishSlot(HeliSharedState::FSlot* Slot, FSlotHistory& SlotHistory,
+	const FHelicopterSharedStateSource& Source, double Time)
+{
+	Chaos::FRigidBodyHandle_Internal* Body = Source.Proxy ? Source.Proxy->GetPhysicsThreadAPI() : nullptr;
+	if(!Body)
+		return false;
+
+	const FQuat Quat = Body->R();
+	const FRotator3f Rotation { Quat.Rotator() };
+	const FVector Velocity = Body->V();
+
+	// Chaos keeps angular velocity in radians
+	const FVector3f AngularVelocity { Quat.UnrotateVector(FMath::RadiansToDegrees(FVector(Body->W()))) };
+
+	// First sample of a helicopter in the slot has nothing to compare with
+	const double DeltaTime = Time - SlotHistory.Time;
+	const bool bHasPrevious = SlotHistory.Time >= 0.0 && SlotHistory.HelicopterId == Source.HelicopterId;
+	const FVector3f Acceleration = bHasPrevious && DeltaTime > UE_DOUBLE_KINDA_SMALL_NUMBER
+		? FVector3f((Velocity - SlotHistory.Velocity) / DeltaTime)
+		: FVector3f::ZeroVector;
+
+	SlotHistory.HelicopterId = Source.HelicopterId;
+	SlotHistory.Velocity = Velocity;
+	SlotHistory.Time = Time;
+
+	// Filled aside, so shared memory is written with a single copy while the slot is locked
+	HeliSharedState::FPayload Payload {};
+	Payload.bValid = 1;
+	Payload.HelicopterId = Source.HelicopterId;
+	Payload.Time = Time;
+
+	const FVector Location = Body->X();
+	Payload.Location[0] = Location.X;
+	Payload.Location[1] = Location.Y;
+	Payload.Location[2] = Location.Z;
+	
+	Payload.Rotation[0] = Rotation.Pitch;
+	Payload.Rotation[1] = Rotation.Yaw;
+	Payload.Rotation[2] = Rotation.Roll;
+
+	const FVector3f Velocity3f { Velocity };
+	
+	for(int32 Axis = 0; Axis < 3; ++Axis)
+	{
+		Payload.LinearVelocity[Axis] = Velocity3f[Axis];
+		Payload.AngularVelocity[Axis] = AngularVelocity[Axis];
+		Payload.LinearAcceleration[Axis] = Acceleration[Axis];
+	}
+
+	// Game thread values change once per frame
+	Payload.Altitude = Source.Altitude;
+	Payload.Collective = Source.Collective;
+	Payload.MassKg = Source.MassKg;
+	Payload.WeightOnWheels = Source.WeightOnWheels;
+
+	HeliSharedStatePublishing::WriteSlot(Slot, Payload);
+	return true;
+}
+
+bool UHelicopterSharedStateSubsystem::ShouldCreateSubsystem(UObject* Outer) const
+{
+	return Super::ShouldCreateSubsystem(Outer) && CVarHeliSharedStateEnabled.GetValueOnGameThread();
+}
+
+bool UHelicopterSharedStateSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+void UHelicopterSharedStateSubsystem::OnWorldBeginPlay(UWorld& InWorld)
+{
+	LLM_SCOPE_BYTAG(Heli_Subsystems);
+
+	Super::OnWorldBeginPlay(InWorld);
+
+	FPhysScene* PhysScene = InWorld.GetPhysicsScene();
+	if(!PhysScene || !PhysScene->GetSolver())
+	{
+		HELI_ERR("Shared state is published by physics steps, world %s has no physics scene", *InWorld.GetName());
+		return;
+	}
+
+	FString Name = CVarHeliSharedStateName.GetValueOnGameThread();
+
+	// PIE instances run in one process, each of them gets a region of its own
+	const int32 PIEInstance = InWorld.GetPackage()->GetPIEInstanceID();
+	if(InWorld.WorldType == EWorldType::PIE && PIEInstance > 0)
+		Name += FString::Printf(TEXT("_%d"), PIEInstance);
+
+	if(HeliSharedStatePublishing::MappedRegionNames.Contains(Name))
+	{
+		HELI_ERR("Shared memory region %s is already published by another world", *Name);
+		return;
+	}
+
+	NumSlots = FMath::Max(CVarHeliSharedStateNumSlots.GetValueOnGameThread(), 1);
+	const SIZE_T RegionSize = sizeof(HeliSharedState::FHeader) + NumSlots * sizeof(HeliSharedState::FSlot);
+
+	SharedMemoryRegion = FPlatformMemory::MapNamedSharedMemoryRegion(
+		Name,
+		true,
+		FPlatformMemory::ESharedMemoryAccess::Read | FPlatformMemory::ESharedMemoryAccess::Write,
+		RegionSize
+	);
+
+	if(!SharedMemoryRegion)
+	{
+		HELI_ERR("Failed to create shared memory region %s", *Name);
+		return;
+	}
+
+	RegionName = Name;
+	HeliSharedStatePublishing::MappedRegionNames.Add(RegionName);
+
+	// Nobody else in this process writes to the region, clearing leftovers of a previous run is safe
+	uint8* Address = static_cast<uint8*>(SharedMemoryRegion->GetAddress());
+	FMemory::Memzero(Address, RegionSize);
+
+	HeliSharedState::FHeader& Header = *reinterpret_cast<HeliSharedState::FHeader*>(Address);
+	Header.HeaderSize = sizeof(HeliSharedState::FHeader);
+	Header.SlotSize = sizeof(HeliSharedState::FSlot);
+	Header.NumSlots = NumSlots;
+	Header.PublishRate = 0.f;
+	Header.Version = HeliSharedState::Version;
+
+	// Magic goes last, readers that see it can trust the rest of the header
+	FPlatformMisc::MemoryBarrier();
+	Header.Magic = HeliSharedState::Magic;
+
+	Publisher = PhysScene->GetSolver()->CreateAndRegisterSimCallbackObject_External<FHelicopterSharedStatePublisher>();
+	PhysScenePreTickHandle = PhysScene->OnPhysScenePreTick.AddUObject(this, &UHelicopterSharedStateSubsystem::OnPhysScenePreTick);
+}
+
+void UHelicopterSharedStateSubsystem::Deinitialize()
+{
+	// Physics isn't ticked async, no step is writing to the region while the world goes away
+	if(FPhysScene* PhysScene = GetWorld()->GetPhysicsScene())
+	{
+		if(PhysScenePreTickHandle.IsValid())
+			PhysScene->OnPhysScenePreTick.Remove(PhysScenePreTickHandle);
+
+		if(Publisher && PhysScene->GetSolver())
+			PhysScene->GetSolver()->UnregisterAndFreeSimCallbackObject_External(Publisher);
+	}
+
+	PhysScenePreTickHandle.Reset();
+	Publisher = nullptr;
+
+	if(SharedMemoryRegion)
+	{
+		uint8* Address = static_cast<uint8*>(SharedMemoryRegion->GetAddress());
+
+		for(int32 SlotIndex = 0; SlotIndex < NumSlots; ++SlotIndex)
+		{
+			HeliSharedStatePublishing::InvalidateSlot(HeliSharedStatePublishing::GetSlot(Address, SlotIndex));
+		}
+
+		FPlatformMemory::UnmapNamedSharedMemoryRegion(SharedMemoryRegion);
+		SharedMemoryRegion = nullptr;
+
+		HeliSharedStatePublishing::MappedRegionNames.Remove(RegionName);
+		RegionName.Reset();
+	}
+
+	Super::Deinitialize();
+}
+
+void UHelicopterSharedStateSubsystem::OnPhysScenePreTick(FChaosScene* PhysScene, float DeltaTime)
+{
+	const UWorld* World = GetWorld();
+	if(!Publisher || !SharedMemoryRegion || !World)
+		return;
+
+	// Queued every frame, even without helicopters, so the steps invalidate slots nobody flies anymore
+	FHelicopterSharedStateInput* Input = Publisher->GetProducerInputData_External();
+	Input->RegionAddress = static_cast<uint8*>(SharedMemoryRegion->GetAddress());
+	Input->NumSlots = NumSlots;
+	Input->FrameStartTime = World->GetTimeSeconds() - DeltaTime;
+
+	// Only a couple of local players, walking controllers is cheaper than tracking helicopters
+	for(FConstPlayerControllerIterator It = World->GetPlayerControllerIterator(); It && Input->Sources.Num() < NumSlots; ++It)
+	{
+		const APlayerController* PlayerController = It->Get();
+		if(!PlayerController || !PlayerController->IsLocalController())
+			continue;
+
+		const AHelicopter* Helicopter = Cast<AHelicopter>(PlayerController->GetPawn());
+		const UHelicopterMovementComponent* Movement = Helicopter ? Helicopter->GetHelicopterMovementComponent() : nullptr;
+		const UPrimitiveComponent* Body = Movement ? Movement->UpdatedPrimitive.Get() : nullptr;
+		const FBodyInstance* BodyInstance = Body ? Body->GetBodyInstance() : nullptr;
+		if(!BodyInstance || !BodyInstance->IsValidBodyInstance())
+			continue;
+
+		FHelicopterSharedStateSource& Source = Input->Sources.AddDefaulted_GetRef();
+		Source.Proxy = BodyInstance->GetPhysicsActorHandle();
+		Source.HelicopterId = Helicopter->GetUniqueID();
+		Source.Altitude = Movement->GetTelemetry().Altitude;
+		Source.Collective = Movement->GetCurrentCollective();
+		Source.MassKg = Movement->GetActualMass();
+		Source.WeightOnWheels = Movement->GetWeightOnWheels();
+	}
+}
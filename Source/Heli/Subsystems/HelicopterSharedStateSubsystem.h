@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "HAL/PlatformMemory.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "HelicopterSharedStateSubsystem.generated.h"
+
+class FChaosScene;
+class FHelicopterSharedStatePublisher;
+
+/**
+ * Publishes state of locally controlled helicopters to a named shared memory region,
+ * see HelicopterSharedStateLayout.h for the format.
+ * Written on physics thread before every physics step with the state the previous step left, so substeps
+ * are published one by one. Game thread only picks the helicopters once per frame before physics ticks.
+ * Readers never wait for the game and game never waits for readers.
+ * Every world maps its own region, PIE instances after the first one add _<instance> to heli.SharedState.Name.
+ * Exists only when heli.SharedState.Enabled is set.
+ */
+UCLASS()
+class HELI_API UHelicopterSharedStateSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	virtual bool ShouldCreateSubsystem(UObject* Outer) const override;
+
+	virtual void OnWorldBeginPlay(UWorld& InWorld) override;
+
+	virtual void Deinitialize() override;
+
+protected:
+
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+
+	FPlatformMemory::FSharedMemoryRegion* SharedMemoryRegion { nullptr };
+
+	// Name the region is mapped with, empty when it isn't
+	FString RegionName {};
+
+	FHelicopterSharedStatePublisher* Publisher { nullptr };
+
+	FDelegateHandle PhysScenePreTickHandle {};
+
+	int32 NumSlots { 0 };
+
+	// Queues helicopters of local players for the physics steps of the frame
+	void OnPhysScenePreTick(FChaosScene* PhysScene, float DeltaTime);
+
+};
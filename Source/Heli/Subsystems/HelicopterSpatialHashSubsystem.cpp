@@ -0,0 +1,336 @@
+﻿#include "HelicopterSpatialHashSubsystem.h"
+
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+#include "Heli/Vehicles/Helicopters/Helicopter.h"
+#include "Heli/Vehicles/Helicopters/HelicopterMovementComponent.h"
+
+static TAutoConsoleVariable<float> CVarHeliSpatialHashCellSize(
+	TEXT("heli.SpatialHash.CellSize"),
+	50000.f,
+	TEXT("Size of helicopter spatial hash cell in cm. Read when the world starts"),
+	ECVF_Default
+);
+
+int32 UHelicopterSpatialHashSubsystem::RegisterHelicopter(AHelicopter* Helicopter, const FVector& Location,
+	const FVector& Velocity)
+{
+	LLM_SCOPE_BYTAG(Heli_Subsystems);
+
+	FEntry Entry {};
+	Entry.Helicopter = Helicopter;
+	Entry.Location = Location;
+	Entry.Velocity = Velocity;
+
+	const int32 Handle = Entries.Add(MoveTemp(Entry));
+	AddToCell(Handle, GetCell(Location));
+
+	MaxTrackedSpeed = FMath::Max(MaxTrackedSpeed, Velocity.Size());
+
+	return Handle;
+}
+
+void UHelicopterSpatialHashSubsystem::UnregisterHelicopter(int32 Handle)
+{
+	if(!Entries.IsValidIndex(Handle))
+		return;
+
+	RemoveFromCell(Handle);
+	Entries.RemoveAt(Handle);
+}
+
+void UHelicopterSpatialHashSubsystem::UpdateHelicopter(int32 Handle, const FVector& Location, const FVector& Velocity)
+{
+	LLM_SCOPE_BYTAG(Heli_Subsystems);
+
+	if(!Entries.IsValidIndex(Handle))
+		return;
+
+	FEntry& Entry = Entries[Handle];
+	Entry.Location = Location;
+	Entry.Velocity = Velocity;
+
+	const FIntPoint NewCell = GetCell(Location);
+	if(NewCell != Entry.Cell)
+	{
+		RemoveFromCell(Handle);
+		AddToCell(Handle, NewCell);
+	}
+
+	MaxTrackedSpeed = FMath::Max(MaxTrackedSpeed, Velocity.Size());
+}
+
+void UHelicopterSpatialHashSubsystem::FindHelicoptersInRadius(const FVector& Location, float Radius,
+	TArray<AHelicopter*>& OutHelicopters, const AHelicopter* IgnoredHelicopter) const
+{
+	OutHelicopters.Reset();
+
+	const float RadiusSquared = FMath::Square(Radius);
+
+	ForEachEntryInSquare(Location, Radius, [&](const FEntry& Entry)
+	{
+		if(FVector::DistSquared(Entry.Location, Location) > RadiusSquared)
+			return;
+
+		AHelicopter* Helicopter = Entry.Helicopter.Get();
+		if(Helicopter && Helicopter != IgnoredHelicopter)
+			OutHelicopters.Add(Helicopter);
+	});
+}
+
+void UHelicopterSpatialHashSubsystem::FindNearestHelicopters(const FVector& Location, int32 Count, float MaxRadius,
+	TArray<AHelicopter*>& OutHelicopters, const AHelicopter* IgnoredHelicopter) const
+{
+	OutHelicopters.Reset();
+
+	if(Count <= 0 || Entries.Num() == 0)
+		return;
+
+	struct FCandidate
+	{
+		float DistSquared;
+		AHelicopter* Helicopter;
+	};
+
+	// Max heap, so the farthest of found candidates is on top and gets replaced first
+	TArray<FCandidate, TInlineAllocator<16>> Candidates {};
+	const auto FartherFirst = [](const FCandidate& A, const FCandidate& B) { return A.DistSquared > B.DistSquared; };
+
+	const float MaxRadiusSquared = FMath::Square(MaxRadius);
+	const FIntPoint Center = GetCell(Location);
+	const int32 MaxRing = FMath::CeilToInt32(MaxRadius * InvCellSize);
+
+	const auto VisitCell = [&](const FIntPoint& CellCoords)
+	{
+		const FCell* Cell = Cells.Find(CellCoords);
+		if(!Cell)
+			return;
+
+		for(const int32 Handle : *Cell)
+		{
+			const FEntry& Entry = Entries[Handle];
+			
+			const float DistSquared = FVector::DistSquared(Entry.Location, Location);
+			if(DistSquared > MaxRadiusSquared)
+				continue;
+
+			AHelicopter* Helicopter = Entry.Helicopter.Get();
+			if(!Helicopter || Helicopter == IgnoredHelicopter)
+				continue;
+
+			if(Candidates.Num() < Count)
+			{
+				Candidates.HeapPush({ DistSquared, Helicopter }, FartherFirst);
+			}
+			else if(DistSquared < Candidates.HeapTop().DistSquared)
+			{
+				Candidates.HeapPopDiscard(FartherFirst, false);
+				Candidates.HeapPush({ DistSquared, Helicopter }, FartherFirst);
+			}
+		}
+	};
+
+	for(int32 Ring = 0; Ring <= MaxRing; ++Ring)
+	{
+		if(Ring == 0)
+		{
+			VisitCell(Center);
+		}
+		else
+		{
+			// Walk only the border of the square ring
+			for(int32 Offset = -Ring; Offset <= Ring; ++Offset)
+			{
+				VisitCell({ Center.X + Offset, Center.Y - Ring });
+				VisitCell({ Center.X + Offset, Center.Y + Ring });
+			}
+
+			for(int32 Offset = -Ring + 1; Offset <= Ring - 1; ++Offset)
+			{
+				VisitCell({ Center.X - Ring, Center.Y + Offset });
+				VisitCell({ Center.X + Ring, Center.Y + Offset });
+			}
+		}
+
+		// Every cell of the next rings is at least this far, nothing closer can be found there
+		const float UnvisitedDistance = Ring * CellSize;
+		if(Candidates.Num() == Count && Candidates.HeapTop().DistSquared <= FMath::Square(UnvisitedDistance))
+			break;
+	}
+
+	Candidates.Sort([](const FCandidate& A, const FCandidate& B) { return A.DistSquared < B.DistSquared; });
+
+	OutHelicopters.Reserve(Candidates.Num());
+	for(const FCandidate& Candidate : Candidates)
+	{
+		OutHelicopters.Add(Candidate.Helicopter);
+	}
+}
+
+void UHelicopterSpatialHashSubsystem::FindConflicts(const AHelicopter* Helicopter, float TimeHorizon,
+	float SeparationDistance, TArray<FHelicopterConflict>& OutConflicts) const
+{
+	OutConflicts.Reset();
+
+	if(!Helicopter || !Helicopter->GetHelicopterMovementComponent())
+		return;
+
+	const int32 Handle = Helicopter->GetHelicopterMovementComponent()->GetSpatialHashHandle();
+	if(!Entries.IsValidIndex(Handle))
+		return;
+
+	const FEntry& Self = Entries[Handle];
+
+	// Nobody can come from farther than that within the horizon
+	const float SearchRadius = SeparationDistance + (Self.Velocity.Size() + MaxTrackedSpeed) * TimeHorizon;
+	const float SeparationSquared = FMath::Square(SeparationDistance);
+
+	ForEachEntryInSquare(Self.Location, SearchRadius, [&](const FEntry& Entry)
+	{
+		if(&Entry == &Self)
+			return;
+		
+		const FVector RelativeLocation = Entry.Location - Self.Location;
+		const FVector RelativeVelocity = Entry.Velocity - Self.Velocity;
+		
+		const float RelativeSpeedSquared = RelativeVelocity.SizeSquared();
+		const float Time = RelativeSpeedSquared > UE_KINDA_SMALL_NUMBER
+			? FMath::Clamp(-RelativeLocation.Dot(RelativeVelocity) / RelativeSpeedSquared, 0.f, TimeHorizon)
+			: 0.f;
+
+		const float ClosestDistanceSquared = (RelativeLocation + RelativeVelocity * Time).SizeSquared();
+		if(ClosestDistanceSquared > SeparationSquared)
+			return;
+
+		AHelicopter* Other = Entry.Helicopter.Get();
+		if(!Other)
+			return;
+
+		FHelicopterConflict& Conflict = OutConflicts.AddDefaulted_GetRef();
+		Conflict.Other = Other;
+		Conflict.TimeToClosestApproach = Time;
+		Conflict.ClosestApproachDistance = FMath::Sqrt(ClosestDistanceSquared);
+	});
+
+	OutConflicts.Sort([](const FHelicopterConflict& A, const FHelicopterConflict& B)
+	{
+		return A.TimeToClosestApproach < B.TimeToClosestApproach;
+	});
+}
+
+int32 UHelicopterSpatialHashSubsystem::GetNumHelicopters() const
+{
+	return Entries.Num();
+}
+
+float UHelicopterSpatialHashSubsystem::GetMaxTrackedSpeed() const
+{
+	return MaxTrackedSpeed;
+}
+
+void UHelicopterSpatialHashSubsystem::Initialize(FSubsystemCollectionBase& Collection)
+{
+	Super::Initialize(Collection);
+
+	CellSize = FMath::Max(CVarHeliSpatialHashCellSize.GetValueOnGameThread(), 100.f);
+	InvCellSize = 1.f / CellSize;
+}
+
+void UHelicopterSpatialHashSubsystem::Deinitialize()
+{
+	if(Entries.Num() > 0)
+	{
+		HELI_WRN("%d helicopters are still registered in spatial hash", Entries.Num());
+	}
+	
+	Entries.Empty();
+	Cells.Empty();
+
+	Super::Deinitialize();
+}
+
+bool UHelicopterSpatialHashSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+FIntPoint UHelicopterSpatialHashSubsystem::GetCell(const FVector& Location) const
+{
+	return {
+		FMath::FloorToInt32(Location.X * InvCellSize),
+		FMath::FloorToInt32(Location.Y * InvCellSize)
+	};
+}
+
+void UHelicopterSpatialHashSubsystem::AddToCell(int32 Handle, const FIntPoint& Cell)
+{
+	FCell& CellEntries = Cells.FindOrAdd(Cell);
+	
+	FEntry& Entry = Entries[Handle];
+	Entry.Cell = Cell;
+	Entry.IndexInCell = CellEntries.Add(Handle);
+}
+
+void UHelicopterSpatialHashSubsystem::RemoveFromCell(int32 Handle)
+{
+	FEntry& Entry = Entries[Handle];
+	
+	FCell* CellEntries = Cells.Find(Entry.Cell);
+	if(!CellEntries || !CellEntries->IsValidIndex(Entry.IndexInCell))
+		return;
+
+	// Swap with the last one so removal is O(1), the moved entry has to know its new index
+	CellEntries->RemoveAtSwap(Entry.IndexInCell, 1, false);
+	if(CellEntries->IsValidIndex(Entry.IndexInCell))
+	{
+		Entries[(*CellEntries)[Entry.IndexInCell]].IndexInCell = Entry.IndexInCell;
+	}
+
+	if(CellEntries->IsEmpty())
+	{
+		Cells.Remove(Entry.Cell);
+	}
+
+	Entry.IndexInCell = INDEX_NONE;
+}
+
+template<typename FVisitor>
+void UHelicopterSpatialHashSubsystem::ForEachEntryInSquare(const FVector& Location, float HalfExtent,
+	FVisitor&& Visitor) const
+{
+	const FIntPoint Min = GetCell(Location - FVector(HalfExtent, HalfExtent, 0.f));
+	const FIntPoint Max = GetCell(Location + FVector(HalfExtent, HalfExtent, 0.f));
+
+	// Huge squares cover more cells than there are helicopters, just check all of them then
+	const int64 NumCellsInSquare = int64(Max.X - Min.X + 1) * int64(Max.Y - Min.Y + 1);
+	if(NumCellsInSquare > Cells.Num())
+	{
+		for(const TPair<FIntPoint, FCell>& Pair : Cells)
+		{
+			if(Pair.Key.X < Min.X || Pair.Key.X > Max.X || Pair.Key.Y < Min.Y || Pair.Key.Y > Max.Y)
+				continue;
+
+			for(const int32 Handle : Pair.Value)
+			{
+				Visitor(Entries[Handle]);
+			}
+		}
+		
+		return;
+	}
+
+	for(int32 X = Min.X; X <= Max.X; ++X)
+	{
+		for(int32 Y = Min.Y; Y <= Max.Y; ++Y)
+		{
+			const FCell* Cell = Cells.Find({ X, Y });
+			if(!Cell)
+				continue;
+
+			for(const int32 Handle : *Cell)
+			{
+				Visitor(Entries[Handle]);
+			}
+		}
+	}
+}
@@ -0,0 +1,120 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "HelicopterSpatialHashSubsystem.generated.h"
+
+class AHelicopter;
+
+USTRUCT(BlueprintType)
+struct FHelicopterConflict
+{
+	GENERATED_BODY()
+
+	UPROPERTY(BlueprintReadOnly)
+	TObjectPtr<AHelicopter> Other {};
+
+	// Seconds from now until helicopters are the closest, zero if they are getting away from each other
+	UPROPERTY(BlueprintReadOnly)
+	float TimeToClosestApproach { 0.f };
+
+	UPROPERTY(BlueprintReadOnly)
+	float ClosestApproachDistance { 0.f };
+};
+
+/**
+ * Uniform grid of all helicopters in the world, kept up to date by UHelicopterMovementComponent.
+ * Grid is 2D since helicopters are spread horizontally much more than vertically, distances are still 3D.
+ */
+UCLASS()
+class HELI_API UHelicopterSpatialHashSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Returns handle that must be passed to update and unregister
+	int32 RegisterHelicopter(AHelicopter* Helicopter, const FVector& Location, const FVector& Velocity);
+
+	void UnregisterHelicopter(int32 Handle);
+
+	// Cheap when helicopter stays in the same cell, otherwise moves it between two cells
+	void UpdateHelicopter(int32 Handle, const FVector& Location, const FVector& Velocity);
+
+	UFUNCTION(BlueprintCallable)
+	void FindHelicoptersInRadius(
+		const FVector& Location,
+		float Radius,
+		TArray<AHelicopter*>& OutHelicopters,
+		const AHelicopter* IgnoredHelicopter = nullptr
+	) const;
+
+	// Sorted from the nearest one. MaxRadius limits how far the search goes
+	UFUNCTION(BlueprintCallable)
+	void FindNearestHelicopters(
+		const FVector& Location,
+		int32 Count,
+		float MaxRadius,
+		TArray<AHelicopter*>& OutHelicopters,
+		const AHelicopter* IgnoredHelicopter = nullptr
+	) const;
+
+	// Predicts closest approach with every helicopter around assuming all of them keep current velocities.
+	// Reports the ones that get closer than SeparationDistance within TimeHorizon seconds
+	UFUNCTION(BlueprintCallable)
+	void FindConflicts(
+		const AHelicopter* Helicopter,
+		float TimeHorizon,
+		float SeparationDistance,
+		TArray<FHelicopterConflict>& OutConflicts
+	) const;
+
+	UFUNCTION(BlueprintCallable)
+	int32 GetNumHelicopters() const;
+
+	// The highest speed any tracked helicopter has ever had, good to bound searches by time
+	float GetMaxTrackedSpeed() const;
+
+	virtual void Initialize(FSubsystemCollectionBase& Collection) override;
+
+	virtual void Deinitialize() override;
+
+protected:
+
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+
+	struct FEntry
+	{
+		TWeakObjectPtr<AHelicopter> Helicopter {};
+		FVector Location { FVector::ZeroVector };
+		FVector Velocity { FVector::ZeroVector };
+		FIntPoint Cell { FIntPoint::ZeroValue };
+		int32 IndexInCell { INDEX_NONE };
+	};
+
+	using FCell = TArray<int32, TInlineAllocator<8>>;
+
+	float CellSize { 0.f };
+
+	float InvCellSize { 0.f };
+
+	// Never decreases, so conflict search radius is always conservative
+	float MaxTrackedSpeed { 0.f };
+
+	TSparseArray<FEntry> Entries {};
+
+	TMap<FIntPoint, FCell> Cells {};
+
+	FIntPoint GetCell(const FVector& Location) const;
+
+	void AddToCell(int32 Handle, const FIntPoint& Cell);
+
+	void RemoveFromCell(int32 Handle);
+
+	// Calls Visitor for every entry in cells overlapping the square around location
+	template<typename FVisitor>
+	void ForEachEntryInSquare(const FVector& Location, float HalfExtent, FVisitor&& Visitor) const;
+
+};
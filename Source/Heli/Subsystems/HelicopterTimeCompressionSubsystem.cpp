@@ -0,0 +1,313 @@
+﻿#include "HelicopterTimeCompressionSubsystem.h"
+
+#include "Engine/World.h"
+#include "GameFramework/WorldSettings.h"
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+#include "Heli/Vehicles/Helicopters/HelicopterMovementComponent.h"
+#include "Heli/Vehicles/Helicopters/HelicopterPhysicsStepCallback.h"
+#include "PBDRigidsSolver.h"
+#include "Physics/Experimental/PhysScene_Chaos.h"
+#include "PhysicsEngine/PhysicsSettings.h"
+
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Time Compression Factor"), STAT_HeliTimeCompressionFactor, STATGROUP_Heli);
+DECLARE_FLOAT_COUNTER_STAT(TEXT("Time Compression Achieved Ratio"), STAT_HeliTimeCompressionAchievedRatio, STATGROUP_Heli);
+
+static TAutoConsoleVariable<float> CVarHeliTimeCompressionMaxFactor(
+	TEXT("heli.TimeCompression.MaxFactor"),
+	32.f,
+	TEXT("The highest time compression that can be requested"),
+	ECVF_Default
+);
+
+static TAutoConsoleVariable<float> CVarHeliTimeCompressionFrameBudgetMs(
+	TEXT("heli.TimeCompression.FrameBudgetMs"),
+	33.3f,
+	TEXT("Wall clock milliseconds a compressed frame may take, compression is lowered when frames take longer"),
+	ECVF_Default
+);
+
+namespace HelicopterTimeCompression
+{
+	// Step helicopters are flown with while compressing, the same as an ordinary frame at 60 fps
+	constexpr float SubstepDeltaTime { 1.f / 60.f };
+
+	constexpr int32 MaxSubsteps { 64 };
+
+	// Substepping is a project setting shared by every world of the process, PIE worlds may compress at once.
+	// The first one to compress saves the setting and the last one to stop puts it back
+	int32 NumWorldsSubstepping { 0 };
+
+	bool bSavedSubstepping { false };
+
+	float SavedMaxSubstepDeltaTime { 0.f };
+
+	int32 SavedMaxSubsteps { 0 };
+}
+
+static FAutoConsoleCommandWithWorldArgsAndOutputDevice HeliTimeCompressionCommand(
+	TEXT("heli.TimeCompression"),
+	TEXT("Runs the world Factor times faster, 1 turns it off. Without arguments reports the current state"),
+	FConsoleCommandWithWorldArgsAndOutputDeviceDelegate::CreateLambda(
+		[](const TArray<FString>& Args, UWorld* World, FOutputDevice& Ar)
+		{
+			UHelicopterTimeCompressionSubsystem* TimeCompression = World
+				? World->GetSubsystem<UHelicopterTimeCompressionSubsystem>()
+				: nullptr;
+
+			if(!TimeCompression)
+			{
+				Ar.Log(TEXT("Time can be compressed only in game worlds"));
+				return;
+			}
+
+			if(Args.Num() > 0 && !TimeCompression->SetTimeCompression(FCString::Atof(*Args[0])))
+			{
+				Ar.Log(TEXT("Time can't be compressed here, see the log"));
+				return;
+			}
+
+			Ar.Logf(TEXT("Time compression: requested %.1fx, current %.1fx, achieved %.1fx"),
+				TimeCompression->GetRequestedFactor(),
+				TimeCompression->GetCurrentFactor(),
+				TimeCompression->GetAchievedRatio()
+			);
+		}
+	)
+);
+
+bool UHelicopterTimeCompressionSubsystem::SetTimeCompression(float Factor)
+{
+	UWorld* World = GetWorld();
+
+	if(World->GetNetMode() == NM_Client)
+	{
+		HELI_WRN("Time can be compressed only by server, clients follow its time dilation");
+		return false;
+	}
+
+	const float MaxFactor = FMath::Max(CVarHeliTimeCompressionMaxFactor.GetValueOnGameThread(), 1.f);
+	const float NewFactor = FMath::Clamp(Factor, 1.f, MaxFactor);
+
+	// Without physics steps helicopters would integrate whole compressed frames at once
+	if(NewFactor > 1.f && !BeginPhysicsSubsteps())
+	{
+		HELI_WRN("Time can't be compressed without physics scene of the world");
+		return false;
+	}
+
+	RequestedFactor = NewFactor;
+	LastWallTime = -1.0;
+
+	// World settings clamp dilation to 20 by default, the frame budget and physics are the limits here
+	if(AWorldSettings* WorldSettings = World->GetWorldSettings())
+		WorldSettings->MaxGlobalTimeDilation = FMath::Max(WorldSettings->MaxGlobalTimeDilation, MaxFactor);
+
+	if(RequestedFactor <= 1.f)
+	{
+		ApplyFactor(1.f);
+		AchievedRatio = 1.f;
+
+		EndPhysicsSubsteps();
+
+		HELI_LOG("Time compression is off");
+		return true;
+	}
+
+	// Compression ramps up from the current factor as long as frames fit into the budget
+	HELI_LOG("Compressing time up to %.1fx", RequestedFactor);
+	return true;
+}
+
+float UHelicopterTimeCompressionSubsystem::GetRequestedFactor() const
+{
+	return RequestedFactor;
+}
+
+float UHelicopterTimeCompressionSubsystem::GetCurrentFactor() const
+{
+	return CurrentFactor;
+}
+
+float UHelicopterTimeCompressionSubsystem::GetAchievedRatio() const
+{
+	return AchievedRatio;
+}
+
+bool UHelicopterTimeCompressionSubsystem::IsCompressingTime() const
+{
+	return RequestedFactor > 1.f || CurrentFactor > 1.f;
+}
+
+void UHelicopterTimeCompressionSubsystem::RegisterHelicopter(UHelicopterMovementComponent* Helicopter)
+{
+	if(!Helicopter)
+		return;
+
+	Helicopters.AddUnique(Helicopter);
+	Helicopter->SetPhysicsStepCallback(PhysicsStepCallback);
+}
+
+void UHelicopterTimeCompressionSubsystem::UnregisterHelicopter(UHelicopterMovementComponent* Helicopter)
+{
+	if(!Helicopter)
+		return;
+
+	Helicopters.Remove(Helicopter);
+	Helicopter->SetPhysicsStepCallback(nullptr);
+}
+
+void UHelicopterTimeCompressionSubsystem::Tick(float DeltaTime)
+{
+	Super::Tick(DeltaTime);
+
+	const double WallTime = FPlatformTime::Seconds();
+	const double WorldTime = GetWorld()->GetTimeSeconds();
+
+	const float WallDeltaTime = WallTime - LastWallTime;
+	const float WorldDeltaTime = WorldTime - LastWorldTime;
+	const bool bHasLastTick = LastWallTime >= 0.0;
+
+	LastWallTime = WallTime;
+	LastWorldTime = WorldTime;
+
+	if(!bHasLastTick || WallDeltaTime <= 0.f)
+		return;
+
+	// Averaged over about ten frames, so a single hitch doesn't swing the factor
+	AverageWallDeltaTime = AverageWallDeltaTime > 0.f
+		? FMath::Lerp(AverageWallDeltaTime, WallDeltaTime, 0.1f)
+		: WallDeltaTime;
+
+	AchievedRatio = FMath::Lerp(AchievedRatio, WorldDeltaTime / WallDeltaTime, 0.1f);
+
+	const float FrameBudget = CVarHeliTimeCompressionFrameBudgetMs.GetValueOnGameThread() / 1000.f;
+
+	float Factor = CurrentFactor;
+
+	if(AverageWallDeltaTime > FrameBudget)
+		Factor *= 0.9f;
+	else if(AverageWallDeltaTime < FrameBudget * 0.8f)
+		Factor *= 1.05f;
+
+	// Physics clamps its delta time, compressed time it can't simulate in one frame would be silently lost.
+	// Substepping turned on for compression allows about 1.07 s per frame
+	const float PhysicsMaxFactor = GetMaxPhysicsDeltaTime() / AverageWallDeltaTime;
+
+	ApplyFactor(FMath::Clamp(Factor, 1.f, FMath::Max(FMath::Min(RequestedFactor, PhysicsMaxFactor), 1.f)));
+
+	SET_FLOAT_STAT(STAT_HeliTimeCompressionFactor, CurrentFactor);
+	SET_FLOAT_STAT(STAT_HeliTimeCompressionAchievedRatio, AchievedRatio);
+}
+
+TStatId UHelicopterTimeCompressionSubsystem::GetStatId() const
+{
+	RETURN_QUICK_DECLARE_CYCLE_STAT(UHelicopterTimeCompressionSubsystem, STATGROUP_Tickables);
+}
+
+bool UHelicopterTimeCompressionSubsystem::IsTickable() const
+{
+	return IsCompressingTime();
+}
+
+void UHelicopterTimeCompressionSubsystem::Deinitialize()
+{
+	// Dilation goes away with the world, substepping is shared and has to be put back
+	EndPhysicsSubsteps();
+
+	RequestedFactor = 1.f;
+	CurrentFactor = 1.f;
+
+	Helicopters.Reset();
+
+	Super::Deinitialize();
+}
+
+bool UHelicopterTimeCompressionSubsystem::DoesSupportWorldType(const EWorldType::Type WorldType) const
+{
+	return WorldType == EWorldType::Game || WorldType == EWorldType::PIE;
+}
+
+float UHelicopterTimeCompressionSubsystem::GetMaxPhysicsDeltaTime()
+{
+	const UPhysicsSettings* PhysicsSettings = UPhysicsSettings::Get();
+
+	if(PhysicsSettings->bSubstepping)
+		return PhysicsSettings->MaxSubstepDeltaTime * PhysicsSettings->MaxSubsteps;
+
+	return PhysicsSettings->MaxPhysicsDeltaTime;
+}
+
+void UHelicopterTimeCompressionSubsystem::ApplyFactor(float Factor)
+{
+	UWorld* World = GetWorld();
+
+	// World settings clamp dilation to their own limits, keep what was actually applied
+	AWorldSettings* WorldSettings = World->GetWorldSettings();
+	CurrentFactor = WorldSettings ? WorldSettings->SetTimeDilation(Factor) : 1.f;
+}
+
+bool UHelicopterTimeCompressionSubsystem::BeginPhysicsSubsteps()
+{
+	if(PhysicsStepCallback)
+		return true;
+
+	FPhysScene* PhysicsScene = GetWorld()->GetPhysicsScene();
+	Chaos::FPhysicsSolver* Solver = PhysicsScene ? PhysicsScene->GetSolver() : nullptr;
+	if(!Solver)
+		return false;
+
+	PhysicsStepCallback = Solver->CreateAndRegisterSimCallbackObject_External<FHelicopterPhysicsStepCallback>();
+
+	using namespace HelicopterTimeCompression;
+
+	// Physics scene reads the settings every frame
+	UPhysicsSettings* PhysicsSettings = GetMutableDefault<UPhysicsSettings>();
+	if(NumWorldsSubstepping++ == 0)
+	{
+		bSavedSubstepping = PhysicsSettings->bSubstepping;
+		SavedMaxSubstepDeltaTime = PhysicsSettings->MaxSubstepDeltaTime;
+		SavedMaxSubsteps = PhysicsSettings->MaxSubsteps;
+	}
+
+	PhysicsSettings->bSubstepping = true;
+	PhysicsSettings->MaxSubstepDeltaTime = SubstepDeltaTime;
+	PhysicsSettings->MaxSubsteps = MaxSubsteps;
+
+	for(UHelicopterMovementComponent* Helicopter : Helicopters)
+	{
+		if(IsValid(Helicopter))
+			Helicopter->SetPhysicsStepCallback(PhysicsStepCallback);
+	}
+
+	HELI_LOG("Physics substeps every %.4f s while compressing time", SubstepDeltaTime);
+	return true;
+}
+
+void UHelicopterTimeCompressionSubsystem::EndPhysicsSubsteps()
+{
+	if(!PhysicsStepCallback)
+		return;
+
+	for(UHelicopterMovementComponent* Helicopter : Helicopters)
+	{
+		if(IsValid(Helicopter))
+			Helicopter->SetPhysicsStepCallback(nullptr);
+	}
+
+	FPhysScene* PhysicsScene = GetWorld()->GetPhysicsScene();
+	if(Chaos::FPhysicsSolver* Solver = PhysicsScene ? PhysicsScene->GetSolver() : nullptr)
+		Solver->UnregisterAndFreeSimCallbackObject_External(PhysicsStepCallback);
+
+	PhysicsStepCallback = nullptr;
+
+	using namespace HelicopterTimeCompression;
+
+	if(--NumWorldsSubstepping == 0)
+	{
+		UPhysicsSettings* PhysicsSettings = GetMutableDefault<UPhysicsSettings>();
+		PhysicsSettings->bSubstepping = bSavedSubstepping;
+		PhysicsSettings->MaxSubstepDeltaTime = SavedMaxSubstepDeltaTime;
+		PhysicsSettings->MaxSubsteps = SavedMaxSubsteps;
+	}
+}
@@ -0,0 +1,93 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "HelicopterTimeCompressionSubsystem.generated.h"
+
+class FHelicopterPhysicsStepCallback;
+class UHelicopterMovementComponent;
+
+/**
+ * Fast-forwards the world for training scenarios and AI soak tests, "heli.TimeCompression 8" runs it 8 times faster.
+ * Time is compressed by world time dilation. While it is, physics substeps every frame into steps of 1/60 s and
+ * FHelicopterPhysicsStepCallback flies helicopters before each of them with input held for the frame, so a compressed
+ * frame is many ordinary steps from the pose the previous one left and not one long one.
+ * Substepping is turned on only while compressing and put back after, ordinary frames keep a single physics step.
+ * Factor is lowered when frames take longer than heli.TimeCompression.FrameBudgetMs and raised back when they fit,
+ * and it never goes above what physics can simulate in one frame without dropping time. That's 64 substeps
+ * of 1/60 s per frame, so 32x holds at 30 fps and higher and 16x at 15 fps.
+ * Works only on server and in standalone since clients follow server's dilation.
+ */
+UCLASS()
+class HELI_API UHelicopterTimeCompressionSubsystem : public UTickableWorldSubsystem
+{
+	GENERATED_BODY()
+
+public:
+
+	// Factor the world should run at, 1 turns compression off. Returns false when compression isn't possible here
+	UFUNCTION(BlueprintCallable)
+	bool SetTimeCompression(float Factor);
+
+	UFUNCTION(BlueprintCallable)
+	float GetRequestedFactor() const;
+
+	// Factor currently applied after frame budget and physics limits
+	UFUNCTION(BlueprintCallable)
+	float GetCurrentFactor() const;
+
+	// Simulated seconds per wall clock second, averaged over the last frames
+	UFUNCTION(BlueprintCallable)
+	float GetAchievedRatio() const;
+
+	UFUNCTION(BlueprintCallable)
+	bool IsCompressingTime() const;
+
+	// Helicopters are flown by physics steps while time is compressed
+	void RegisterHelicopter(UHelicopterMovementComponent* Helicopter);
+
+	void UnregisterHelicopter(UHelicopterMovementComponent* Helicopter);
+
+	virtual void Tick(float DeltaTime) override;
+
+	virtual TStatId GetStatId() const override;
+
+	virtual bool IsTickable() const override;
+
+	virtual void Deinitialize() override;
+
+protected:
+
+	virtual bool DoesSupportWorldType(const EWorldType::Type WorldType) const override;
+
+private:
+
+	UPROPERTY(Transient)
+	TArray<TObjectPtr<UHelicopterMovementComponent>> Helicopters {};
+
+	// Registered on the solver of the world while compressing, null otherwise
+	FHelicopterPhysicsStepCallback* PhysicsStepCallback { nullptr };
+
+	float RequestedFactor { 1.f };
+
+	float CurrentFactor { 1.f };
+
+	float AchievedRatio { 1.f };
+
+	// Wall clock and world time of the previous tick, negative before the first one
+	double LastWallTime { -1.0 };
+
+	double LastWorldTime { 0.0 };
+
+	float AverageWallDeltaTime { 0.f };
+
+	// The most game time physics simulates in one frame, more than that would be dropped
+	static float GetMaxPhysicsDeltaTime();
+
+	void ApplyFactor(float Factor);
+
+	bool BeginPhysicsSubsteps();
+
+	void EndPhysicsSubsteps();
+
+};
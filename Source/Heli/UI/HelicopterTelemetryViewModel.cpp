@@ -0,0 +1,53 @@
+﻿#include "HelicopterTelemetryViewModel.h"
+
+#include "Heli/Vehicles/Helicopters/HelicopterMovementComponent.h"
+
+// Stored value is changed only together with notification,
+// so small drift accumulates until it's big enough to be shown
+#define HELI_SET_TELEMETRY_FIELD(Member, NewValue, Threshold) \
+	if(bForce || FMath::Abs((NewValue) - Member) >= (Threshold)) \
+	{ \
+		UE_MVVM_SET_PROPERTY_VALUE(Member, NewValue); \
+	}
+
+void UHelicopterTelemetryViewModel::SetTelemetry(const FHelicopterTelemetry& Telemetry, bool bForce)
+{
+	HELI_SET_TELEMETRY_FIELD(Altitude, Telemetry.Altitude, AltitudeThreshold);
+	HELI_SET_TELEMETRY_FIELD(VerticalSpeed, Telemetry.VerticalSpeed, SpeedThreshold);
+	HELI_SET_TELEMETRY_FIELD(HorizontalSpeed, Telemetry.HorizontalSpeed, SpeedThreshold);
+	HELI_SET_TELEMETRY_FIELD(Collective, Telemetry.Collective, CollectiveThreshold);
+	HELI_SET_TELEMETRY_FIELD(ActualMassKg, Telemetry.ActualMassKg, MassThreshold);
+	HELI_SET_TELEMETRY_FIELD(AdditionalMassKg, Telemetry.AdditionalMassKg, MassThreshold);
+}
+
+#undef HELI_SET_TELEMETRY_FIELD
+
+float UHelicopterTelemetryViewModel::GetAltitude() const
+{
+	return Altitude;
+}
+
+float UHelicopterTelemetryViewModel::GetVerticalSpeed() const
+{
+	return VerticalSpeed;
+}
+
+float UHelicopterTelemetryViewModel::GetHorizontalSpeed() const
+{
+	return HorizontalSpeed;
+}
+
+float UHelicopterTelemetryViewModel::GetCollective() const
+{
+	return Collective;
+}
+
+float UHelicopterTelemetryViewModel::GetActualMassKg() const
+{
+	return ActualMassKg;
+}
+
+float UHelicopterTelemetryViewModel::GetAdditionalMassKg() const
+{
+	return AdditionalMassKg;
+}
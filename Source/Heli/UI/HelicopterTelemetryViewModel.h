@@ -0,0 +1,69 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "MVVMViewModelBase.h"
+#include "HelicopterTelemetryViewModel.generated.h"
+
+struct FHelicopterTelemetry;
+
+/**
+ * Telemetry of one helicopter for widgets to bind to.
+ * Values are pushed by UHelicopterMovementComponent and a field is notified only
+ * when it moved further than its display threshold, so widgets don't rebuild text every frame.
+ */
+UCLASS(BlueprintType)
+class HELI_API UHelicopterTelemetryViewModel : public UMVVMViewModelBase
+{
+	GENERATED_BODY()
+
+public:
+
+	// Minimal change of each value that is worth to show, in the same units as the value
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float AltitudeThreshold { 50.f };
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float SpeedThreshold { 10.f };
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float CollectiveThreshold { 0.005f };
+
+	UPROPERTY(EditAnywhere, BlueprintReadWrite)
+	float MassThreshold { 1.f };
+
+	// Ignores thresholds when bForce is set, e.g. for the first snapshot after binding
+	void SetTelemetry(const FHelicopterTelemetry& Telemetry, bool bForce = false);
+
+	float GetAltitude() const;
+
+	float GetVerticalSpeed() const;
+
+	float GetHorizontalSpeed() const;
+
+	float GetCollective() const;
+
+	float GetActualMassKg() const;
+
+	float GetAdditionalMassKg() const;
+
+private:
+
+	UPROPERTY(BlueprintReadOnly, FieldNotify, Getter, meta=(AllowPrivateAccess))
+	float Altitude { 0.f };
+
+	UPROPERTY(BlueprintReadOnly, FieldNotify, Getter, meta=(AllowPrivateAccess))
+	float VerticalSpeed { 0.f };
+
+	UPROPERTY(BlueprintReadOnly, FieldNotify, Getter, meta=(AllowPrivateAccess))
+	float HorizontalSpeed { 0.f };
+
+	UPROPERTY(BlueprintReadOnly, FieldNotify, Getter, meta=(AllowPrivateAccess))
+	float Collective { 0.f };
+
+	UPROPERTY(BlueprintReadOnly, FieldNotify, Getter, meta=(AllowPrivateAccess))
+	float ActualMassKg { 0.f };
+
+	UPROPERTY(BlueprintReadOnly, FieldNotify, Getter, meta=(AllowPrivateAccess))
+	float AdditionalMassKg { 0.f };
+
+};
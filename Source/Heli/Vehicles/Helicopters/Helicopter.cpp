@@ -1,20 +1,33 @@
 ﻿#include "Helicopter.h"
 
+#include "HelicopterLandingGearComponent.h"
 #include "HelicopterMovementComponent.h"
+#include "HelicopterPhysicsProxyComponent.h"
+#include "HelicopterRewindComponent.h"
 #include "HelicopterRootMeshComponent.h"
+#include "HelicopterStreamingSourceComponent.h"
+#include "HelicopterTrajectoryPredictorComponent.h"
 #include "Camera/CameraComponent.h"
+#include "Engine/World.h"
+#include "GameFramework/Controller.h"
 #include "GameFramework/SpringArmComponent.h"
+#include "Heli/HeliStats.h"
 #include "Heli/LogHeli.h"
 #include "Heli/Components/CameraLookAroundComponent.h"
 
 AHelicopter::AHelicopter()
 {
+	LLM_SCOPE_BYTAG(Heli_Helicopters);
+
 	PrimaryActorTick.bCanEverTick = true;
 	PrimaryActorTick.TickGroup = TG_PrePhysics;
 	PrimaryActorTick.EndTickGroup = TG_PrePhysics;
 
 	HelicopterMeshComponent = CreateDefaultSubobject<UHelicopterRootMeshComponent>(HelicopterMeshComponentName);
 	SetRootComponent(HelicopterMeshComponent);
+
+	PhysicsProxyComponent = CreateDefaultSubobject<UHelicopterPhysicsProxyComponent>(PhysicsProxyComponentName);
+	PhysicsProxyComponent->SetupAttachment(RootComponent);
 	
 	CameraSpringArmComponent = CreateDefaultSubobject<USpringArmComponent>(SpringArmComponentName);
 	CameraSpringArmComponent->SetupAttachment(RootComponent);
@@ -24,6 +37,10 @@ AHelicopter::AHelicopter()
 
 	HelicopterMovementComponent = CreateDefaultSubobject<UHelicopterMovementComponent>(HelicopterMovementComponentName);
 	CameraLookAroundComponent = CreateDefaultSubobject<UCameraLookAroundComponent>(CameraLookAroundComponentName);
+	HelicopterRewindComponent = CreateDefaultSubobject<UHelicopterRewindComponent>(HelicopterRewindComponentName);
+	LandingGearComponent = CreateDefaultSubobject<UHelicopterLandingGearComponent>(LandingGearComponentName);
+	StreamingSourceComponent = CreateDefaultSubobject<UHelicopterStreamingSourceComponent>(StreamingSourceComponentName);
+	TrajectoryPredictorComponent = CreateDefaultSubobject<UHelicopterTrajectoryPredictorComponent>(TrajectoryPredictorComponentName);
 }
 
 void AHelicopter::BeginPlay()
@@ -31,32 +48,154 @@ void AHelicopter::BeginPlay()
 	Super::BeginPlay();
 }
 
+void AHelicopter::MakePhysicsProxyRoot()
+{
+	if(RootComponent == PhysicsProxyComponent)
+		return;
+
+	if(!PhysicsProxyComponent || !HelicopterMeshComponent)
+	{
+		HELI_ERR("Can't use physics proxy for helicopter %s, proxy or mesh is null", *GetName());
+		bUsePhysicsProxy = false;
+		return;
+	}
+
+	FVector ProxyCenter;
+	if(!PhysicsProxyComponent->FitToMesh(HelicopterMeshComponent->GetSkeletalMeshAsset(), ProxyCenter))
+		HELI_WRN("Physics proxy of helicopter %s keeps its default size, there is no mesh to fit it to", *GetName());
+
+	// Mesh is still the root, so its relative transform is where the actor is
+	const FTransform ActorTransform = HelicopterMeshComponent->GetRelativeTransform();
+	const FTransform ProxyOffset { ProxyCenter };
+
+	// Swap proxy and mesh, so simulated proxy drives the actor and mesh just follows it.
+	// Nothing is registered yet, so attachment is only set up and no physics state is created twice
+	PhysicsProxyComponent->SetupAttachment(nullptr);
+	PhysicsProxyComponent->SetRelativeTransform(ProxyOffset * ActorTransform);
+	PhysicsProxyComponent->bAutoRegister = true;
+	SetRootComponent(PhysicsProxyComponent);
+
+	HelicopterMeshComponent->SetupAttachment(PhysicsProxyComponent);
+	HelicopterMeshComponent->SetRelativeTransform(ProxyOffset.Inverse());
+
+	// Mesh physics asset bodies are not created without collision
+	HelicopterMeshComponent->SetSimulatePhysics(false);
+	HelicopterMeshComponent->SetCollisionEnabled(ECollisionEnabled::NoCollision);
+
+	ConfigPhysicsProxy();
+
+	if(HelicopterMovementComponent)
+		HelicopterMovementComponent->SetUpdatedComponent(PhysicsProxyComponent);
+}
+
+void AHelicopter::StripCosmeticComponents()
+{
+	// Components are destroyed rather than not created in server build,
+	// cooked blueprints have templates of them and would fail to find them otherwise
+	if(CameraLookAroundComponent)
+	{
+		CameraLookAroundComponent->DestroyComponent();
+		CameraLookAroundComponent = nullptr;
+	}
+
+	if(CameraComponent)
+	{
+		CameraComponent->DestroyComponent();
+		CameraComponent = nullptr;
+	}
+
+	if(CameraSpringArmComponent)
+	{
+		CameraSpringArmComponent->DestroyComponent();
+		CameraSpringArmComponent = nullptr;
+	}
+
+	bCosmeticComponentsStripped = true;
+}
+
 void AHelicopter::ConfigHelicopterMesh()
 {
-	if(HelicopterMeshComponent)
+	if(!HelicopterMeshComponent)
+	{
+		HELI_ERR("Can't initialize helicopter %s because it has no skeletal mesh", *GetName());
+		return;
+	}
+	
+	if(bUsePhysicsProxy)
+	{
+		HelicopterMeshComponent->SetGenerateOverlapEvents(false);
+		HelicopterMeshComponent->SetNotifyRigidBodyCollision(false);
+
+		// Mesh is only a visual now, nobody needs its pose when it's not seen or far away
+		HelicopterMeshComponent->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickPoseWhenRendered;
+		HelicopterMeshComponent->bEnableUpdateRateOptimizations = true;
+	}
+	else
 	{
 		HelicopterMeshComponent->SetCollisionProfileName("Pawn", true);
 		HelicopterMeshComponent->SetPhysMaterialOverride(HelicopterPhysicalMaterial);
 		HelicopterMeshComponent->SetGenerateOverlapEvents(true);
 		HelicopterMeshComponent->SetNotifyRigidBodyCollision(true);
 	}
-	else
+
+	if(bCosmeticComponentsStripped)
 	{
-		HELI_ERR("Can't initialize helicopter %s because it has no skeletal mesh", *GetName());
+		// Server never renders, so anim graph is never evaluated, only montages are kept for gameplay notifies
+		HelicopterMeshComponent->VisibilityBasedAnimTickOption = EVisibilityBasedAnimTickOption::OnlyTickMontagesWhenNotRendered;
+
+		// Without physics on it, mesh has nothing to do on server at all
+		if(bUsePhysicsProxy)
+		{
+			HelicopterMeshComponent->bNoSkeletonUpdate = true;
+			HelicopterMeshComponent->SetComponentTickEnabled(false);
+		}
 	}
 }
 
+void AHelicopter::ConfigPhysicsProxy()
+{
+	PhysicsProxyComponent->SetCollisionProfileName("Pawn", true);
+	PhysicsProxyComponent->SetPhysMaterialOverride(HelicopterPhysicalMaterial);
+	PhysicsProxyComponent->SetGenerateOverlapEvents(true);
+	PhysicsProxyComponent->SetNotifyRigidBodyCollision(true);
+}
+
 void AHelicopter::Tick(float DeltaTime)
 {
 	Super::Tick(DeltaTime);
 }
 
+void AHelicopter::PreRegisterAllComponents()
+{
+	Super::PreRegisterAllComponents();
+
+	// Blueprint defaults of bUsePhysicsProxy are not known in constructor yet, this is the last point before
+	// components register and create their physics state. Editor worlds keep the mesh as root
+	const UWorld* World = GetWorld();
+	if(bUsePhysicsProxy && World && World->IsGameWorld())
+		MakePhysicsProxyRoot();
+}
+
+void AHelicopter::PreInitializeComponents()
+{
+	LLM_SCOPE_BYTAG(Heli_Helicopters);
+
+	Super::PreInitializeComponents();
+
+	if(IsNetMode(NM_DedicatedServer))
+		StripCosmeticComponents();
+}
+
 void AHelicopter::PostInitializeComponents()
 {
+	LLM_SCOPE_BYTAG(Heli_Helicopters);
+
 	Super::PostInitializeComponents();
 
 	ConfigHelicopterMesh();
-	ConfigCameraAndSpringArm();
+
+	if(!bCosmeticComponentsStripped)
+		ConfigCameraAndSpringArm();
 }
 
 void AHelicopter::SetAdditionalMass(float NewMass, bool bAddToCurrent)
@@ -75,6 +214,22 @@ float AHelicopter::GetAdditionalMass() const
 	return HelicopterMovementComponent->GetAdditionalMass();
 }
 
+int32 AHelicopter::AddCargo(float MassKg, const FVector& Offset)
+{
+	if(!HelicopterMovementComponent)
+		return INDEX_NONE;
+
+	return HelicopterMovementComponent->AddCargo(MassKg, Offset);
+}
+
+bool AHelicopter::RemoveCargo(int32 Handle)
+{
+	if(!HelicopterMovementComponent)
+		return false;
+
+	return HelicopterMovementComponent->RemoveCargo(Handle);
+}
+
 float AHelicopter::GetMaxAdditionalMass() const
 {
 	if(!HelicopterMovementComponent)
@@ -101,12 +256,18 @@ float AHelicopter::GetActualMass() const
 
 float AHelicopter::GetVerticalSpeed() const
 {
-	return GetVelocity().Z;
+	if(!HelicopterMovementComponent)
+		return GetVelocity().Z;
+
+	return HelicopterMovementComponent->GetTelemetry().VerticalSpeed;
 }
 
 float AHelicopter::GetHorizontalSpeed() const
 {
-	return GetVelocity().Size2D();
+	if(!HelicopterMovementComponent)
+		return GetVelocity().Size2D();
+
+	return HelicopterMovementComponent->GetTelemetry().HorizontalSpeed;
 }
 
 float AHelicopter::GetAltitude() const
@@ -125,6 +286,184 @@ float AHelicopter::GetCurrentCollective() const
 	return HelicopterMovementComponent->GetCurrentCollective();
 }
 
+UHelicopterMovementComponent* AHelicopter::GetHelicopterMovementComponent() const
+{
+	return HelicopterMovementComponent;
+}
+
+UHelicopterTrajectoryPredictorComponent* AHelicopter::GetTrajectoryPredictorComponent() const
+{
+	return TrajectoryPredictorComponent;
+}
+
+void AHelicopter::ResetHelicopterState()
+{
+	if(HelicopterMovementComponent)
+		HelicopterMovementComponent->ResetMovementState();
+
+	if(CameraLookAroundComponent)
+		CameraLookAroundComponent->ResetLookAround();
+
+	// Helicopter is teleported after reset, history before that is not valid anymore
+	if(HelicopterRewindComponent)
+		HelicopterRewindComponent->ResetHistory();
+
+	if(LandingGearComponent)
+		LandingGearComponent->ResetContacts();
+
+	if(TrajectoryPredictorComponent)
+		TrajectoryPredictorComponent->ResetPrediction();
+}
+
+bool AHelicopter::IsInPool() const
+{
+	return bIsInPool;
+}
+
+bool FHelicopterSharedRepMovement::Equals(const FHelicopterSharedRepMovement& Other) const
+{
+	// Time always differs, only movement decides whether it's worth sending
+	return RepMovement.Location == Other.RepMovement.Location
+		&& RepMovement.Rotation == Other.RepMovement.Rotation
+		&& RepMovement.LinearVelocity == Other.RepMovement.LinearVelocity
+		&& RepMovement.AngularVelocity == Other.RepMovement.AngularVelocity
+		&& RepMovement.bRepPhysics == Other.RepMovement.bRepPhysics;
+}
+
+bool AHelicopter::UpdateSharedReplication()
+{
+	if(GetLocalRole() != ROLE_Authority || bIsInPool)
+		return false;
+
+	const UPrimitiveComponent* PhysicsRoot = GetPhysicsRootComponent();
+	if(!PhysicsRoot)
+		return false;
+
+	FHelicopterSharedRepMovement SharedRepMovement {};
+	SharedRepMovement.RepMovement.Location = FRepMovement::RebaseOntoZeroOrigin(PhysicsRoot->GetComponentLocation(), this);
+	SharedRepMovement.RepMovement.Rotation = PhysicsRoot->GetComponentRotation();
+	SharedRepMovement.RepMovement.LinearVelocity = PhysicsRoot->GetPhysicsLinearVelocity();
+	SharedRepMovement.RepMovement.AngularVelocity = PhysicsRoot->GetPhysicsAngularVelocityInDegrees();
+	SharedRepMovement.RepMovement.bRepPhysics = PhysicsRoot->IsSimulatingPhysics();
+	SharedRepMovement.ServerTime = GetWorld()->GetTimeSeconds();
+
+	// Parked helicopters don't send anything, clients already have their last movement
+	if(!SharedRepMovement.Equals(LastSharedRepMovement))
+	{
+		LastSharedRepMovement = SharedRepMovement;
+		FastSharedReplication(SharedRepMovement);
+	}
+
+	return true;
+}
+
+void AHelicopter::FastSharedReplication_Implementation(const FHelicopterSharedRepMovement& SharedRepMovement)
+{
+	// Pilot's own helicopter and replays keep their movement
+	if(GetLocalRole() != ROLE_SimulatedProxy || GetWorld()->IsPlayingReplay())
+		return;
+
+	// Unreliable, an older update may come after a newer one
+	if(SharedRepMovement.ServerTime <= LastSharedRepServerTime)
+		return;
+
+	LastSharedRepServerTime = SharedRepMovement.ServerTime;
+
+	SetReplicatedMovement(SharedRepMovement.RepMovement);
+	OnRep_ReplicatedMovement();
+}
+
+void AHelicopter::ActivateFromPool(const FTransform& SpawnTransform)
+{
+	bIsInPool = false;
+
+	SetActorTransform(SpawnTransform, false, nullptr, ETeleportType::ResetPhysics);
+
+	if(UPrimitiveComponent* PhysicsRoot = GetPhysicsRootComponent())
+	{
+		PhysicsRoot->SetSimulatePhysics(true);
+		PhysicsRoot->WakeAllRigidBodies();
+	}
+
+	ResetHelicopterState();
+
+	if(HelicopterMovementComponent)
+		HelicopterMovementComponent->SetTrackedInSpatialHash(true);
+
+	SetActorHiddenInGame(false);
+	SetActorEnableCollision(true);
+	SetActorTickEnabled(true);
+	SetPoolableComponentsTickEnabled(true);
+
+	// Pool spawns helicopters without AI controller, so give it one now if class wants it
+	AutoPossessAI = GetClass()->GetDefaultObject<AHelicopter>()->AutoPossessAI;
+	
+	if(!Controller && AutoPossessPlayer == EAutoReceiveInput::Disabled && AutoPossessAI != EAutoPossessAI::Disabled)
+	{
+		SpawnDefaultController();
+	}
+
+	ReceiveActivatedFromPool();
+}
+
+void AHelicopter::DeactivateToPool()
+{
+	if(AController* OldController = Controller)
+	{
+		OldController->UnPossess();
+
+		if(!OldController->IsPlayerController())
+			OldController->Destroy();
+	}
+
+	ResetHelicopterState();
+
+	// Do not destroy physics state, just stop simulating it so body stays where it is
+	if(UPrimitiveComponent* PhysicsRoot = GetPhysicsRootComponent())
+	{
+		PhysicsRoot->SetSimulatePhysics(false);
+	}
+
+	if(HelicopterMovementComponent)
+		HelicopterMovementComponent->SetTrackedInSpatialHash(false);
+
+	SetActorHiddenInGame(true);
+	SetActorEnableCollision(false);
+	SetActorTickEnabled(false);
+	SetPoolableComponentsTickEnabled(false);
+
+	bIsInPool = true;
+
+	ReceiveDeactivatedToPool();
+}
+
+UPrimitiveComponent* AHelicopter::GetPhysicsRootComponent() const
+{
+	return Cast<UPrimitiveComponent>(GetRootComponent());
+}
+
+void AHelicopter::SetPoolableComponentsTickEnabled(bool bEnabled)
+{
+	if(HelicopterMeshComponent && !(bCosmeticComponentsStripped && bUsePhysicsProxy))
+		HelicopterMeshComponent->SetComponentTickEnabled(bEnabled);
+
+	if(HelicopterMovementComponent)
+		HelicopterMovementComponent->SetComponentTickEnabled(bEnabled);
+
+	if(CameraLookAroundComponent)
+		CameraLookAroundComponent->SetComponentTickEnabled(bEnabled);
+
+	if(LandingGearComponent)
+		LandingGearComponent->SetComponentTickEnabled(bEnabled);
+
+	// Pooled helicopters don't move, there is nothing to record and the reset history should stay empty
+	if(HelicopterRewindComponent)
+		HelicopterRewindComponent->SetComponentTickEnabled(bEnabled && HelicopterRewindComponent->ShouldRecord());
+
+	if(TrajectoryPredictorComponent)
+		TrajectoryPredictorComponent->SetComponentTickEnabled(bEnabled && TrajectoryPredictorComponent->ShouldPredict());
+}
+
 void AHelicopter::ConfigCameraAndSpringArm()
 {
 	if(!CameraSpringArmComponent || !CameraComponent)
@@ -162,7 +501,7 @@ void AHelicopter::ConfigCameraAndSpringArm()
 		
 		CameraSpringArmComponent
 			->AttachToComponent(
-				RootComponent,
+				HelicopterMeshComponent,
 				AttachRules,
 				UHelicopterRootMeshComponent::HelicopterMeshSkeletonCameraSocketName
 			);
@@ -6,10 +6,31 @@
 
 class UHelicopterDestroyComponent;
 class UHelicopterRootMeshComponent;
+class UHelicopterPhysicsProxyComponent;
 class UCameraLookAroundComponent;
 class UCameraComponent;
 class USpringArmComponent;
 class UHelicopterMovementComponent;
+class UHelicopterRewindComponent;
+class UHelicopterLandingGearComponent;
+class UHelicopterStreamingSourceComponent;
+class UHelicopterTrajectoryPredictorComponent;
+
+// Movement UHeliReplicationGraph sends between full replications, serialized once for all connections
+USTRUCT()
+struct FHelicopterSharedRepMovement
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	FRepMovement RepMovement {};
+
+	// Server world time, clients drop updates older than the last one they applied
+	UPROPERTY()
+	float ServerTime { 0.f };
+
+	bool Equals(const FHelicopterSharedRepMovement& Other) const;
+};
 
 UCLASS(Blueprintable, Abstract, HideCategories=(ComponentReplication, Replication, ActorTick))
 class HELI_API AHelicopter : public APawn
@@ -24,11 +45,20 @@ public:
 	inline static FName HelicopterDestroyComponentName { TEXT("HelicopterDestroyComponent") };
 	inline static FName SpringArmComponentName { TEXT("SpringArmComponent") };
 	inline static FName CameraComponentName { TEXT("CameraComponent") };
+	inline static FName PhysicsProxyComponentName { TEXT("PhysicsProxyComponent") };
+	inline static FName HelicopterRewindComponentName { TEXT("HelicopterRewindComponent") };
+	inline static FName LandingGearComponentName { TEXT("LandingGearComponent") };
+	inline static FName StreamingSourceComponentName { TEXT("StreamingSourceComponent") };
+	inline static FName TrajectoryPredictorComponentName { TEXT("TrajectoryPredictorComponent") };
 	
 	AHelicopter();
 	
 	virtual void Tick(float DeltaTime) override;
 
+	virtual void PreRegisterAllComponents() override;
+
+	virtual void PreInitializeComponents() override;
+
 	virtual void PostInitializeComponents() override;
 
 	UFUNCTION(BlueprintCallable)
@@ -37,6 +67,12 @@ public:
 	
 	UFUNCTION(BlueprintCallable)
 	float GetAdditionalMass() const;
+
+	UFUNCTION(BlueprintCallable)
+	int32 AddCargo(float MassKg, const FVector& Offset);
+
+	UFUNCTION(BlueprintCallable)
+	bool RemoveCargo(int32 Handle);
 	
 	UFUNCTION(BlueprintCallable)
 	float GetMaxAdditionalMass() const;
@@ -59,6 +95,34 @@ public:
 	UFUNCTION(BlueprintCallable)
 	float GetCurrentCollective() const;
 
+	UFUNCTION(BlueprintCallable)
+	UHelicopterMovementComponent* GetHelicopterMovementComponent() const;
+
+	UFUNCTION(BlueprintCallable)
+	UHelicopterTrajectoryPredictorComponent* GetTrajectoryPredictorComponent() const;
+
+	// Puts movement, cargo and camera state back to the values helicopter has been spawned with
+	UFUNCTION(BlueprintCallable)
+	void ResetHelicopterState();
+
+	UFUNCTION(BlueprintCallable)
+	bool IsInPool() const;
+
+	// Called by UHelicopterPoolSubsystem when helicopter is handed out
+	virtual void ActivateFromPool(const FTransform& SpawnTransform);
+
+	// Called by UHelicopterPoolSubsystem when helicopter is returned.
+	// Physics body is kept, it's only stopped and hidden
+	virtual void DeactivateToPool();
+
+	// Called by UHeliReplicationGraph on server. Sends current movement with FastSharedReplication unless it
+	// hasn't changed since the last call, false when helicopter has no movement to share
+	bool UpdateSharedReplication();
+
+	// Replication graph captures it and sends one bunch to every connection the helicopter isn't fully replicated to
+	UFUNCTION(NetMulticast, Unreliable)
+	void FastSharedReplication(const FHelicopterSharedRepMovement& SharedRepMovement);
+
 protected:
 
 	UPROPERTY()
@@ -70,21 +134,69 @@ protected:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly)
 	TObjectPtr<UHelicopterRootMeshComponent> HelicopterMeshComponent {};
 	
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	TObjectPtr<UHelicopterPhysicsProxyComponent> PhysicsProxyComponent {};
+
+	// Simulate simple proxy body instead of skeletal mesh physics asset.
+	// Mesh is attached to the proxy and used for visuals only, its animation is throttled off-screen and at distance
+	// Proxy box is fitted to bodies of the mesh physics asset
+	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly)
+	bool bUsePhysicsProxy { false };
+	
 	UPROPERTY(EditAnywhere, BlueprintReadOnly)
 	TObjectPtr<UHelicopterMovementComponent> HelicopterMovementComponent {};
 	
 	UPROPERTY(EditAnywhere, BlueprintReadOnly)
 	TObjectPtr<UCameraLookAroundComponent> CameraLookAroundComponent {};
 
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	TObjectPtr<UHelicopterRewindComponent> HelicopterRewindComponent {};
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	TObjectPtr<UHelicopterLandingGearComponent> LandingGearComponent {};
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	TObjectPtr<UHelicopterStreamingSourceComponent> StreamingSourceComponent {};
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly)
+	TObjectPtr<UHelicopterTrajectoryPredictorComponent> TrajectoryPredictorComponent {};
+
 	UPROPERTY(EditDefaultsOnly, BlueprintReadOnly)
 	TObjectPtr<UPhysicalMaterial> HelicopterPhysicalMaterial {};
 	
 	virtual void BeginPlay() override;
+
+	UFUNCTION(BlueprintImplementableEvent)
+	void ReceiveActivatedFromPool();
+
+	UFUNCTION(BlueprintImplementableEvent)
+	void ReceiveDeactivatedToPool();
 	
 private:
 
+	bool bIsInPool { false };
+
+	// Set on dedicated server, camera and look around are destroyed and mesh doesn't animate
+	bool bCosmeticComponentsStripped { false };
+
+	// Sent by server last time
+	FHelicopterSharedRepMovement LastSharedRepMovement {};
+
+	// Server time of the last shared movement applied on client
+	float LastSharedRepServerTime { -1.f };
+
+	void MakePhysicsProxyRoot();
+
+	void StripCosmeticComponents();
+
 	void ConfigHelicopterMesh();
 
+	void ConfigPhysicsProxy();
+
 	void ConfigCameraAndSpringArm();
+
+	UPrimitiveComponent* GetPhysicsRootComponent() const;
+
+	void SetPoolableComponentsTickEnabled(bool bEnabled);
 	
 };
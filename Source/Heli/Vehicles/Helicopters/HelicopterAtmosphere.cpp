@@ -0,0 +1,54 @@
+﻿#include "HelicopterAtmosphere.h"
+
+void FHelicopterAtmosphereTable::Bake(float InTemperatureOffset, float AltitudeStep)
+{
+	AltitudeStep = FMath::Max(AltitudeStep, 1.f);
+
+	TemperatureOffset = InTemperatureOffset;
+	InvAltitudeStep = 1.f / AltitudeStep;
+
+	const int32 NumSamples = FMath::CeilToInt32((MaxAltitude - MinAltitude) * InvAltitudeStep) + 1;
+
+	Samples.Reset(NumSamples);
+
+	for(int32 Index = 0; Index < NumSamples; ++Index)
+	{
+		const float Altitude = FMath::Min(MinAltitude + Index * AltitudeStep, MaxAltitude);
+
+		const float StandardTemperature = SeaLevelTemperature - TemperatureLapseRate * Altitude;
+		const float PressureRatio = FMath::Pow(StandardTemperature / SeaLevelTemperature, PressureExponent);
+
+		FHelicopterAtmosphereSample Sample {};
+		Sample.Temperature = FMath::Max(StandardTemperature + TemperatureOffset, 1.f);
+
+		const float TemperatureRatio = Sample.Temperature / SeaLevelTemperature;
+
+		Sample.DensityRatio = PressureRatio / TemperatureRatio;
+		// Usual turboshaft lapse, hot air and thin air both take power away
+		Sample.PowerRatio = PressureRatio / FMath::Sqrt(TemperatureRatio);
+		Sample.PowerLiftScale = FMath::Pow(FMath::Square(Sample.PowerRatio) * Sample.DensityRatio, 1.f / 3.f);
+
+		Samples.Add(Sample);
+	}
+}
+
+FHelicopterAtmosphereSample FHelicopterAtmosphereTable::GetSample(float Altitude) const
+{
+	if(!IsBaked())
+		return {};
+
+	const float Position = FMath::Clamp((Altitude - MinAltitude) * InvAltitudeStep, 0.f, Samples.Num() - 1.f);
+	const int32 Index = FMath::Min(FMath::FloorToInt32(Position), Samples.Num() - 2);
+	const float Alpha = Position - Index;
+
+	const FHelicopterAtmosphereSample& Lower = Samples[Index];
+	const FHelicopterAtmosphereSample& Upper = Samples[Index + 1];
+
+	FHelicopterAtmosphereSample Result {};
+	Result.Temperature = FMath::Lerp(Lower.Temperature, Upper.Temperature, Alpha);
+	Result.DensityRatio = FMath::Lerp(Lower.DensityRatio, Upper.DensityRatio, Alpha);
+	Result.PowerRatio = FMath::Lerp(Lower.PowerRatio, Upper.PowerRatio, Alpha);
+	Result.PowerLiftScale = FMath::Lerp(Lower.PowerLiftScale, Upper.PowerLiftScale, Alpha);
+
+	return Result;
+}
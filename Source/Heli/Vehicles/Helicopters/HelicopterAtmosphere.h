@@ -0,0 +1,53 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+
+// Air and engine conditions at one altitude, defaults are standard sea level
+struct FHelicopterAtmosphereSample
+{
+	// Kelvin
+	float Temperature { 288.15f };
+
+	// Air density relative to standard sea level, rotor thrust at the same collective scales with it
+	float DensityRatio { 1.f };
+
+	// Turbine power available relative to standard sea level
+	float PowerRatio { 1.f };
+
+	// Thrust the available power can hold relative to standard sea level, momentum theory gives (Power^2 * Density)^(1/3)
+	float PowerLiftScale { 1.f };
+};
+
+/**
+ * ISA troposphere and turbine power lapse baked into a table by altitude.
+ * Baking does all exp and pow work once, lookup is a lerp of two neighbour samples.
+ * Temperature offset shifts the whole day hotter or colder, pressure keeps the standard profile.
+ */
+struct HELI_API FHelicopterAtmosphereTable
+{
+	static constexpr float SeaLevelTemperature { 288.15f };
+	static constexpr float TemperatureLapseRate { 0.0065f };
+	// g * M / (R * L) of the standard atmosphere
+	static constexpr float PressureExponent { 5.25588f };
+	// Tropopause, air is isothermal above it and nothing in the game flies that high
+	static constexpr float MaxAltitude { 11000.f };
+	static constexpr float MinAltitude { -500.f };
+
+	// Temperature offset in Kelvin, altitude step in meters
+	void Bake(float InTemperatureOffset, float AltitudeStep = 50.f);
+
+	bool IsBaked() const { return Samples.Num() > 1; }
+
+	float GetTemperatureOffset() const { return TemperatureOffset; }
+
+	// Altitude above sea level in meters, clamped to the baked range
+	FHelicopterAtmosphereSample GetSample(float Altitude) const;
+
+private:
+
+	float TemperatureOffset { 0.f };
+
+	float InvAltitudeStep { 0.f };
+
+	TArray<FHelicopterAtmosphereSample> Samples {};
+};
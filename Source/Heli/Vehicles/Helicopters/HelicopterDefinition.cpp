@@ -0,0 +1,6 @@
+﻿#include "HelicopterDefinition.h"
+
+FPrimaryAssetId UHelicopterDefinition::GetPrimaryAssetId() const
+{
+	return FPrimaryAssetId(PrimaryAssetType, GetFName());
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Engine/DataAsset.h"
+#include "HelicopterFlightEnvelope.h"
+#include "HelicopterMovementComponent.h"
+#include "HelicopterDefinition.generated.h"
+
+/**
+ * Immutable tuning of one helicopter model.
+ * All helicopters of the model share the same asset, so keep per-instance state out of here.
+ * Curves are soft and get loaded with the "Flight" bundle by UHelicopterMovementComponent.
+ */
+UCLASS(BlueprintType)
+class HELI_API UHelicopterDefinition : public UPrimaryDataAsset
+{
+	GENERATED_BODY()
+
+public:
+
+	inline static const FPrimaryAssetType PrimaryAssetType { TEXT("HelicopterDefinition") };
+	inline static const FName FlightBundleName { TEXT("Flight") };
+
+	UPROPERTY(EditDefaultsOnly)
+	FPhysicsData PhysicsData {};
+
+	UPROPERTY(EditDefaultsOnly)
+	FCollectiveData CollectiveData {};
+
+	UPROPERTY(EditDefaultsOnly)
+	FRotationData RotationData {};
+
+	// Baked by UHelicopterEnvelopeCommandlet, rebake it after changing tuning
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	FHelicopterFlightEnvelope FlightEnvelope {};
+
+	virtual FPrimaryAssetId GetPrimaryAssetId() const override;
+
+};
@@ -0,0 +1,127 @@
+﻿#include "HelicopterFlightEnvelope.h"
+
+bool FHelicopterFlightEnvelope::IsValid() const
+{
+	return NumMassSteps > 0
+		&& NumPitchSteps > 0
+		&& HoverCollective.Num() == NumMassSteps
+		&& TrimCollective.Num() == NumMassSteps * NumPitchSteps;
+}
+
+float FHelicopterFlightEnvelope::GetHoverCollective(float MassKg) const
+{
+	if(HoverCollective.Num() != NumMassSteps || NumMassSteps == 0)
+		return -1.f;
+
+	int32 Row;
+	float Alpha;
+	GetMassRows(MassKg, Row, Alpha);
+
+	const float LowerCollective = HoverCollective[Row];
+	const float UpperCollective = HoverCollective[FMath::Min(Row + 1, NumMassSteps - 1)];
+
+	// Between a mass that hovers and one that doesn't there is no telling where hover ends
+	if(LowerCollective < 0.f || (UpperCollective < 0.f && Alpha > 0.f))
+		return -1.f;
+
+	return FMath::Lerp(LowerCollective, UpperCollective, Alpha);
+}
+
+float FHelicopterFlightEnvelope::GetMaxClimbRate(float MassKg) const
+{
+	return InterpolateMassTable(MaxClimbRate, MassKg);
+}
+
+float FHelicopterFlightEnvelope::GetMaxForwardSpeed(float MassKg) const
+{
+	return InterpolateMassTable(MaxForwardSpeed, MassKg);
+}
+
+bool FHelicopterFlightEnvelope::FindTrim(float MassKg, float ForwardSpeed, float& OutPitch, float& OutCollective) const
+{
+	if(!IsValid())
+		return false;
+
+	int32 Row;
+	float Alpha;
+	GetMassRows(MassKg, Row, Alpha);
+
+	float LowerPitch, LowerCollective;
+	if(!FindTrimInRow(Row, ForwardSpeed, LowerPitch, LowerCollective))
+		return false;
+
+	const int32 UpperRow = FMath::Min(Row + 1, NumMassSteps - 1);
+
+	float UpperPitch, UpperCollective;
+	if(UpperRow == Row || !FindTrimInRow(UpperRow, ForwardSpeed, UpperPitch, UpperCollective))
+	{
+		UpperPitch = LowerPitch;
+		UpperCollective = LowerCollective;
+	}
+
+	OutPitch = FMath::Lerp(LowerPitch, UpperPitch, Alpha);
+	OutCollective = FMath::Lerp(LowerCollective, UpperCollective, Alpha);
+
+	return true;
+}
+
+void FHelicopterFlightEnvelope::GetMassRows(float MassKg, int32& OutRow, float& OutAlpha) const
+{
+	const float Position = MassStepKg > 0.f
+		? FMath::Clamp((MassKg - MinMassKg) / MassStepKg, 0.f, static_cast<float>(NumMassSteps - 1))
+		: 0.f;
+
+	OutRow = FMath::Min(FMath::FloorToInt32(Position), NumMassSteps - 1);
+	OutAlpha = Position - OutRow;
+}
+
+float FHelicopterFlightEnvelope::InterpolateMassTable(const TArray<float>& Table, float MassKg) const
+{
+	if(Table.Num() != NumMassSteps || NumMassSteps == 0)
+		return 0.f;
+
+	int32 Row;
+	float Alpha;
+	GetMassRows(MassKg, Row, Alpha);
+
+	const int32 UpperRow = FMath::Min(Row + 1, NumMassSteps - 1);
+
+	return FMath::Lerp(Table[Row], Table[UpperRow], Alpha);
+}
+
+bool FHelicopterFlightEnvelope::FindTrimInRow(int32 Row, float ForwardSpeed, float& OutPitch, float& OutCollective) const
+{
+	const int32 RowStart = Row * NumPitchSteps;
+
+	// Pitch columns are short and speed grows with pitch while altitude can be kept, scan is enough
+	int32 PreviousColumn = INDEX_NONE;
+	
+	for(int32 Column = 0; Column < NumPitchSteps; ++Column)
+	{
+		const float Collective = TrimCollective[RowStart + Column];
+		if(Collective < 0.f)
+			break;
+
+		const float Speed = TrimForwardSpeed[RowStart + Column];
+		if(Speed >= ForwardSpeed)
+		{
+			if(PreviousColumn == INDEX_NONE)
+			{
+				OutPitch = Column * PitchStep;
+				OutCollective = Collective;
+				return true;
+			}
+
+			const float PreviousSpeed = TrimForwardSpeed[RowStart + PreviousColumn];
+			const float Alpha = Speed > PreviousSpeed ? (ForwardSpeed - PreviousSpeed) / (Speed - PreviousSpeed) : 0.f;
+
+			OutPitch = FMath::Lerp(PreviousColumn * PitchStep, Column * PitchStep, Alpha);
+			OutCollective = FMath::Lerp(TrimCollective[RowStart + PreviousColumn], Collective, Alpha);
+			return true;
+		}
+
+		PreviousColumn = Column;
+	}
+
+	return false;
+}
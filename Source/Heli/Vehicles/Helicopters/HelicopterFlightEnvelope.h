@@ -0,0 +1,71 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "HelicopterFlightEnvelope.generated.h"
+
+/**
+ * Steady flight states of a helicopter model baked by UHelicopterEnvelopeCommandlet.
+ * Rows are masses from MassKg to MassKg + MaxAdditionalMassKg, columns are forward pitch angles.
+ * Speeds are in cm/s, pitch in degrees, nose down is positive.
+ */
+USTRUCT(BlueprintType)
+struct HELI_API FHelicopterFlightEnvelope
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere)
+	float MinMassKg { 0.f };
+
+	UPROPERTY(VisibleAnywhere)
+	float MassStepKg { 0.f };
+
+	UPROPERTY(VisibleAnywhere)
+	int32 NumMassSteps { 0 };
+
+	UPROPERTY(VisibleAnywhere)
+	float PitchStep { 0.f };
+
+	UPROPERTY(VisibleAnywhere)
+	int32 NumPitchSteps { 0 };
+
+	// Per mass, collective needed to keep zero vertical speed while level. Negative if it can't hover at the mass
+	UPROPERTY(VisibleAnywhere)
+	TArray<float> HoverCollective {};
+
+	// Per mass, steady vertical speed on full collective while level
+	UPROPERTY(VisibleAnywhere)
+	TArray<float> MaxClimbRate {};
+
+	// Per mass, the fastest steady level flight among all pitches
+	UPROPERTY(VisibleAnywhere)
+	TArray<float> MaxForwardSpeed {};
+
+	// Per mass and pitch, collective that keeps altitude. Negative if altitude can't be kept at the pitch
+	UPROPERTY(VisibleAnywhere)
+	TArray<float> TrimCollective {};
+
+	// Per mass and pitch, steady forward speed while altitude is kept
+	UPROPERTY(VisibleAnywhere)
+	TArray<float> TrimForwardSpeed {};
+
+	bool IsValid() const;
+
+	// Negative if helicopter can't hover at the mass
+	float GetHoverCollective(float MassKg) const;
+
+	float GetMaxClimbRate(float MassKg) const;
+
+	float GetMaxForwardSpeed(float MassKg) const;
+
+	// Pitch and collective to keep altitude at the forward speed. Returns false if it's beyond the envelope
+	bool FindTrim(float MassKg, float ForwardSpeed, float& OutPitch, float& OutCollective) const;
+
+private:
+
+	// Index of the lower row and weight of the upper one
+	void GetMassRows(float MassKg, int32& OutRow, float& OutAlpha) const;
+
+	float InterpolateMassTable(const TArray<float>& Table, float MassKg) const;
+
+	bool FindTrimInRow(int32 Row, float ForwardSpeed, float& OutPitch, float& OutCollective) const;
+};
@@ -0,0 +1,294 @@
+﻿#include "HelicopterFlightModel.h"
+
+#include "Curves/CurveFloat.h"
+#include "Heli/BFLs/HeliConversionsLibrary.h"
+
+FHelicopterFlightModel::FHelicopterFlightModel(const FPhysicsData& InPhysicsData, const FHelicopterFlightCurves& InCurves,
+	const FHelicopterAtmosphereSample& InAtmosphere)
+	: PhysicsData(InPhysicsData)
+	, Curves(InCurves)
+	, Atmosphere(InAtmosphere)
+{
+}
+
+float FHelicopterFlightModel::CalculateAngleFromUp(const FVector& UpVector)
+{
+	const FVector WorldUpVector {0.f, 0.f ,1.f};
+
+	const float DotProduct = FMath::Clamp(WorldUpVector.Dot(UpVector), -1.f, 1.f);
+	
+	return FMath::RadiansToDegrees(FMath::Acos(DotProduct));
+}
+
+FVector FHelicopterFlightModel::GetUpVectorForPitch(float PitchDegrees)
+{
+	const float PitchRadians = FMath::DegreesToRadians(PitchDegrees);
+	
+	return { FMath::Sin(PitchRadians), 0.f, FMath::Cos(PitchRadians) };
+}
+
+float FHelicopterFlightModel::CalculateLiftForce(float Collective) const
+{
+	// Get collective lift force scale from curve
+	// or if there is no curve, use collective as a scale itself
+	
+	const float LiftForceScale = Curves.LiftForceScaleFromCollectiveCurve
+		? Curves.LiftForceScaleFromCollectiveCurve->GetFloatValue(Collective)
+		: Collective;
+
+	// Rotor gives less thrust in thin air at the same collective
+	const float DensityLiftScale = LiftForceScale * Atmosphere.DensityRatio;
+
+	// And it can't give more than engine has power for
+	const float PowerLiftScale = PhysicsData.EngineLiftMargin > 0.f
+		? PhysicsData.EngineLiftMargin * Atmosphere.PowerLiftScale
+		: DensityLiftScale;
+
+	return PhysicsData.LiftForceFromMaxCollective * FMath::Min(DensityLiftScale, PowerLiftScale);
+}
+
+FVector FHelicopterFlightModel::CalculateCollectiveAcceleration(const FVector& UpVector, float Collective,
+	float MassKg) const
+{
+	const float Acceleration = UHeliConversionsLibrary::MsToCms(CalculateLiftForce(Collective) / MassKg);
+	
+	FVector FinalAcceleration = UpVector * Acceleration;
+	
+	float LiftScaleFromRotation = Curves.LiftScaleFromRotationCurve
+		? Curves.LiftScaleFromRotationCurve->GetFloatValue(CalculateAngleFromUp(UpVector))
+		: 1.f;
+	LiftScaleFromRotation = FMath::Clamp(LiftScaleFromRotation, 0.f, 1.f);
+
+	// Do not scale lift when going to the ground
+	FinalAcceleration.Z = FMath::Min(FinalAcceleration.Z, FinalAcceleration.Z * LiftScaleFromRotation);
+	
+	return FinalAcceleration;
+}
+
+FVector FHelicopterFlightModel::ApplyAirFriction(const FVector& Velocity, float DeltaTime) const
+{
+	FVector Result = Velocity;
+	
+	// We use raw accelerations since air friction doesn't depend on helicopter mass
+	// and we don't want to make all of these too complicated
+	
+	// Apply horizontal air friction
+	// Note: Horizontal Speed is always positive
+	const float HorizontalSpeed = UHeliConversionsLibrary::CmsToKmh(Result.Size2D());
+	const float HorizontalAirFrictionDeceleration = Curves.HorizontalAirFrictionDecelerationToVelocityCurve
+		? UHeliConversionsLibrary::KmhToCms(
+			Curves.HorizontalAirFrictionDecelerationToVelocityCurve->GetFloatValue(HorizontalSpeed)
+		)
+		: 0.f;
+	
+	Result += -Result.GetSafeNormal2D() * HorizontalAirFrictionDeceleration * DeltaTime;
+
+	// Apply vertical air friction
+	// Note: Vertical Speed may be negative (in case of falling)
+	const float VerticalSpeed = UHeliConversionsLibrary::CmsToKmh(Result.Z);
+	const float VerticalAirFrictionDeceleration = Curves.VerticalAirFrictionDecelerationToVelocityCurve
+		? UHeliConversionsLibrary::KmhToCms(
+			Curves.VerticalAirFrictionDecelerationToVelocityCurve->GetFloatValue(VerticalSpeed)
+		)
+		: 0.f;
+
+	Result.Z += -FMath::Sign(Result.Z) * VerticalAirFrictionDeceleration * DeltaTime;
+
+	return Result;
+}
+
+FVector FHelicopterFlightModel::CalculateAirFrictionAcceleration(const FVector& Velocity, float DeltaTime) const
+{
+	FVector Result = FVector::ZeroVector;
+
+	const float HorizontalSpeed = Velocity.Size2D();
+	if(Curves.HorizontalAirFrictionDecelerationToVelocityCurve && HorizontalSpeed > UE_KINDA_SMALL_NUMBER)
+	{
+		const float Deceleration = UHeliConversionsLibrary::KmhToCms(
+			Curves.HorizontalAirFrictionDecelerationToVelocityCurve->GetFloatValue(UHeliConversionsLibrary::CmsToKmh(HorizontalSpeed))
+		);
+		const float StoppingDeceleration = HorizontalSpeed / DeltaTime;
+
+		Result = -Velocity.GetSafeNormal2D() * FMath::Min(Deceleration, StoppingDeceleration);
+	}
+
+	if(Curves.VerticalAirFrictionDecelerationToVelocityCurve && !FMath::IsNearlyZero(Velocity.Z))
+	{
+		const float Deceleration = UHeliConversionsLibrary::KmhToCms(
+			Curves.VerticalAirFrictionDecelerationToVelocityCurve->GetFloatValue(UHeliConversionsLibrary::CmsToKmh(Velocity.Z))
+		);
+		const float StoppingDeceleration = FMath::Abs(Velocity.Z) / DeltaTime;
+
+		Result.Z = -FMath::Sign(Velocity.Z) * FMath::Min(Deceleration, StoppingDeceleration);
+	}
+
+	return Result;
+}
+
+float FHelicopterFlightModel::DecelerateTowardsZero(float Value, float Deceleration, float DeltaTime)
+{
+	const float Decrement = FMath::Max(Deceleration, 0.f) * DeltaTime;
+
+	return Value > 0.f
+		? FMath::Max(Value - Decrement, 0.f)
+		: FMath::Min(Value + Decrement, 0.f);
+}
+
+FVector FHelicopterFlightModel::ClampVelocityToMaxSpeed(const FVector& Velocity) const
+{
+	const float AverageMaxSpeed = PhysicsData.MaxSpeed * PhysicsData.AverageMaxSpeedScale;
+
+	FVector Result = Velocity;
+	
+	// Allow helicopter to fall faster then anything
+	Result.Z = FMath::Clamp(Result.Z, -PhysicsData.MaxSpeed, AverageMaxSpeed);
+	
+	// Limit horizontal velocity
+	const FVector ClampedHorizontal = Result.GetClampedToMaxSize2D(AverageMaxSpeed);
+	Result.X = ClampedHorizontal.X;
+	Result.Y = ClampedHorizontal.Y;
+
+	return Result;
+}
+
+FVector FHelicopterFlightModel::StepVelocity(const FVector& Velocity, const FVector& UpVector, float Collective,
+	float MassKg, float DeltaTime) const
+{
+	if(DeltaTime <= 0.f)
+		return Velocity;
+	
+	const FVector CollectiveAcceleration = CalculateCollectiveAcceleration(UpVector, Collective, MassKg);
+	const FVector GravityAcceleration { 0.f, 0.f, PhysicsData.GravityZAcceleration };
+
+	// Lift and gravity don't depend on velocity, only friction does
+	const FVector ForceAcceleration = CollectiveAcceleration + GravityAcceleration;
+
+	switch(PhysicsData.Integrator)
+	{
+	case EHelicopterIntegrator::SemiImplicit:
+		return StepVelocitySemiImplicit(Velocity, ForceAcceleration, DeltaTime);
+	case EHelicopterIntegrator::RungeKutta4:
+		return StepVelocityRungeKutta4(Velocity, ForceAcceleration, DeltaTime);
+	default:
+		return StepVelocityExplicitEuler(Velocity, ForceAcceleration, DeltaTime);
+	}
+}
+
+FVector FHelicopterFlightModel::StepLocalAngularVelocity(const FVector& LocalAngularVelocity, const FVector& RotationInput,
+	const FRotationData& RotationData, float WeightOnWheels, float HorizontalSpeed, float DeltaTime) const
+{
+	// Skids on the ground resist tilting, yaw is still free to turn on the pad
+	const float PitchRollScale = FMath::Lerp(1.f, RotationData.LandedPitchRollScale, WeightOnWheels);
+
+	const FVector Delta {
+		RotationInput.X * RotationData.RollAcceleration * PitchRollScale * DeltaTime,
+		RotationInput.Y * RotationData.PitchAcceleration * PitchRollScale * DeltaTime,
+		RotationInput.Z * RotationData.YawAcceleration * DeltaTime
+	};
+
+	FVector AngularVelocity = LocalAngularVelocity;
+
+	// Do not apply deceleration if we rotated
+	// It allows to rotate even with low (0.1) intensity
+	if(!Delta.IsNearlyZero())
+	{
+		AngularVelocity += Delta;
+	}
+	else
+	{
+		// Damping stops rotation exactly at zero, so it doesn't swing around it at low tick rates
+		AngularVelocity.X = DecelerateTowardsZero(AngularVelocity.X, RotationData.RollDeceleration, DeltaTime);
+		AngularVelocity.Y = DecelerateTowardsZero(AngularVelocity.Y, RotationData.PitchDeceleration, DeltaTime);
+		AngularVelocity.Z = DecelerateTowardsZero(AngularVelocity.Z, RotationData.YawDeceleration, DeltaTime);
+	}
+
+	const float YawMaxSpeedScale = Curves.YawMaxSpeedScaleFromVelocityCurve
+		? Curves.YawMaxSpeedScaleFromVelocityCurve->GetFloatValue(UHeliConversionsLibrary::CmsToKmh(HorizontalSpeed))
+		: 1.f;
+	const float ScaledYawMaxSpeed = RotationData.YawMaxSpeed * YawMaxSpeedScale;
+
+	AngularVelocity.X = FMath::Clamp(AngularVelocity.X, -RotationData.RollMaxSpeed, RotationData.RollMaxSpeed);
+	AngularVelocity.Y = FMath::Clamp(AngularVelocity.Y, -RotationData.PitchMaxSpeed, RotationData.PitchMaxSpeed);
+	AngularVelocity.Z = FMath::Clamp(AngularVelocity.Z, -ScaledYawMaxSpeed, ScaledYawMaxSpeed);
+
+	return AngularVelocity;
+}
+
+FVector FHelicopterFlightModel::StepVelocityExplicitEuler(const FVector& Velocity, const FVector& ForceAcceleration,
+	float DeltaTime) const
+{
+	FVector Result = Velocity + ForceAcceleration * DeltaTime;
+	
+	Result = ClampVelocityToMaxSpeed(Result);
+
+	return ApplyAirFriction(Result, DeltaTime);
+}
+
+FVector FHelicopterFlightModel::StepVelocitySemiImplicit(const FVector& Velocity, const FVector& ForceAcceleration,
+	float DeltaTime) const
+{
+	FVector Result = ClampVelocityToMaxSpeed(Velocity + ForceAcceleration * DeltaTime);
+
+	// Friction of the velocity we end up with, not the one we started from, and it can only stop helicopter
+	return Result + CalculateAirFrictionAcceleration(Result, DeltaTime) * DeltaTime;
+}
+
+FVector FHelicopterFlightModel::StepVelocityRungeKutta4(const FVector& Velocity, const FVector& ForceAcceleration,
+	float DeltaTime) const
+{
+	const float HalfDeltaTime = DeltaTime * 0.5f;
+
+	// Friction of every stage is limited by the stage length, so none of them overshoots zero
+	const FVector K1 = ForceAcceleration + CalculateAirFrictionAcceleration(Velocity, DeltaTime);
+	const FVector K2 = ForceAcceleration + CalculateAirFrictionAcceleration(Velocity + K1 * HalfDeltaTime, HalfDeltaTime);
+	const FVector K3 = ForceAcceleration + CalculateAirFrictionAcceleration(Velocity + K2 * HalfDeltaTime, HalfDeltaTime);
+	const FVector K4 = ForceAcceleration + CalculateAirFrictionAcceleration(Velocity + K3 * DeltaTime, DeltaTime);
+
+	const FVector Result = Velocity + (K1 + 2.f * K2 + 2.f * K3 + K4) * (DeltaTime / 6.f);
+
+	return ClampVelocityToMaxSpeed(Result);
+}
+
+FVector FHelicopterFlightModel::SolveSteadyVelocity(const FVector& UpVector, float Collective, float MassKg,
+	float DeltaTime, float MaxTime) const
+{
+	const int32 NumSteps = FMath::CeilToInt32(MaxTime / DeltaTime);
+	const int32 NumAveragedSteps = FMath::Clamp(FMath::CeilToInt32(1.f / DeltaTime), 1, NumSteps);
+
+	FVector Velocity = FVector::ZeroVector;
+	FVector AveragedVelocity = FVector::ZeroVector;
+
+	for(int32 Step = 0; Step < NumSteps; ++Step)
+	{
+		Velocity = StepVelocity(Velocity, UpVector, Collective, MassKg, DeltaTime);
+
+		if(Step >= NumSteps - NumAveragedSteps)
+			AveragedVelocity += Velocity;
+	}
+
+	return AveragedVelocity / NumAveragedSteps;
+}
+
+float FHelicopterFlightModel::SolveLevelCollective(const FVector& UpVector, float MassKg) const
+{
+	if(SolveSteadyVelocity(UpVector, 1.f, MassKg).Z < 0.f)
+		return -1.f;
+
+	if(SolveSteadyVelocity(UpVector, 0.f, MassKg).Z >= 0.f)
+		return 0.f;
+
+	float Low = 0.f;
+	float High = 1.f;
+
+	for(int32 Iteration = 0; Iteration < 20; ++Iteration)
+	{
+		const float Middle = (Low + High) * 0.5f;
+		
+		if(SolveSteadyVelocity(UpVector, Middle, MassKg).Z < 0.f)
+			Low = Middle;
+		else
+			High = Middle;
+	}
+
+	return High;
+}
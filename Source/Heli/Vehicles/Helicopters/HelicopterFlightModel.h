@@ -0,0 +1,89 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "HelicopterAtmosphere.h"
+#include "HelicopterMovementComponent.h"
+
+/**
+ * Flight equations of the helicopter without any dependency on the world or physics scene.
+ * UHelicopterMovementComponent feeds Chaos with them, offline tools run them directly.
+ * Air is taken at a single altitude for the whole step, standard sea level unless told otherwise.
+ * All velocities are in cm/s, accelerations in cm/s^2.
+ */
+struct HELI_API FHelicopterFlightModel
+{
+	FHelicopterFlightModel(
+		const FPhysicsData& InPhysicsData,
+		const FHelicopterFlightCurves& InCurves,
+		const FHelicopterAtmosphereSample& InAtmosphere = {}
+	);
+
+	// Angle between world up and helicopter up in degrees
+	static float CalculateAngleFromUp(const FVector& UpVector);
+
+	// Up vector of helicopter pitched nose down by the angle, forward is X
+	static FVector GetUpVectorForPitch(float PitchDegrees);
+
+	// Collective lift scaled by air density and capped by engine power
+	float CalculateLiftForce(float Collective) const;
+
+	// Acceleration along helicopter up vector with lift reduced by helicopter angle
+	FVector CalculateCollectiveAcceleration(const FVector& UpVector, float Collective, float MassKg) const;
+
+	FVector ApplyAirFriction(const FVector& Velocity, float DeltaTime) const;
+
+	// Air friction deceleration limited to what stops the velocity within DeltaTime, so it never flips its sign
+	FVector CalculateAirFrictionAcceleration(const FVector& Velocity, float DeltaTime) const;
+
+	// Constant deceleration over the step solved exactly, value stops at zero instead of crossing it
+	static float DecelerateTowardsZero(float Value, float Deceleration, float DeltaTime);
+
+	FVector ClampVelocityToMaxSpeed(const FVector& Velocity) const;
+
+	// Whole linear velocity update of a single tick with the integrator of physics data
+	FVector StepVelocity(
+		const FVector& Velocity,
+		const FVector& UpVector,
+		float Collective,
+		float MassKg,
+		float DeltaTime
+	) const;
+
+	// Whole angular velocity update of a single tick in helicopter space, deg/s with roll in X, pitch in Y and yaw in Z.
+	// Input in the same order accelerates rotation, without input rotation is damped. Result is clamped to max speeds
+	FVector StepLocalAngularVelocity(
+		const FVector& LocalAngularVelocity,
+		const FVector& RotationInput,
+		const FRotationData& RotationData,
+		float WeightOnWheels,
+		float HorizontalSpeed,
+		float DeltaTime
+	) const;
+
+	// Runs the model with fixed inputs from rest and returns velocity it settles at.
+	// Velocity is averaged over the last second, so it doesn't depend on friction jitter around zero
+	FVector SolveSteadyVelocity(
+		const FVector& UpVector,
+		float Collective,
+		float MassKg,
+		float DeltaTime = 1.f / 30.f,
+		float MaxTime = 120.f
+	) const;
+
+	// Collective that keeps steady vertical speed at zero, negative if even full collective isn't enough
+	float SolveLevelCollective(const FVector& UpVector, float MassKg) const;
+
+	const FPhysicsData& PhysicsData;
+
+	const FHelicopterFlightCurves& Curves;
+
+	const FHelicopterAtmosphereSample Atmosphere;
+
+private:
+
+	FVector StepVelocityExplicitEuler(const FVector& Velocity, const FVector& ForceAcceleration, float DeltaTime) const;
+
+	FVector StepVelocitySemiImplicit(const FVector& Velocity, const FVector& ForceAcceleration, float DeltaTime) const;
+
+	FVector StepVelocityRungeKutta4(const FVector& Velocity, const FVector& ForceAcceleration, float DeltaTime) const;
+};
@@ -0,0 +1,254 @@
+﻿#include "HelicopterLandingGearComponent.h"
+
+#include "Helicopter.h"
+#include "HelicopterMovementComponent.h"
+#include "Engine/World.h"
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+
+DECLARE_CYCLE_STAT(TEXT("Landing Gear"), STAT_HeliLandingGear, STATGROUP_Heli);
+
+namespace HelicopterLandingGear
+{
+	// Skids of generated points, relative to half of the body length and width
+	constexpr float SkidLengthShare { 0.33f };
+	constexpr float SkidWidthShare { 0.75f };
+
+	// Generated points are attached this high above the bottom of the body and reach a bit below it
+	constexpr float AttachHeight { 50.f };
+	constexpr float RestLength { 80.f };
+}
+
+UHelicopterLandingGearComponent::UHelicopterLandingGearComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.TickGroup = TG_PrePhysics;
+}
+
+void UHelicopterLandingGearComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	const AHelicopter* Helicopter = Cast<AHelicopter>(GetOwner());
+	HelicopterMovementComponent = Helicopter ? Helicopter->GetHelicopterMovementComponent() : nullptr;
+
+	if(!HelicopterMovementComponent)
+	{
+		HELI_ERR("Landing gear of %s has no helicopter movement to support", *GetNameSafe(GetOwner()));
+		SetComponentTickEnabled(false);
+		return;
+	}
+
+	// Weight on wheels has to be known before movement component uses it
+	HelicopterMovementComponent->PrimaryComponentTick.AddPrerequisite(this, PrimaryComponentTick);
+
+	if(SkidPoints.IsEmpty() && HelicopterMovementComponent->UpdatedPrimitive)
+		MakeSkidPointsFromBounds(*HelicopterMovementComponent->UpdatedPrimitive);
+
+	Contacts.SetNum(SkidPoints.Num());
+
+	ProbeQueryParams = FCollisionQueryParams(SCENE_QUERY_STAT(HelicopterLandingGear), false, GetOwner());
+
+	MaxSkidReach = 0.f;
+	for(const FHelicopterSkidPoint& SkidPoint : SkidPoints)
+	{
+		MaxSkidReach = FMath::Max(MaxSkidReach, SkidPoint.RestLength - SkidPoint.Offset.Z);
+	}
+}
+
+void UHelicopterLandingGearComponent::TickComponent(float DeltaTime, ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	SCOPE_CYCLE_COUNTER(STAT_HeliLandingGear);
+
+	if(!HelicopterMovementComponent || !HelicopterMovementComponent->UpdatedPrimitive || DeltaTime <= 0.f)
+		return;
+
+	// Altitude is already traced by movement component, don't probe while nothing can be reached
+	if(HelicopterMovementComponent->GetCurrentAltitude() > MaxSkidReach + ProbeAltitudeMargin)
+	{
+		ResetContacts();
+		return;
+	}
+
+	if(!ProbeSkids())
+	{
+		SetWeightOnWheels(0.f);
+		return;
+	}
+
+	ApplySuspensionForces(DeltaTime);
+}
+
+void UHelicopterLandingGearComponent::MakeSkidPointsFromBounds(const UPrimitiveComponent& Body)
+{
+	using namespace HelicopterLandingGear;
+
+	const FBox Bounds = Body.CalcLocalBounds().GetBox();
+	const FVector Center = Bounds.GetCenter();
+	const FVector Extent = Bounds.GetExtent();
+
+	for(const float SideX : { 1.f, -1.f })
+	{
+		for(const float SideY : { 1.f, -1.f })
+		{
+			const FVector Offset {
+				Center.X + SideX * SkidLengthShare * Extent.X,
+				Center.Y + SideY * SkidWidthShare * Extent.Y,
+				Bounds.Min.Z + AttachHeight
+			};
+
+			SkidPoints.Add({ Offset, RestLength });
+		}
+	}
+}
+
+bool UHelicopterLandingGearComponent::ProbeSkids()
+{
+	const UWorld* World = GetWorld();
+	if(!World)
+		return false;
+
+	const FTransform BodyTransform = HelicopterMovementComponent->UpdatedPrimitive->GetComponentTransform();
+	const FVector Down = -BodyTransform.GetUnitAxis(EAxis::Z);
+
+	NumContacts = 0;
+
+	TArray<FVector, TInlineAllocator<8>> Starts {};
+	FBox ProbeBounds { ForceInit };
+
+	for(const FHelicopterSkidPoint& SkidPoint : SkidPoints)
+	{
+		const FVector& Start = Starts.Add_GetRef(BodyTransform.TransformPosition(SkidPoint.Offset));
+
+		ProbeBounds += Start;
+		ProbeBounds += Start + Down * SkidPoint.RestLength;
+	}
+
+	// A single scene query for all skids, usually it finds the ground and nothing else
+	ProbeOverlaps.Reset();
+	World->OverlapMultiByChannel(
+		ProbeOverlaps,
+		ProbeBounds.GetCenter(),
+		FQuat::Identity,
+		ProbeChannel,
+		FCollisionShape::MakeBox(ProbeBounds.GetExtent()),
+		ProbeQueryParams
+	);
+
+	for(int32 Index = 0; Index < SkidPoints.Num(); ++Index)
+	{
+		const FHelicopterSkidPoint& SkidPoint = SkidPoints[Index];
+		FSkidContact& Contact = Contacts[Index];
+
+		const FVector& Start = Starts[Index];
+		const FVector End = Start + Down * SkidPoint.RestLength;
+
+		Contact.bHasContact = false;
+		float HitTime = 1.f;
+
+		// Nearest blocking hit among the components found, like a trace by channel would return
+		for(const FOverlapResult& Overlap : ProbeOverlaps)
+		{
+			UPrimitiveComponent* Component = Overlap.GetComponent();
+			if(!Overlap.bBlockingHit || !Component)
+				continue;
+
+			FHitResult Hit {};
+			if(!Component->LineTraceComponent(Hit, Start, End, ProbeQueryParams) || Hit.Time >= HitTime)
+				continue;
+
+			HitTime = Hit.Time;
+
+			// Force is applied where suspension is attached, applying it on the ground point makes body wobble
+			Contact.Location = Start;
+			Contact.Normal = Hit.ImpactNormal;
+			Contact.Compression = SkidPoint.RestLength * (1.f - Hit.Time);
+			Contact.bHasContact = true;
+		}
+
+		if(Contact.bHasContact)
+			++NumContacts;
+	}
+
+	return NumContacts > 0;
+}
+
+void UHelicopterLandingGearComponent::ApplySuspensionForces(float DeltaTime)
+{
+	UPrimitiveComponent* Body = HelicopterMovementComponent->UpdatedPrimitive;
+
+	// Every skid carries an equal share, so the helicopter settles with the same compression whatever it carries
+	const float MassPerSkid = HelicopterMovementComponent->GetActualMass() / SkidPoints.Num();
+	const float AngularFrequency = 2.f * PI * SpringFrequencyHz;
+	const float Stiffness = MassPerSkid * FMath::Square(AngularFrequency);
+	const float Damping = 2.f * DampingRatio * MassPerSkid * AngularFrequency;
+
+	float SupportForce = 0.f;
+
+	for(const FSkidContact& Contact : Contacts)
+	{
+		if(!Contact.bHasContact)
+			continue;
+
+		const FVector PointVelocity = Body->GetPhysicsLinearVelocityAtPoint(Contact.Location);
+		const float NormalSpeed = PointVelocity | Contact.Normal;
+
+		// Ground only pushes, it never pulls the helicopter down
+		const float NormalForce = FMath::Max(Stiffness * Contact.Compression - Damping * NormalSpeed, 0.f);
+
+		// Friction can't be stronger than what stops the skid in a single step, otherwise it would push it back
+		const FVector TangentVelocity = PointVelocity - NormalSpeed * Contact.Normal;
+		const float TangentSpeed = TangentVelocity.Size();
+		const float FrictionForce = FMath::Min(FrictionCoefficient * NormalForce, MassPerSkid * TangentSpeed / DeltaTime);
+
+		FVector Force = Contact.Normal * NormalForce;
+		if(TangentSpeed > UE_KINDA_SMALL_NUMBER)
+			Force -= TangentVelocity / TangentSpeed * FrictionForce;
+
+		Body->AddForceAtLocation(Force, Contact.Location);
+
+		SupportForce += NormalForce * Contact.Normal.Z;
+	}
+
+	const float Weight = HelicopterMovementComponent->GetActualMass() * FMath::Abs(HelicopterMovementComponent->GetGravityZ());
+
+	SetWeightOnWheels(Weight > 0.f ? SupportForce / Weight : 0.f);
+}
+
+void UHelicopterLandingGearComponent::SetWeightOnWheels(float NewWeightOnWheels)
+{
+	WeightOnWheels = FMath::Clamp(NewWeightOnWheels, 0.f, 1.f);
+
+	HelicopterMovementComponent->SetWeightOnWheels(WeightOnWheels);
+}
+
+float UHelicopterLandingGearComponent::GetWeightOnWheels() const
+{
+	return WeightOnWheels;
+}
+
+bool UHelicopterLandingGearComponent::IsWeightOnWheels() const
+{
+	return WeightOnWheels >= WeightOnWheelsThreshold;
+}
+
+int32 UHelicopterLandingGearComponent::GetNumContacts() const
+{
+	return NumContacts;
+}
+
+void UHelicopterLandingGearComponent::ResetContacts()
+{
+	for(FSkidContact& Contact : Contacts)
+	{
+		Contact.bHasContact = false;
+	}
+
+	NumContacts = 0;
+
+	if(HelicopterMovementComponent)
+		SetWeightOnWheels(0.f);
+}
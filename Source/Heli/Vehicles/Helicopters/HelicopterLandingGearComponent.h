@@ -0,0 +1,123 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "WorldCollision.h"
+#include "HelicopterLandingGearComponent.generated.h"
+
+class UHelicopterMovementComponent;
+
+USTRUCT(BlueprintType)
+struct FHelicopterSkidPoint
+{
+	GENERATED_BODY()
+
+	// Where suspension is attached, relative to the simulated root of helicopter
+	UPROPERTY(EditAnywhere)
+	FVector Offset { FVector::ZeroVector };
+
+	// Suspension length when it's not loaded, probe goes down this far
+	UPROPERTY(EditAnywhere, meta=(ClampMin=1.0))
+	float RestLength { 80.f };
+};
+
+/**
+ * Holds helicopter on the ground with a spring-damper per skid point instead of physics contacts.
+ * Each skid is resolved by one short probe along helicopter down axis, once per tick and only when helicopter
+ * is close enough to the ground to touch it. One overlap around all probes finds what they can hit,
+ * probes then trace only those components instead of the whole scene each.
+ * Spring stiffness is derived from helicopter mass, so cargo doesn't make it sink or bounce.
+ */
+UCLASS(
+	ClassGroup=(Custom),
+	meta=(BlueprintSpawnableComponent),
+	HideCategories=(ComponentReplication, Replication, ComponentTick, Activation)
+)
+class HELI_API UHelicopterLandingGearComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	UHelicopterLandingGearComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Share of helicopter weight carried by skids, 0 in the air and 1 when it stands on the ground
+	UFUNCTION(BlueprintCallable)
+	float GetWeightOnWheels() const;
+
+	UFUNCTION(BlueprintCallable)
+	bool IsWeightOnWheels() const;
+
+	UFUNCTION(BlueprintCallable)
+	int32 GetNumContacts() const;
+
+	UFUNCTION(BlueprintCallable)
+	void ResetContacts();
+
+protected:
+
+	// Empty puts four skids under the bounds of the simulated root, physics proxy or bodies of the mesh
+	UPROPERTY(EditAnywhere)
+	TArray<FHelicopterSkidPoint> SkidPoints {};
+
+	// Natural frequency of helicopter bouncing on suspension
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.1))
+	float SpringFrequencyHz { 1.5f };
+
+	// 1 is critical damping, less bounces and more is sluggish
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float DampingRatio { 0.7f };
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float FrictionCoefficient { 0.8f };
+
+	// Above this weight share helicopter counts as landed
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0, ClampMax=1.0))
+	float WeightOnWheelsThreshold { 0.5f };
+
+	// Probes are skipped while helicopter altitude is higher than the longest skid plus this margin
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float ProbeAltitudeMargin { 500.f };
+
+	UPROPERTY(EditAnywhere)
+	TEnumAsByte<ECollisionChannel> ProbeChannel { ECC_Visibility };
+
+	virtual void BeginPlay() override;
+
+private:
+
+	struct FSkidContact
+	{
+		FVector Location { FVector::ZeroVector };
+		FVector Normal { FVector::UpVector };
+		float Compression { 0.f };
+		bool bHasContact { false };
+	};
+
+	UPROPERTY(Transient)
+	TObjectPtr<UHelicopterMovementComponent> HelicopterMovementComponent {};
+
+	TArray<FSkidContact> Contacts {};
+
+	// Kept between ticks to keep its allocation
+	TArray<FOverlapResult> ProbeOverlaps {};
+
+	FCollisionQueryParams ProbeQueryParams {};
+
+	float MaxSkidReach { 0.f };
+
+	float WeightOnWheels { 0.f };
+
+	int32 NumContacts { 0 };
+
+	void MakeSkidPointsFromBounds(const UPrimitiveComponent& Body);
+
+	bool ProbeSkids();
+
+	void ApplySuspensionForces(float DeltaTime);
+
+	void SetWeightOnWheels(float NewWeightOnWheels);
+
+};
@@ -5,9 +5,24 @@
 #include "EditorDialogLibrary.h"
 #endif
 
+#include "Helicopter.h"
+#include "HelicopterDefinition.h"
+#include "HelicopterFlightModel.h"
+#include "HelicopterPhysicsStepCallback.h"
+#include "Engine/AssetManager.h"
+#include "Heli/HeliStats.h"
 #include "Heli/LogHeli.h"
+#include "Heli/Subsystems/HelicopterAtmosphereSubsystem.h"
+#include "Heli/Subsystems/HelicopterLockstepSubsystem.h"
+#include "Heli/Subsystems/HelicopterSchedulerSubsystem.h"
+#include "Heli/Subsystems/HelicopterSpatialHashSubsystem.h"
+#include "Heli/Subsystems/HelicopterTimeCompressionSubsystem.h"
+#include "Heli/UI/HelicopterTelemetryViewModel.h"
 #include "Kismet/KismetMathLibrary.h"
 
+DECLARE_CYCLE_STAT(TEXT("Movement Step"), STAT_HeliMovementStep, STATGROUP_Heli);
+DECLARE_CYCLE_STAT(TEXT("Telemetry"), STAT_HeliTelemetry, STATGROUP_Heli);
+
 UHelicopterMovementComponent::UHelicopterMovementComponent()
 {
 	PrimaryComponentTick.bCanEverTick = true;
@@ -25,17 +40,79 @@ UHelicopterMovementComponent::UHelicopterMovementComponent()
 void UHelicopterMovementComponent::BeginPlay()
 {
 	Super::BeginPlay();
+
+	SetTrackedInSpatialHash(true);
+
+	if(UHelicopterLockstepSubsystem* Lockstep = GetWorld()->GetSubsystem<UHelicopterLockstepSubsystem>())
+		Lockstep->RegisterHelicopter(this);
+
+	if(UHelicopterTimeCompressionSubsystem* TimeCompression = GetWorld()->GetSubsystem<UHelicopterTimeCompressionSubsystem>())
+		TimeCompression->RegisterHelicopter(this);
+
+	// Lockstep steps must trace the same ground on every machine, only free running helicopters defer traces
+	UHelicopterSchedulerSubsystem* Scheduler = GetWorld()->GetSubsystem<UHelicopterSchedulerSubsystem>();
+	if(Scheduler && !bDrivenByLockstep)
+	{
+		AltitudeJobHandle = Scheduler->RegisterJob(GetOwner(), AltitudeMaxStaleness, [this](float)
+		{
+			UpdateTracedAltitude();
+		});
+	}
+
+	// View model only feeds UI, so it may lag behind even for lockstep helicopters
+	if(Scheduler)
+	{
+		TelemetryJobHandle = Scheduler->RegisterJob(GetOwner(), TelemetryViewModelMaxStaleness, [this](float)
+		{
+			if(TelemetryViewModel)
+				TelemetryViewModel->SetTelemetry(Telemetry);
+		});
+	}
+}
+
+void UHelicopterMovementComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	SetTrackedInSpatialHash(false);
+
+	if(UHelicopterLockstepSubsystem* Lockstep = GetWorld()->GetSubsystem<UHelicopterLockstepSubsystem>())
+		Lockstep->UnregisterHelicopter(this);
+
+	if(UHelicopterTimeCompressionSubsystem* TimeCompression = GetWorld()->GetSubsystem<UHelicopterTimeCompressionSubsystem>())
+		TimeCompression->UnregisterHelicopter(this);
+
+	if(UHelicopterSchedulerSubsystem* Scheduler = GetWorld()->GetSubsystem<UHelicopterSchedulerSubsystem>())
+	{
+		Scheduler->UnregisterJob(AltitudeJobHandle);
+		Scheduler->UnregisterJob(TelemetryJobHandle);
+	}
+
+	AltitudeJobHandle = INDEX_NONE;
+	TelemetryJobHandle = INDEX_NONE;
+	
+	Super::EndPlay(EndPlayReason);
 }
 
 void UHelicopterMovementComponent::CalculateForceNeededToStartGoingUp() const
 {
 	// Do not include code that depends on editor-only modules for game builds
 #if WITH_EDITOR
-	const float ActualMass = GetActualMass();
+	const FPhysicsData* Data = &PhysicsData;
+
+	// Definition is not loaded outside of the game, load it here since it's an editor-only utility
+	if(HelicopterDefinitionId.IsValid() && UAssetManager::IsInitialized())
+	{
+		const FSoftObjectPath DefinitionPath = UAssetManager::Get().GetPrimaryAssetPath(HelicopterDefinitionId);
+		if(const UHelicopterDefinition* Definition = Cast<UHelicopterDefinition>(DefinitionPath.TryLoad()))
+		{
+			Data = &Definition->PhysicsData;
+		}
+	}
+	
+	const float ActualMass = Data->MassKg + MovementState.AdditionalMassKg;
 
 	const float GravityZ = UHeliConversionsLibrary::CmsToMs(GetGravityZ());
 	const float ForceNeeded = UHeliConversionsLibrary::AccelMsAndMassToForce(-GravityZ + 1.f, ActualMass);
-	const float Percent = ForceNeeded / PhysicsData.LiftForceFromMaxCollective * 100.f;
+	const float Percent = ForceNeeded / Data->LiftForceFromMaxCollective * 100.f;
 
 	const FString Result = FString::Printf(
 	TEXT("For an actual mass %fkg, you need to apply a force %fN to start going up."
@@ -43,7 +120,7 @@ void UHelicopterMovementComponent::CalculateForceNeededToStartGoingUp() const
 			" Note: It doesn't take into account decelerations, only gravity."),
 		ActualMass,
 		ForceNeeded,
-		PhysicsData.LiftForceFromMaxCollective,
+		Data->LiftForceFromMaxCollective,
 		Percent);
 
 	UEditorDialogLibrary::ShowMessage(
@@ -54,112 +131,196 @@ void UHelicopterMovementComponent::CalculateForceNeededToStartGoingUp() const
 #endif
 }
 
-float UHelicopterMovementComponent::CalculateForceAmountBasedOnCollective() const
+void FHelicopterFlightCurves::Resolve(const FPhysicsData& PhysicsData, const FRotationData& RotationData,
+	bool bLoadSynchronous)
 {
-	// Get collective lift force scale from curve
-	// or if there is no curve, use collective as a scale itself
+	const auto ResolveCurve = [bLoadSynchronous](const TSoftObjectPtr<UCurveFloat>& Curve)
+	{
+		return bLoadSynchronous ? Curve.LoadSynchronous() : Curve.Get();
+	};
 	
-	const float LiftForceScale = PhysicsData.LiftForceScaleFromCollectiveCurve
-		? PhysicsData.LiftForceScaleFromCollectiveCurve->GetFloatValue(CollectiveData.CurrentCollective)
-		: CollectiveData.CurrentCollective;
-
-	return PhysicsData.LiftForceFromMaxCollective * LiftForceScale;
+	LiftForceScaleFromCollectiveCurve = ResolveCurve(PhysicsData.LiftForceScaleFromCollectiveCurve);
+	LiftScaleFromRotationCurve = ResolveCurve(PhysicsData.LiftScaleFromRotationCurve);
+	HorizontalAirFrictionDecelerationToVelocityCurve = ResolveCurve(PhysicsData.HorizontalAirFrictionDecelerationToVelocityCurve);
+	VerticalAirFrictionDecelerationToVelocityCurve = ResolveCurve(PhysicsData.VerticalAirFrictionDecelerationToVelocityCurve);
+	YawMaxSpeedScaleFromVelocityCurve = ResolveCurve(RotationData.YawMaxSpeedScaleFromVelocityCurve);
 }
 
 void UHelicopterMovementComponent::SetCollective(float NewCollocation)
 {
-	CollectiveData.CurrentCollective = UKismetMathLibrary::FClamp(NewCollocation, 0.0, 1.0);
+	MovementState.CurrentCollective = UKismetMathLibrary::FClamp(NewCollocation, 0.0, 1.0);
 }
 
 void UHelicopterMovementComponent::IncreaseCollective()
 {
-	const float DeltaTime = GetWorld()->DeltaTimeSeconds;
-	
-	SetCollective(CollectiveData.CurrentCollective + DeltaTime * CollectiveData.CollectiveIncreaseSpeed);
+	MovementState.CollectiveInput = FMath::Min(MovementState.CollectiveInput + 1.f, 1.f);
 }
 
 void UHelicopterMovementComponent::DecreaseCollective()
 {
-	const float DeltaTime = GetWorld()->DeltaTimeSeconds;
-
-	SetCollective(CollectiveData.CurrentCollective - DeltaTime * CollectiveData.CollectiveDecreaseSpeed);
+	MovementState.CollectiveInput = FMath::Max(MovementState.CollectiveInput - 1.f, -1.f);
 }
 
-void UHelicopterMovementComponent::AddRotation(float PitchIntensity, float YawIntensity, float RollIntensity)
+void UHelicopterMovementComponent::ApplyCollectiveInput(float DeltaTime)
 {
-	// Allow to collect input from different source, but do not allow it to be more than possible
+	const FCollectiveData& Collective = GetCollectiveData();
 	
-	RotationData.PitchPending = FMath::Clamp(RotationData.PitchPending + PitchIntensity, -1.f, 1.f);
-	RotationData.RollPending = FMath::Clamp(RotationData.RollPending + RollIntensity, -1.f, 1.f);
-	RotationData.YawPending = FMath::Clamp(RotationData.YawPending + YawIntensity, -1.f, 1.f);
+	if(MovementState.CollectiveInput > 0.f)
+	{
+		SetCollective(MovementState.CurrentCollective + MovementState.CollectiveInput * DeltaTime * Collective.CollectiveIncreaseSpeed);
+	}
+	else if(MovementState.CollectiveInput < 0.f)
+	{
+		SetCollective(MovementState.CurrentCollective + MovementState.CollectiveInput * DeltaTime * Collective.CollectiveDecreaseSpeed);
+	}
 }
 
-FVector UHelicopterMovementComponent::CalculateCurrentCollectiveAccelerationVector() const
+void UHelicopterMovementComponent::AddRotation(float PitchIntensity, float YawIntensity, float RollIntensity)
 {
-	const FVector AccelerationDirection = GetOwner()->GetActorUpVector();
-	const float CurrentCollocationForceAmount = CalculateForceAmountBasedOnCollective();
-	
-	const float Acceleration = UHeliConversionsLibrary::MsToCms(CurrentCollocationForceAmount / GetActualMass());
-	
-	FVector FinalAcceleration = AccelerationDirection * Acceleration;
-	
-	float LiftScaleFromRotation = PhysicsData.LiftScaleFromRotationCurve
-		? PhysicsData.LiftScaleFromRotationCurve->GetFloatValue(GetCurrentAngle())
-		: 1.f;
-	LiftScaleFromRotation = FMath::Clamp(LiftScaleFromRotation, 0.f, 1.f);
-
-	// Do not scale lift when going to the ground
-	FinalAcceleration.Z = FMath::Min(FinalAcceleration.Z, FinalAcceleration.Z * LiftScaleFromRotation);
+	// Allow to collect input from different source, but do not allow it to be more than possible
 	
-	return FinalAcceleration;
+	MovementState.PitchPending = FMath::Clamp(MovementState.PitchPending + PitchIntensity, -1.f, 1.f);
+	MovementState.RollPending = FMath::Clamp(MovementState.RollPending + RollIntensity, -1.f, 1.f);
+	MovementState.YawPending = FMath::Clamp(MovementState.YawPending + YawIntensity, -1.f, 1.f);
 }
 
 float UHelicopterMovementComponent::GetGravityZ() const
 {
-	return PhysicsData.GravityZAcceleration;
+	return GetPhysicsData().GravityZAcceleration;
 }
 
 float UHelicopterMovementComponent::GetMaxSpeed() const
 {
-	return PhysicsData.MaxSpeed;
+	return GetPhysicsData().MaxSpeed;
 }
 
 float UHelicopterMovementComponent::GetRawMass() const
 {
-	return PhysicsData.MassKg;
+	return GetPhysicsData().MassKg;
 }
 
 float UHelicopterMovementComponent::GetActualMass() const
 {
-	return PhysicsData.MassKg + PhysicsData.AdditionalMassKg;
+	return GetPhysicsData().MassKg + MovementState.AdditionalMassKg;
 }
 
 float UHelicopterMovementComponent::GetAdditionalMass() const
 {
-	return PhysicsData.AdditionalMassKg;
+	return MovementState.AdditionalMassKg;
 }
 
 void UHelicopterMovementComponent::SetAdditionalMass(float NewMass, bool bAddToCurrent)
 {
 	if(bAddToCurrent)
-		NewMass += PhysicsData.AdditionalMassKg;
+		NewMass += MovementState.LooseCargoMassKg;
 
-	PhysicsData.AdditionalMassKg = FMath::Clamp(NewMass, 0.f, PhysicsData.MaxAdditionalMassKg);
+	// Attached cargo takes its share of max mass first
+	const float AttachedCargoMassKg = MovementState.AdditionalMassKg - MovementState.LooseCargoMassKg;
+	const float MaxLooseCargoMassKg = FMath::Max(GetPhysicsData().MaxAdditionalMassKg - AttachedCargoMassKg, 0.f);
 
-	SyncPhysicsAndComponentMass();
+	MovementState.LooseCargoMassKg = FMath::Clamp(NewMass, 0.f, MaxLooseCargoMassKg);
+
+	RecalculateAdditionalMass();
+}
+
+int32 UHelicopterMovementComponent::AddCargo(float MassKg, const FVector& Offset)
+{
+	if(MassKg <= 0.f)
+		return INDEX_NONE;
+
+	if(MovementState.AdditionalMassKg + MassKg > GetPhysicsData().MaxAdditionalMassKg + UE_KINDA_SMALL_NUMBER)
+	{
+		HELI_WRN("Cargo of %.1f kg doesn't fit into %s", MassKg, *GetNameSafe(GetOwner()));
+		return INDEX_NONE;
+	}
+
+	FHelicopterCargoItem& Item = MovementState.CargoItems.AddDefaulted_GetRef();
+	Item.Handle = NextCargoHandle++;
+	Item.MassKg = MassKg;
+	Item.Offset = Offset;
+
+	RecalculateAdditionalMass();
+
+	return Item.Handle;
+}
+
+bool UHelicopterMovementComponent::RemoveCargo(int32 Handle)
+{
+	const int32 NumRemoved = MovementState.CargoItems.RemoveAll([Handle](const FHelicopterCargoItem& Item)
+	{
+		return Item.Handle == Handle;
+	});
+
+	if(NumRemoved == 0)
+		return false;
+
+	RecalculateAdditionalMass();
+
+	return true;
+}
+
+const TArray<FHelicopterCargoItem>& UHelicopterMovementComponent::GetCargoItems() const
+{
+	return MovementState.CargoItems;
+}
+
+void UHelicopterMovementComponent::RecalculateAdditionalMass()
+{
+	float AdditionalMassKg = MovementState.LooseCargoMassKg;
+	
+	for(const FHelicopterCargoItem& Item : MovementState.CargoItems)
+	{
+		AdditionalMassKg += Item.MassKg;
+	}
+
+	MovementState.AdditionalMassKg = AdditionalMassKg;
+
+	// Flight model sees the new mass right away, physics body gets it on the next step
+	bMassPropertiesDirty = true;
 }
 
 float UHelicopterMovementComponent::GetMaxAdditionalMass() const
 {
-	return PhysicsData.MaxAdditionalMassKg; 
+	return GetPhysicsData().MaxAdditionalMassKg; 
 }
 
 float UHelicopterMovementComponent::GetCurrentCollective() const
 {
-	return CollectiveData.CurrentCollective;
+	return MovementState.CurrentCollective;
 }
 
 float UHelicopterMovementComponent::GetCurrentAltitude() const
+{
+	return Telemetry.Altitude;
+}
+
+const FHelicopterTelemetry& UHelicopterMovementComponent::GetTelemetry() const
+{
+	return Telemetry;
+}
+
+void UHelicopterMovementComponent::SetWeightOnWheels(float NewWeightOnWheels)
+{
+	MovementState.WeightOnWheels = FMath::Clamp(NewWeightOnWheels, 0.f, 1.f);
+}
+
+float UHelicopterMovementComponent::GetWeightOnWheels() const
+{
+	return MovementState.WeightOnWheels;
+}
+
+UHelicopterTelemetryViewModel* UHelicopterMovementComponent::GetTelemetryViewModel()
+{
+	if(!TelemetryViewModel)
+	{
+		TelemetryViewModel = NewObject<UHelicopterTelemetryViewModel>(this);
+		TelemetryViewModel->SetTelemetry(Telemetry, true);
+	}
+
+	return TelemetryViewModel;
+}
+
+float UHelicopterMovementComponent::TraceAltitude() const
 {
 	if(!UpdatedPrimitive)
 		return 0.f;
@@ -181,6 +342,59 @@ float UHelicopterMovementComponent::GetCurrentAltitude() const
 	return FMath::Max((HitResult.ImpactPoint - Start).Length() + AltitudeOffset, 0.f);
 }
 
+void UHelicopterMovementComponent::UpdateTracedAltitude()
+{
+	TracedAltitude = TraceAltitude();
+	TracedZ = UpdatedPrimitive ? UpdatedPrimitive->GetComponentLocation().Z : 0.0;
+	bHasTracedAltitude = true;
+}
+
+float UHelicopterMovementComponent::EstimateAltitude()
+{
+	if(!bHasTracedAltitude)
+		UpdateTracedAltitude();
+
+	if(!UpdatedPrimitive)
+		return TracedAltitude;
+
+	// Ground under helicopter is assumed flat until the next trace
+	const double Climb = UpdatedPrimitive->GetComponentLocation().Z - TracedZ;
+
+	return FMath::Max(TracedAltitude + static_cast<float>(Climb), 0.f);
+}
+
+void UHelicopterMovementComponent::ResetMovementState()
+{
+	MovementState.CurrentCollective = GetCollectiveData().InitialCollective;
+
+	MovementState.PitchPending = 0.f;
+	MovementState.RollPending = 0.f;
+	MovementState.YawPending = 0.f;
+	MovementState.WeightOnWheels = 0.f;
+	MovementState.CollectiveInput = 0.f;
+	MovementState.CargoItems.Reset();
+	MovementState.LooseCargoMassKg = 0.f;
+
+	SetAdditionalMass(GetPhysicsData().InitialAdditionalMassKg);
+
+	if(UpdatedPrimitive)
+	{
+		UpdatedPrimitive->SetPhysicsLinearVelocity(FVector::ZeroVector);
+		UpdatedPrimitive->SetPhysicsAngularVelocityInDegrees(FVector::ZeroVector);
+	}
+
+	Velocity = FVector::ZeroVector;
+
+	// Helicopter may have been moved anywhere, the old trace says nothing about the ground here
+	bHasTracedAltitude = false;
+
+	UpdateTelemetry();
+
+	// Reset is a jump, UI shouldn't show the old state until the next scheduled update
+	if(TelemetryViewModel && TelemetryJobHandle != INDEX_NONE)
+		TelemetryViewModel->SetTelemetry(Telemetry);
+}
+
 void UHelicopterMovementComponent::UpdateComponentVelocity()
 {
 	if(UpdatedPrimitive)
@@ -201,252 +415,450 @@ void UHelicopterMovementComponent::InitializeComponent()
 		UpdatedPrimitive->SetEnableGravity(false);
 		UpdatedPrimitive->SetLinearDamping(0.f);
 		UpdatedPrimitive->SetAngularDamping(0.01f);
-
-		SyncPhysicsAndComponentMass();
 	}
 	else
 	{
 		HELI_LOG("Can't config physics on UpdatedPrimitive");
 	}
+
+	RequestFlightData();
 }
 
-void UHelicopterMovementComponent::ApplyVelocityDamping(float DeltaTime)
+const FPhysicsData& UHelicopterMovementComponent::GetPhysicsData() const
 {
-	if(!UpdatedPrimitive)
-		return;
-
-	FVector PhysicsVelocity = UpdatedPrimitive->GetPhysicsLinearVelocity();
-	
-	// We use raw accelerations since air friction doesn't depend on helicopter mass
-	// and we don't want to make all of these too complicated
-	
-	// Apply horizontal air friction
-	// Note: Horizontal Speed is always positive
-	const float HorizontalSpeed = UHeliConversionsLibrary::CmsToKmh(PhysicsVelocity.Size2D());
-	const float HorizontalAirFrictionDeceleration = PhysicsData.HorizontalAirFrictionDecelerationToVelocityCurve
-		? UHeliConversionsLibrary::KmhToCms(
-			PhysicsData.HorizontalAirFrictionDecelerationToVelocityCurve->GetFloatValue(HorizontalSpeed)
-		)
-		: 0.f;
-	
-	PhysicsVelocity += -PhysicsVelocity.GetSafeNormal2D() * HorizontalAirFrictionDeceleration * DeltaTime;
+	return HelicopterDefinition ? HelicopterDefinition->PhysicsData : PhysicsData;
+}
 
-	// Apply vertical air friction
-	// Note: Vertical Speed may be negative (in case of falling)
-	const float VerticalSpeed = UHeliConversionsLibrary::CmsToKmh(PhysicsVelocity.Z);
-	const float VerticalAirFrictionDeceleration = PhysicsData.VerticalAirFrictionDecelerationToVelocityCurve
-		? UHeliConversionsLibrary::KmhToCms(
-			PhysicsData.VerticalAirFrictionDecelerationToVelocityCurve->GetFloatValue(VerticalSpeed)
-		)
-		: 0.f;
+const FCollectiveData& UHelicopterMovementComponent::GetCollectiveData() const
+{
+	return HelicopterDefinition ? HelicopterDefinition->CollectiveData : CollectiveData;
+}
 
-	PhysicsVelocity.Z += -FMath::Sign(PhysicsVelocity.Z) * VerticalAirFrictionDeceleration * DeltaTime;
+const FRotationData& UHelicopterMovementComponent::GetRotationData() const
+{
+	return HelicopterDefinition ? HelicopterDefinition->RotationData : RotationData;
+}
 
-	UpdatedPrimitive->SetPhysicsLinearVelocity(PhysicsVelocity);
+FPrimaryAssetId UHelicopterMovementComponent::GetHelicopterDefinitionId() const
+{
+	return HelicopterDefinitionId;
 }
 
-void UHelicopterMovementComponent::ClampVelocityToMaxSpeed()
+void UHelicopterMovementComponent::GetSharedFlightObjects(TArray<UObject*>& OutObjects) const
 {
-	if(!UpdatedPrimitive)
-		return;
-	
-	const float AverageMaxSpeed = GetMaxSpeed() * PhysicsData.AverageMaxSpeedScale;
+	for(UObject* Object : TArray<UObject*> {
+		HelicopterDefinition,
+		FlightCurves.LiftForceScaleFromCollectiveCurve,
+		FlightCurves.LiftScaleFromRotationCurve,
+		FlightCurves.HorizontalAirFrictionDecelerationToVelocityCurve,
+		FlightCurves.VerticalAirFrictionDecelerationToVelocityCurve,
+		FlightCurves.YawMaxSpeedScaleFromVelocityCurve })
+	{
+		if(Object)
+			OutObjects.AddUnique(Object);
+	}
+}
 
-	FVector PhysicsVelocity = UpdatedPrimitive->GetPhysicsLinearVelocity();
-	
-	// Allow helicopter to fall faster then anything
-	PhysicsVelocity.Z = FMath::Clamp(PhysicsVelocity.Z, -PhysicsData.MaxSpeed, AverageMaxSpeed);
-	
-	// Limit horizontal velocity
-	const FVector ClampedHorizontal = PhysicsVelocity.GetClampedToMaxSize2D(AverageMaxSpeed);
-	PhysicsVelocity.X = ClampedHorizontal.X;
-	PhysicsVelocity.Y = ClampedHorizontal.Y;
+FHelicopterFlightModel UHelicopterMovementComponent::MakeFlightModel() const
+{
+	const UWorld* World = GetWorld();
+	const UHelicopterAtmosphereSubsystem* Atmosphere = World ? World->GetSubsystem<UHelicopterAtmosphereSubsystem>() : nullptr;
 
-	UpdatedPrimitive->SetPhysicsLinearVelocity(PhysicsVelocity);
+	return {
+		GetPhysicsData(),
+		FlightCurves,
+		Atmosphere && UpdatedComponent
+			? Atmosphere->GetSample(UpdatedComponent->GetComponentLocation())
+			: FHelicopterAtmosphereSample {}
+	};
 }
 
-float UHelicopterMovementComponent::GetCurrentAngle() const
+const FHelicopterFlightEnvelope* UHelicopterMovementComponent::GetFlightEnvelope() const
 {
-	const FVector UpVector {0.f, 0.f ,1.f};
-	const FVector ComponentUpVector = UpdatedComponent->GetUpVector();
+	return HelicopterDefinition && HelicopterDefinition->FlightEnvelope.IsValid()
+		? &HelicopterDefinition->FlightEnvelope
+		: nullptr;
+}
 
-	const float DotProduct = UpVector.Dot(ComponentUpVector);
-	const float AngleDecrees = FMath::RadiansToDegrees(FMath::Acos(DotProduct));
-	
-	return AngleDecrees;
+bool UHelicopterMovementComponent::IsFlightDataReady() const
+{
+	return bIsFlightDataReady;
 }
 
-void UHelicopterMovementComponent::UpdateAngularVelocity(float DeltaTime)
+void UHelicopterMovementComponent::SetTrackedInSpatialHash(bool bTracked)
 {
-	const bool bHasMoved = ApplyAccelerationsToAngularVelocity(DeltaTime);
+	UWorld* World = GetWorld();
+	UHelicopterSpatialHashSubsystem* SpatialHash = World ? World->GetSubsystem<UHelicopterSpatialHashSubsystem>() : nullptr;
+	if(!SpatialHash)
+		return;
 
-	// Do not apply deceleration if we rotated
-	// It allows to rotate even with low (0.1) intensity
-	if(!bHasMoved)
+	if(bTracked && SpatialHashHandle == INDEX_NONE)
+	{
+		AHelicopter* Helicopter = Cast<AHelicopter>(GetOwner());
+		if(!Helicopter || !UpdatedComponent)
+			return;
+
+		SpatialHashHandle = SpatialHash->RegisterHelicopter(Helicopter, UpdatedComponent->GetComponentLocation(), Velocity);
+	}
+	else if(!bTracked && SpatialHashHandle != INDEX_NONE)
 	{
-		ApplyAngularVelocityDamping(DeltaTime);
+		SpatialHash->UnregisterHelicopter(SpatialHashHandle);
+		SpatialHashHandle = INDEX_NONE;
 	}
+}
 
-	ClampAngularVelocity();
+int32 UHelicopterMovementComponent::GetSpatialHashHandle() const
+{
+	return SpatialHashHandle;
 }
 
-bool UHelicopterMovementComponent::ApplyAccelerationsToAngularVelocity(float DeltaTime)
+void UHelicopterMovementComponent::UpdateSpatialHash()
 {
-	if(!UpdatedPrimitive)
-		return false;
-	
-	FVector Delta {
-		RotationData.RollPending * RotationData.RollAcceleration * DeltaTime,
-		RotationData.PitchPending * RotationData.PitchAcceleration * DeltaTime,
-		RotationData.YawPending * RotationData.YawAcceleration * DeltaTime
-	};
+	if(SpatialHashHandle == INDEX_NONE || !UpdatedComponent)
+		return;
 
-	const FTransform ComponentTransform = UpdatedPrimitive->GetComponentTransform();
-	Delta = UKismetMathLibrary::TransformDirection(ComponentTransform, Delta);
-	
-	const bool bMoved = !Delta.IsNearlyZero();
+	if(UHelicopterSpatialHashSubsystem* SpatialHash = GetWorld()->GetSubsystem<UHelicopterSpatialHashSubsystem>())
+	{
+		SpatialHash->UpdateHelicopter(SpatialHashHandle, UpdatedComponent->GetComponentLocation(), Velocity);
+	}
+}
 
-	// Do not touch velocity if we don't really need to
-	if(bMoved)
+void UHelicopterMovementComponent::RequestFlightData()
+{
+	if(!UAssetManager::IsInitialized())
 	{
-		UpdatedPrimitive->SetPhysicsAngularVelocityInDegrees(Delta, true);
+		HELI_ERR("Asset manager is not initialized, flight data of %s can't be loaded", *GetPathName());
+		return;
 	}
 	
-	RotationData.PitchPending = 0.f;
-	RotationData.RollPending = 0.f;
-	RotationData.YawPending = 0.f;
-	
-	return bMoved;
+	UAssetManager& AssetManager = UAssetManager::Get();
+	const FStreamableDelegate OnLoaded = FStreamableDelegate::CreateUObject(this, &ThisClass::OnFlightDataLoaded);
+
+	if(HelicopterDefinitionId.IsValid())
+	{
+		// Loads definition with its curves, does nothing but calling the delegate if they are already in memory
+		FlightDataHandle = AssetManager.LoadPrimaryAsset(
+			HelicopterDefinitionId,
+			{ UHelicopterDefinition::FlightBundleName },
+			OnLoaded
+		);
+	}
+	else
+	{
+		TArray<FSoftObjectPath> CurvePaths {};
+
+		for(const TSoftObjectPtr<UCurveFloat>& Curve : {
+			PhysicsData.LiftForceScaleFromCollectiveCurve,
+			PhysicsData.LiftScaleFromRotationCurve,
+			PhysicsData.HorizontalAirFrictionDecelerationToVelocityCurve,
+			PhysicsData.VerticalAirFrictionDecelerationToVelocityCurve,
+			RotationData.YawMaxSpeedScaleFromVelocityCurve })
+		{
+			if(!Curve.IsNull())
+				CurvePaths.Add(Curve.ToSoftObjectPath());
+		}
+
+		if(!CurvePaths.IsEmpty())
+		{
+			FlightDataHandle = AssetManager.GetStreamableManager().RequestAsyncLoad(CurvePaths, OnLoaded);
+		}
+	}
+
+	// Handle may be already completed, or there is nothing to load at all
+	if(!FlightDataHandle.IsValid() || FlightDataHandle->HasLoadCompleted())
+	{
+		OnFlightDataLoaded();
+	}
 }
 
-void UHelicopterMovementComponent::ApplyAngularVelocityDamping(float DeltaTime)
+void UHelicopterMovementComponent::OnFlightDataLoaded()
 {
-	if(!UpdatedPrimitive)
+	LLM_SCOPE_BYTAG(Heli_Helicopters);
+
+	if(bIsFlightDataReady)
 		return;
 
-	FVector PhysicsAngularVelocity = UpdatedPrimitive->GetPhysicsAngularVelocityInDegrees();
-	
-	const FTransform ComponentTransform = UpdatedPrimitive->GetComponentTransform();
-	const FTransform InversedComponentTransform = ComponentTransform.Inverse();
-	
-	FVector LocalAngularVelocity = UKismetMathLibrary::TransformDirection(InversedComponentTransform, PhysicsAngularVelocity);
-
-	const int RollSign = FMath::Sign(LocalAngularVelocity.X);
-	LocalAngularVelocity.X += -RollSign
-		* RotationData.RollDeceleration
-		* DeltaTime;
-	LocalAngularVelocity.X = RollSign == 1
-		? FMath::Max(0.f, LocalAngularVelocity.X)
-		: FMath::Min(0.f, LocalAngularVelocity.X);
-	
-	const int PitchSign = FMath::Sign(LocalAngularVelocity.Y);
-	LocalAngularVelocity.Y += -PitchSign
-		* RotationData.PitchDeceleration
-		* DeltaTime;
-	LocalAngularVelocity.Y = PitchSign == 1
-		? FMath::Max(0.f, LocalAngularVelocity.Y)
-		: FMath::Min(0.f, LocalAngularVelocity.Y);
-	
-	const int YawSign = FMath::Sign(LocalAngularVelocity.Z);
-	LocalAngularVelocity.Z += -YawSign
-		* RotationData.YawDeceleration
-		* DeltaTime;
-	LocalAngularVelocity.Z = YawSign == 1
-		? FMath::Max(0.f, LocalAngularVelocity.Z)
-		: FMath::Min(0.f, LocalAngularVelocity.Z);
-	
-	PhysicsAngularVelocity = UKismetMathLibrary::TransformDirection(ComponentTransform, LocalAngularVelocity);
-	
-	UpdatedPrimitive->SetPhysicsAngularVelocityInDegrees(PhysicsAngularVelocity);
+	if(HelicopterDefinitionId.IsValid())
+	{
+		HelicopterDefinition = UAssetManager::Get().GetPrimaryAssetObject<UHelicopterDefinition>(HelicopterDefinitionId);
+		if(!HelicopterDefinition)
+		{
+			HELI_ERR("Can't load helicopter definition %s, inline data is used", *HelicopterDefinitionId.ToString());
+		}
+	}
+
+	FlightCurves.Resolve(GetPhysicsData(), GetRotationData(), false);
+
+	bIsFlightDataReady = true;
+
+	MovementState.CurrentCollective = GetCollectiveData().InitialCollective;
+	SetAdditionalMass(GetPhysicsData().InitialAdditionalMassKg);
 }
 
-void UHelicopterMovementComponent::ClampAngularVelocity()
+void UHelicopterMovementComponent::UpdateAngularVelocity(float DeltaTime)
 {
 	if(!UpdatedPrimitive)
 		return;
 
-	FVector PhysicsAngularVelocity = UpdatedPrimitive->GetPhysicsAngularVelocityInDegrees();
-	
 	const FTransform ComponentTransform = UpdatedPrimitive->GetComponentTransform();
-	const FTransform InversedComponentTransform = ComponentTransform.Inverse();
-	
-	FVector LocalAngularVelocity = UKismetMathLibrary::TransformDirection(InversedComponentTransform, PhysicsAngularVelocity);
-
-	const float HorizontalVelocity = UHeliConversionsLibrary::CmsToKmh(
-		UpdatedPrimitive->GetPhysicsLinearVelocity().Size2D()
+	const FVector LocalAngularVelocity = ComponentTransform.InverseTransformVectorNoScale(
+		UpdatedPrimitive->GetPhysicsAngularVelocityInDegrees()
 	);
-	const float YawMaxSpeedScale = RotationData.YawMaxSpeedScaleFromVelocityCurve
-		? RotationData.YawMaxSpeedScaleFromVelocityCurve->GetFloatValue(HorizontalVelocity)
-		: 1.f;
-	const float ScaledYawMaxSpeed = RotationData.YawMaxSpeed * YawMaxSpeedScale;
-	
-	LocalAngularVelocity.X = FMath::Clamp(
-		LocalAngularVelocity.X,
-		-RotationData.RollMaxSpeed,
-		RotationData.RollMaxSpeed
-	);
-	LocalAngularVelocity.Y = FMath::Clamp(
-		LocalAngularVelocity.Y,
-		-RotationData.PitchMaxSpeed,
-		RotationData.PitchMaxSpeed
-	);
-	LocalAngularVelocity.Z = FMath::Clamp(
-		LocalAngularVelocity.Z,
-		-ScaledYawMaxSpeed,
-		ScaledYawMaxSpeed
+
+	const FVector NewLocalAngularVelocity = MakeFlightModel().StepLocalAngularVelocity(
+		LocalAngularVelocity,
+		GetRotationInput(),
+		GetRotationData(),
+		MovementState.WeightOnWheels,
+		UpdatedPrimitive->GetPhysicsLinearVelocity().Size2D(),
+		DeltaTime
 	);
-	
-	PhysicsAngularVelocity = UKismetMathLibrary::TransformDirection(ComponentTransform, LocalAngularVelocity);
-	
-	UpdatedPrimitive->SetPhysicsAngularVelocityInDegrees(PhysicsAngularVelocity);
+
+	// Do not touch velocity if we don't really need to
+	if(!NewLocalAngularVelocity.Equals(LocalAngularVelocity, 0.f))
+		UpdatedPrimitive->SetPhysicsAngularVelocityInDegrees(ComponentTransform.TransformVectorNoScale(NewLocalAngularVelocity));
+}
+
+FVector UHelicopterMovementComponent::GetRotationInput() const
+{
+	return { MovementState.RollPending, MovementState.PitchPending, MovementState.YawPending };
 }
 
 void UHelicopterMovementComponent::SyncPhysicsAndComponentMass()
 {
-	if(!UpdatedPrimitive)
+	if(!bMassPropertiesDirty || !UpdatedPrimitive)
+		return;
+
+	FBodyInstance* BodyInstance = UpdatedPrimitive->GetBodyInstance();
+	if(!BodyInstance || !BodyInstance->IsValidBodyInstance())
 		return;
 
-	UpdatedPrimitive->SetMassOverrideInKg(NAME_None, GetActualMass(), true);
+	if(BaseInertiaPerKg.IsZero())
+	{
+		const float BodyMass = BodyInstance->GetBodyMass();
+		if(BodyMass <= 0.f)
+			return;
+
+		// Tensor of the body already has its InertiaTensorScale applied
+		const FVector BodyScale = BodyInstance->InertiaTensorScale;
+		BaseInertiaPerKg = BodyInstance->GetBodyInertiaTensor() / BodyMass;
+		BaseUnscaledInertiaPerKg = FVector(
+			BodyScale.X > 0.f ? BaseInertiaPerKg.X / BodyScale.X : BaseInertiaPerKg.X,
+			BodyScale.Y > 0.f ? BaseInertiaPerKg.Y / BodyScale.Y : BaseInertiaPerKg.Y,
+			BodyScale.Z > 0.f ? BaseInertiaPerKg.Z / BodyScale.Z : BaseInertiaPerKg.Z
+		);
+		BaseCOMNudge = BodyInstance->COMNudge;
+	}
+
+	const float RawMass = GetRawMass();
+	const float ActualMass = GetActualMass();
+
+	FVector MassMoment = FVector::ZeroVector;
+	for(const FHelicopterCargoItem& Item : MovementState.CargoItems)
+	{
+		MassMoment += Item.Offset * Item.MassKg;
+	}
+
+	const FVector CenterOfMassOffset = ActualMass > 0.f ? MassMoment / ActualMass : FVector::ZeroVector;
+
+	// Diagonal inertia of a point mass around axes through the center of mass
+	const auto PointInertia = [](float MassKg, const FVector& Offset)
+	{
+		return MassKg * FVector(
+			FMath::Square(Offset.Y) + FMath::Square(Offset.Z),
+			FMath::Square(Offset.X) + FMath::Square(Offset.Z),
+			FMath::Square(Offset.X) + FMath::Square(Offset.Y)
+		);
+	};
+
+	// Helicopter and loose cargo are shifted from the new center of mass, attached cargo adds point masses.
+	// Mass override scales unscaled body inertia as if cargo was spread like the helicopter, scale corrects it to the sum.
+	// The sum starts from the scaled inertia, so the body's own scale is kept in the new scale and not applied twice
+	FVector Inertia = BaseInertiaPerKg * RawMass + PointInertia(RawMass + MovementState.LooseCargoMassKg, -CenterOfMassOffset);
+	for(const FHelicopterCargoItem& Item : MovementState.CargoItems)
+	{
+		Inertia += PointInertia(Item.MassKg, Item.Offset - CenterOfMassOffset);
+	}
+
+	const FVector OverriddenInertia = BaseUnscaledInertiaPerKg * ActualMass;
+	const FVector InertiaScale {
+		OverriddenInertia.X > 0.f ? Inertia.X / OverriddenInertia.X : 1.f,
+		OverriddenInertia.Y > 0.f ? Inertia.Y / OverriddenInertia.Y : 1.f,
+		OverriddenInertia.Z > 0.f ? Inertia.Z / OverriddenInertia.Z : 1.f
+	};
+
+	BodyInstance->SetMassOverride(ActualMass, true);
+	BodyInstance->COMNudge = BaseCOMNudge + CenterOfMassOffset;
+	BodyInstance->InertiaTensorScale = InertiaScale;
+	BodyInstance->UpdateMassProperties();
+
+	bMassPropertiesDirty = false;
 }
 
 void UHelicopterMovementComponent::TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction)
 {
 	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
 
-	UpdateVelocity(DeltaTime);
+	// Physics steps need the frame queued even when lockstep would drive the helicopter otherwise
+	if(bDrivenByLockstep && !PhysicsStepCallback)
+		return;
+
+	StepSimulation(DeltaTime);
 
-	UpdateAngularVelocity(DeltaTime);
+	ClearFrameInput();
 }
 
-void UHelicopterMovementComponent::UpdateVelocity(float DeltaTime)
+void UHelicopterMovementComponent::StepSimulation(float DeltaTime)
 {
-	ApplyAccelerationsToVelocity(DeltaTime);
-	
-	ApplyGravityToVelocity(DeltaTime);
+	SyncPhysicsAndComponentMass();
 	
-	ClampVelocityToMaxSpeed();
+	if(!bIsFlightDataReady)
+		return;
 
-	ApplyVelocityDamping(DeltaTime);
-	
-	UpdateComponentVelocity();
+	SCOPE_CYCLE_COUNTER(STAT_HeliMovementStep);
+
+	if(PhysicsStepCallback)
+		QueuePhysicsStep();
+
+	ApplyCollectiveInput(DeltaTime);
+
+	// Physics steps set velocities of the body, component only follows them
+	if(PhysicsStepCallback)
+	{
+		UpdateComponentVelocity();
+		UpdateSpatialHash();
+	}
+	else
+	{
+		UpdateVelocity(DeltaTime);
+		UpdateAngularVelocity(DeltaTime);
+	}
+
+	UpdateTelemetry();
 }
 
-void UHelicopterMovementComponent::ApplyGravityToVelocity(float DeltaTime)
+void UHelicopterMovementComponent::ClearFrameInput()
 {
-	if(!UpdatedPrimitive)
+	MovementState.PitchPending = 0.f;
+	MovementState.RollPending = 0.f;
+	MovementState.YawPending = 0.f;
+	MovementState.CollectiveInput = 0.f;
+}
+
+void UHelicopterMovementComponent::SetDrivenByLockstep(bool bDriven)
+{
+	bDrivenByLockstep = bDriven;
+}
+
+bool UHelicopterMovementComponent::IsDrivenByLockstep() const
+{
+	return bDrivenByLockstep;
+}
+
+void UHelicopterMovementComponent::SetPhysicsStepCallback(FHelicopterPhysicsStepCallback* Callback)
+{
+	PhysicsStepCallback = Callback;
+}
+
+bool UHelicopterMovementComponent::IsDrivenByPhysicsStep() const
+{
+	return PhysicsStepCallback != nullptr;
+}
+
+void UHelicopterMovementComponent::QueuePhysicsStep()
+{
+	FBodyInstance* BodyInstance = UpdatedPrimitive ? UpdatedPrimitive->GetBodyInstance() : nullptr;
+	if(!BodyInstance || !BodyInstance->IsValidBodyInstance())
 		return;
-	
-	const FVector GravityAcceleration { 0.f, 0.f, GetGravityZ() };
 
-	UpdatedPrimitive->SetPhysicsLinearVelocity(GravityAcceleration * DeltaTime, true);
+	// Setting velocities kept the body awake before, physics steps only fly awake bodies
+	BodyInstance->WakeInstance();
+
+	const FCollectiveData& Collective = GetCollectiveData();
+	const float CollectiveInput = MovementState.CollectiveInput;
+
+	FHelicopterPhysicsStepInput* Input = PhysicsStepCallback->GetProducerInputData_External();
+	Input->Frame = GFrameCounter;
+
+	FHelicopterPhysicsStep& Step = Input->Helicopters.AddDefaulted_GetRef();
+	Step.Proxy = BodyInstance->GetPhysicsActorHandle();
+	Step.PhysicsData = &GetPhysicsData();
+	Step.RotationData = &GetRotationData();
+	Step.Curves = &FlightCurves;
+	Step.Atmosphere = MakeFlightModel().Atmosphere;
+	Step.Collective = MovementState.CurrentCollective;
+	Step.CollectiveSpeed = CollectiveInput * (CollectiveInput > 0.f ? Collective.CollectiveIncreaseSpeed : Collective.CollectiveDecreaseSpeed);
+	Step.MassKg = GetActualMass();
+	Step.WeightOnWheels = MovementState.WeightOnWheels;
+	Step.RotationInput = GetRotationInput();
 }
 
-void UHelicopterMovementComponent::ApplyAccelerationsToVelocity(float DeltaTime)
+uint32 UHelicopterMovementComponent::UpdateStateHash()
+{
+	// Fields are hashed one by one, hashing whole structs would include padding bytes
+	const auto Mix = [this](const auto& Value)
+	{
+		StateHash = FCrc::MemCrc32(&Value, sizeof(Value), StateHash);
+	};
+
+	if(UpdatedPrimitive)
+	{
+		const FTransform& Transform = UpdatedPrimitive->GetComponentTransform();
+		
+		Mix(Transform.GetLocation());
+		Mix(Transform.GetRotation());
+		Mix(UpdatedPrimitive->GetPhysicsLinearVelocity());
+		Mix(UpdatedPrimitive->GetPhysicsAngularVelocityInDegrees());
+	}
+
+	Mix(MovementState.CurrentCollective);
+	Mix(MovementState.AdditionalMassKg);
+	Mix(MovementState.WeightOnWheels);
+
+	return StateHash;
+}
+
+uint32 UHelicopterMovementComponent::GetStateHash() const
+{
+	return StateHash;
+}
+
+void UHelicopterMovementComponent::UpdateTelemetry()
+{
+	SCOPE_CYCLE_COUNTER(STAT_HeliTelemetry);
+
+	Telemetry.Altitude = AltitudeJobHandle != INDEX_NONE ? EstimateAltitude() : TraceAltitude();
+	Telemetry.VerticalSpeed = Velocity.Z;
+	Telemetry.HorizontalSpeed = Velocity.Size2D();
+	Telemetry.Collective = MovementState.CurrentCollective;
+	Telemetry.ActualMassKg = GetActualMass();
+	Telemetry.AdditionalMassKg = MovementState.AdditionalMassKg;
+	Telemetry.WeightOnWheels = MovementState.WeightOnWheels;
+	Telemetry.Time = GetWorld() ? GetWorld()->GetTimeSeconds() : 0.0;
+
+	// Scheduled job pushes it otherwise
+	if(TelemetryViewModel && TelemetryJobHandle == INDEX_NONE)
+		TelemetryViewModel->SetTelemetry(Telemetry);
+}
+
+void UHelicopterMovementComponent::UpdateVelocity(float DeltaTime)
 {
 	if(!UpdatedPrimitive)
 		return;
+
+	const FHelicopterFlightModel FlightModel = MakeFlightModel();
+
+	const FVector NewVelocity = FlightModel.StepVelocity(
+		UpdatedPrimitive->GetPhysicsLinearVelocity(),
+		UpdatedComponent->GetUpVector(),
+		MovementState.CurrentCollective,
+		GetActualMass(),
+		DeltaTime
+	);
+
+	UpdatedPrimitive->SetPhysicsLinearVelocity(NewVelocity);
 	
-	const FVector CollocationAcceleration = CalculateCurrentCollectiveAccelerationVector();
+	UpdateComponentVelocity();
 
-	UpdatedPrimitive->SetPhysicsLinearVelocity(CollocationAcceleration * DeltaTime, true);
-}
\ No newline at end of file
+	UpdateSpatialHash();
+}
@@ -4,15 +4,23 @@
 #include "Components/ActorComponent.h"
 #include "GameFramework/MovementComponent.h"
 #include "Heli/BFLs/HeliConversionsLibrary.h"
+#include "UObject/PrimaryAssetId.h"
 #include "HelicopterMovementComponent.generated.h"
 
+class UHelicopterDefinition;
+struct FHelicopterFlightModel;
+class FHelicopterPhysicsStepCallback;
+class UHelicopterTelemetryViewModel;
+struct FHelicopterFlightEnvelope;
+struct FStreamableHandle;
+
 USTRUCT(BlueprintType)
 struct FCollectiveData
 {
 	GENERATED_BODY()
 	
 	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0, ClampMax=1.0))
-	float CurrentCollective { 0.f };
+	float InitialCollective { 0.f };
 
 	UPROPERTY(EditAnywhere)
 	float CollectiveIncreaseSpeed { 0.45f };
@@ -35,9 +43,6 @@ struct FRotationData
 	UPROPERTY(EditAnywhere)
 	float PitchMaxSpeed { 35.f };
 
-	UPROPERTY(VisibleAnywhere)
-	float PitchPending { 0.f };
-
 	UPROPERTY(EditAnywhere)
 	float RollAcceleration { 25.f };
 
@@ -46,9 +51,6 @@ struct FRotationData
 
 	UPROPERTY(EditAnywhere)
 	float RollMaxSpeed { 35.f };
-
-	UPROPERTY(VisibleAnywhere)
-	float RollPending { 0.f };
 	
 	UPROPERTY(EditAnywhere)
 	float YawAcceleration { 25.f };
@@ -59,14 +61,26 @@ struct FRotationData
 	UPROPERTY(EditAnywhere)
 	float YawMaxSpeed { 35.f };
 	
-	UPROPERTY(VisibleAnywhere)
-	float YawPending { 0.f };
+	UPROPERTY(EditAnywhere, meta=(AssetBundles="Flight"))
+	TSoftObjectPtr<UCurveFloat> YawMaxSpeedScaleFromVelocityCurve {};
 
-	UPROPERTY(EditAnywhere)
-	TObjectPtr<UCurveFloat> YawMaxSpeedScaleFromVelocityCurve {};
+	// Pitch and roll acceleration scale when landing gear carries all the weight, keeps helicopter from tipping over on the pad
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0, ClampMax=1.0))
+	float LandedPitchRollScale { 0.1f };
 	
 };
 
+UENUM(BlueprintType)
+enum class EHelicopterIntegrator : uint8
+{
+	// Original update, trajectories depend on tick rate
+	ExplicitEuler,
+	// Forces first, then air friction from the new velocity. Cheap and stable at 20-30 Hz
+	SemiImplicit,
+	// Four evaluations per tick, closest to the exact trajectory at any tick rate
+	RungeKutta4
+};
+
 USTRUCT(BlueprintType)
 struct FPhysicsData
 {
@@ -82,13 +96,17 @@ struct FPhysicsData
 	UPROPERTY(EditAnywhere)
 	float AverageMaxSpeedScale { 0.8f };
 
+	// Rebake flight envelope after changing it, baked tables are made with the integrator
+	UPROPERTY(EditAnywhere)
+	EHelicopterIntegrator Integrator { EHelicopterIntegrator::ExplicitEuler };
+
 	// Mass of helicopter itself, without cargo
 	UPROPERTY(EditDefaultsOnly)
 	float MassKg { 0.f };
 	
-	// Add mass here if you need to simulate some heavy cargo
+	// Add mass here if you need helicopter to spawn with some heavy cargo
 	UPROPERTY(EditDefaultsOnly)
-	float AdditionalMassKg { 0.f };
+	float InitialAdditionalMassKg { 0.f };
 	
 	UPROPERTY(EditDefaultsOnly)
 	float MaxAdditionalMassKg { 0.f };
@@ -96,22 +114,139 @@ struct FPhysicsData
 	UPROPERTY(EditAnywhere)
 	float LiftForceFromMaxCollective { 0.f };
 
+	// Lift engine power can hold at standard sea level relative to LiftForceFromMaxCollective.
+	// Power falls with altitude and heat, so it caps lift of high and hot flight. Zero leaves engine power out
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float EngineLiftMargin { 0.f };
+
 	// It's better to start making it from two keys: (0; 0) (1;0)
 	// then place new key at 0.45 and set it's scale so helicopter is going to start going up at this key
-	UPROPERTY(EditAnywhere)
-	TObjectPtr<UCurveFloat> LiftForceScaleFromCollectiveCurve {};
+	UPROPERTY(EditAnywhere, meta=(AssetBundles="Flight"))
+	TSoftObjectPtr<UCurveFloat> LiftForceScaleFromCollectiveCurve {};
 
 	// It gets angle between world Up and component Up and passes it to the curve to find lift scale
 	// we need it to not allow helicopter to fly on pitch = 60 using max collective
-	UPROPERTY(EditAnywhere)
+	UPROPERTY(EditAnywhere, meta=(AssetBundles="Flight"))
+	TSoftObjectPtr<UCurveFloat> LiftScaleFromRotationCurve {};
+
+	UPROPERTY(EditAnywhere, meta=(AssetBundles="Flight"))
+	TSoftObjectPtr<UCurveFloat> HorizontalAirFrictionDecelerationToVelocityCurve {};
+
+	UPROPERTY(EditAnywhere, meta=(AssetBundles="Flight"))
+	TSoftObjectPtr<UCurveFloat> VerticalAirFrictionDecelerationToVelocityCurve {};
+	
+};
+
+// Curves of FPhysicsData and FRotationData resolved after they have been loaded
+USTRUCT()
+struct FHelicopterFlightCurves
+{
+	GENERATED_BODY()
+
+	UPROPERTY()
+	TObjectPtr<UCurveFloat> LiftForceScaleFromCollectiveCurve {};
+
+	UPROPERTY()
 	TObjectPtr<UCurveFloat> LiftScaleFromRotationCurve {};
 
-	UPROPERTY(EditAnywhere)
+	UPROPERTY()
 	TObjectPtr<UCurveFloat> HorizontalAirFrictionDecelerationToVelocityCurve {};
 
-	UPROPERTY(EditAnywhere)
+	UPROPERTY()
 	TObjectPtr<UCurveFloat> VerticalAirFrictionDecelerationToVelocityCurve {};
-	
+
+	UPROPERTY()
+	TObjectPtr<UCurveFloat> YawMaxSpeedScaleFromVelocityCurve {};
+
+	// Takes curves that are already loaded, or loads them if bLoadSynchronous is set
+	void Resolve(const FPhysicsData& PhysicsData, const FRotationData& RotationData, bool bLoadSynchronous);
+};
+
+USTRUCT(BlueprintType)
+struct FHelicopterCargoItem
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	int32 Handle { INDEX_NONE };
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float MassKg { 0.f };
+
+	// Where item is attached, relative to the original center of mass of helicopter
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	FVector Offset { FVector::ZeroVector };
+};
+
+// Everything that changes while helicopter flies, tuning is kept in FPhysicsData, FCollectiveData and FRotationData
+USTRUCT(BlueprintType)
+struct FHelicopterMovementState
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere)
+	float CurrentCollective { 0.f };
+
+	// All cargo together, loose and attached
+	UPROPERTY(VisibleAnywhere)
+	float AdditionalMassKg { 0.f };
+
+	// Cargo set by SetAdditionalMass, it sits at the original center of mass
+	UPROPERTY(VisibleAnywhere)
+	float LooseCargoMassKg { 0.f };
+
+	UPROPERTY(VisibleAnywhere)
+	TArray<FHelicopterCargoItem> CargoItems {};
+
+	UPROPERTY(VisibleAnywhere)
+	float PitchPending { 0.f };
+
+	UPROPERTY(VisibleAnywhere)
+	float RollPending { 0.f };
+
+	UPROPERTY(VisibleAnywhere)
+	float YawPending { 0.f };
+
+	// Requested collective change direction, applied with simulation step time instead of frame time.
+	// This and pending rotation are held for all steps of a frame, see ClearFrameInput
+	UPROPERTY(VisibleAnywhere)
+	float CollectiveInput { 0.f };
+
+	// Share of weight carried by landing gear, reported by UHelicopterLandingGearComponent
+	UPROPERTY(VisibleAnywhere)
+	float WeightOnWheels { 0.f };
+};
+
+// Flight values read by UI, AI and gameplay. Built once per tick, so reading it is free
+USTRUCT(BlueprintType)
+struct FHelicopterTelemetry
+{
+	GENERATED_BODY()
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float Altitude { 0.f };
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float VerticalSpeed { 0.f };
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float HorizontalSpeed { 0.f };
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float Collective { 0.f };
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float ActualMassKg { 0.f };
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float AdditionalMassKg { 0.f };
+
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	float WeightOnWheels { 0.f };
+
+	// World time the snapshot was taken at
+	UPROPERTY(VisibleAnywhere, BlueprintReadOnly)
+	double Time { 0.0 };
 };
 
 UCLASS(
@@ -129,6 +264,7 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetCollective(float NewCollocation);
 
+	// Collective changes with its speed over every simulation step of the frame, call it every frame while input is held
 	UFUNCTION(BlueprintCallable)
 	void IncreaseCollective();
 
@@ -139,6 +275,29 @@ public:
 	void AddRotation(float PitchIntensity, float YawIntensity, float RollIntensity);
 	
 	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Everything helicopter does in one tick. Called by tick or by UHelicopterLockstepSubsystem with fixed time.
+	// Input is held for every step of a frame, so the result doesn't depend on how many steps the frame takes
+	void StepSimulation(float DeltaTime);
+
+	// Drops collective and rotation input once the frame is simulated, callers of StepSimulation call it after the last step
+	void ClearFrameInput();
+
+	// Helicopter doesn't step in its own tick while lockstep drives it
+	void SetDrivenByLockstep(bool bDriven);
+
+	bool IsDrivenByLockstep() const;
+
+	// While it's set every physics step flies the helicopter with input of the frame, StepSimulation only queues it.
+	// UHelicopterTimeCompressionSubsystem sets it while physics substeps compressed frames
+	void SetPhysicsStepCallback(FHelicopterPhysicsStepCallback* Callback);
+
+	bool IsDrivenByPhysicsStep() const;
+
+	// Mixes current state into the rolling hash and returns it. Any bit of difference changes it
+	uint32 UpdateStateHash();
+
+	uint32 GetStateHash() const;
 	
 	virtual float GetGravityZ() const override;
 	
@@ -156,20 +315,81 @@ public:
 	UFUNCTION(BlueprintCallable)
 	void SetAdditionalMass(float NewMass, bool bAddToCurrent = false);
 
+	// Attaches cargo at the offset from helicopter center of mass. Returns handle to remove it,
+	// or INDEX_NONE if it doesn't fit into max additional mass. Body is updated once on the next step
+	UFUNCTION(BlueprintCallable)
+	int32 AddCargo(float MassKg, const FVector& Offset);
+
+	UFUNCTION(BlueprintCallable)
+	bool RemoveCargo(int32 Handle);
+
+	UFUNCTION(BlueprintCallable)
+	const TArray<FHelicopterCargoItem>& GetCargoItems() const;
+
 	UFUNCTION(BlueprintCallable)
 	float GetMaxAdditionalMass() const;
 
 	UFUNCTION(BlueprintCallable)
 	float GetCurrentCollective() const;
 
+	// Altitude from the last telemetry snapshot. Ground is traced once per tick,
+	// or by UHelicopterSchedulerSubsystem at least every AltitudeMaxStaleness seconds when it runs
 	UFUNCTION(BlueprintCallable)
 	float GetCurrentAltitude() const;
 
+	UFUNCTION(BlueprintCallable)
+	const FHelicopterTelemetry& GetTelemetry() const;
+
+	void SetWeightOnWheels(float NewWeightOnWheels);
+
+	UFUNCTION(BlueprintCallable)
+	float GetWeightOnWheels() const;
+
+	// Created on first request, so helicopters nobody displays don't pay for notifications
+	UFUNCTION(BlueprintCallable)
+	UHelicopterTelemetryViewModel* GetTelemetryViewModel();
+
+	// Puts collective, pending rotation, cargo and physics velocities back to their initial values
+	UFUNCTION(BlueprintCallable)
+	void ResetMovementState();
+
 	virtual void UpdateComponentVelocity() override;
 
 	virtual void InitializeComponent() override;
 
+	// Tuning from helicopter definition if it's set, or from inline data otherwise
+	const FPhysicsData& GetPhysicsData() const;
+
+	const FCollectiveData& GetCollectiveData() const;
+
+	const FRotationData& GetRotationData() const;
+
+	FPrimaryAssetId GetHelicopterDefinitionId() const;
+
+	// Definition and curves shared by every helicopter of the model, for memory reports
+	void GetSharedFlightObjects(TArray<UObject*>& OutObjects) const;
+
+	// Flight equations with tuning of the helicopter and air at its current altitude.
+	// Model references tuning of the component, don't keep it longer than the component lives
+	FHelicopterFlightModel MakeFlightModel() const;
+
+	// Baked steady flight states, null if helicopter has no definition or it's not loaded yet
+	const FHelicopterFlightEnvelope* GetFlightEnvelope() const;
+
+	// Helicopter doesn't move until its definition and curves are loaded
+	UFUNCTION(BlueprintCallable)
+	bool IsFlightDataReady() const;
+
+	// Helicopter is tracked from BeginPlay, pooled helicopters are removed while they are in pool
+	void SetTrackedInSpatialHash(bool bTracked);
+
+	int32 GetSpatialHashHandle() const;
+
 protected:
+
+	// Shared tuning of the helicopter model. Inline data below is used when it's not set
+	UPROPERTY(EditAnywhere, meta=(AllowedTypes="HelicopterDefinition"))
+	FPrimaryAssetId HelicopterDefinitionId {};
 	
 	UPROPERTY(EditAnywhere)
 	FPhysicsData PhysicsData {};
@@ -180,43 +400,110 @@ protected:
 	UPROPERTY(EditAnywhere)
 	FRotationData RotationData {};
 
+	UPROPERTY(VisibleAnywhere, Transient)
+	FHelicopterMovementState MovementState {};
+
+	UPROPERTY(VisibleAnywhere, Transient)
+	FHelicopterTelemetry Telemetry {};
+
 	// Use it to correct calculated altitude
 	// e.g. center of heli object is not on ground level, but inside a heli so it adds a couple of meters
 	// when it should not
 	// Negative altitude is being clamped, feel free to use negative values here 
 	UPROPERTY(EditAnywhere)
 	float AltitudeOffset { 0.f };
+
+	// Seconds between ground traces when they are scheduled, altitude follows vertical movement in between
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.01))
+	float AltitudeMaxStaleness { 0.1f };
+
+	// Seconds between telemetry view model updates when they are scheduled, telemetry itself is updated every step
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.01))
+	float TelemetryViewModelMaxStaleness { 0.1f };
 	
 	virtual void BeginPlay() override;
 
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
 	UFUNCTION(CallInEditor, Category="Utils")
 	void CalculateForceNeededToStartGoingUp() const;
 
 private:
-	
-	float CalculateForceAmountBasedOnCollective() const;
-	FVector CalculateCurrentCollectiveAccelerationVector() const;
+
+	UPROPERTY(Transient)
+	TObjectPtr<UHelicopterDefinition> HelicopterDefinition {};
+
+	UPROPERTY(Transient)
+	FHelicopterFlightCurves FlightCurves {};
+
+	UPROPERTY(Transient)
+	TObjectPtr<UHelicopterTelemetryViewModel> TelemetryViewModel {};
+
+	TSharedPtr<FStreamableHandle> FlightDataHandle {};
+
+	bool bIsFlightDataReady { false };
+
+	int32 SpatialHashHandle { INDEX_NONE };
+
+	bool bDrivenByLockstep { false };
+
+	FHelicopterPhysicsStepCallback* PhysicsStepCallback { nullptr };
+
+	uint32 StateHash { 0 };
+
+	void ApplyCollectiveInput(float DeltaTime);
+
+	void RequestFlightData();
+
+	void OnFlightDataLoaded();
 	
 	void UpdateVelocity(float DeltaTime);
 
-	void ApplyGravityToVelocity(float DeltaTime);
-	
-	void ApplyAccelerationsToVelocity(float DeltaTime);
+	void UpdateAngularVelocity(float DeltaTime);
 
-	void ApplyVelocityDamping(float DeltaTime);
-	
-	void ClampVelocityToMaxSpeed();
+	// Pending roll, pitch and yaw in the order FHelicopterFlightModel::StepLocalAngularVelocity takes them
+	FVector GetRotationInput() const;
 
-	float GetCurrentAngle() const;
+	// Hands the frame to physics steps, must run before collective input moves current collective
+	void QueuePhysicsStep();
 
-	void UpdateAngularVelocity(float DeltaTime);
+	bool bMassPropertiesDirty { false };
+
+	int32 NextCargoHandle { 0 };
 
-	bool ApplyAccelerationsToAngularVelocity(float DeltaTime);
+	// Inertia of the body per kg with its own scale applied and its nudge, captured before the first cargo commit
+	FVector BaseInertiaPerKg { FVector::ZeroVector };
 
-	void ApplyAngularVelocityDamping(float DeltaTime);
+	// The same inertia before the body's own InertiaTensorScale, it's what a new scale multiplies
+	FVector BaseUnscaledInertiaPerKg { FVector::ZeroVector };
 
-	void ClampAngularVelocity();
+	FVector BaseCOMNudge { FVector::ZeroVector };
 
+	void RecalculateAdditionalMass();
+
+	// Mass, center of mass and inertia of all cargo changes since the last step in a single body update
 	void SyncPhysicsAndComponentMass();
+
+	void UpdateSpatialHash();
+
+	float TraceAltitude() const;
+
+	int32 AltitudeJobHandle { INDEX_NONE };
+
+	float TracedAltitude { 0.f };
+
+	// Height helicopter was at when ground was traced last time
+	double TracedZ { 0.0 };
+
+	bool bHasTracedAltitude { false };
+
+	void UpdateTracedAltitude();
+
+	// Last traced altitude corrected by the climb since then, traces right away when there is no trace yet
+	float EstimateAltitude();
+
+	int32 TelemetryJobHandle { INDEX_NONE };
+
+	void UpdateTelemetry();
 	
 };
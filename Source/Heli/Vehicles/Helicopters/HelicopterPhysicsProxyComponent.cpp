@@ -0,0 +1,53 @@
+﻿#include "HelicopterPhysicsProxyComponent.h"
+
+#include "AnimationRuntime.h"
+#include "Engine/SkeletalMesh.h"
+#include "PhysicsEngine/PhysicsAsset.h"
+#include "PhysicsEngine/SkeletalBodySetup.h"
+
+UHelicopterPhysicsProxyComponent::UHelicopterPhysicsProxyComponent()
+{
+	// Proxy is registered by AHelicopter only if it's really used
+	bAutoRegister = false;
+
+	PrimaryComponentTick.bCanEverTick = false;
+
+	SetCollisionProfileName(TEXT("NoCollision"));
+	SetGenerateOverlapEvents(false);
+	// Only used when helicopter has no mesh to fit it to
+	SetBoxExtent({ 900.f, 200.f, 200.f }, false);
+}
+
+bool UHelicopterPhysicsProxyComponent::FitToMesh(const USkeletalMesh* Mesh, FVector& OutCenter)
+{
+	OutCenter = FVector::ZeroVector;
+
+	if(!Mesh)
+		return false;
+
+	FBox Box { ForceInit };
+
+	// Space the mesh was simulated in so far, rotor blades and antennas usually have no bodies
+	if(const UPhysicsAsset* PhysicsAsset = Mesh->GetPhysicsAsset())
+	{
+		const FReferenceSkeleton& RefSkeleton = Mesh->GetRefSkeleton();
+
+		for(const USkeletalBodySetup* BodySetup : PhysicsAsset->SkeletalBodySetups)
+		{
+			const int32 BoneIndex = BodySetup ? RefSkeleton.FindBoneIndex(BodySetup->BoneName) : INDEX_NONE;
+			if(BoneIndex == INDEX_NONE)
+				continue;
+
+			const FTransform BoneTransform = FAnimationRuntime::GetComponentSpaceTransformRefPose(RefSkeleton, BoneIndex);
+			Box += BodySetup->AggGeom.CalcAABB(BoneTransform);
+		}
+	}
+
+	if(!Box.IsValid)
+		Box = Mesh->GetImportedBounds().GetBox();
+
+	OutCenter = Box.GetCenter();
+	SetBoxExtent(Box.GetExtent(), false);
+
+	return true;
+}
@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/BoxComponent.h"
+#include "HelicopterPhysicsProxyComponent.generated.h"
+
+class USkeletalMesh;
+
+/**
+ * Simple rigid body that is simulated instead of helicopter skeletal mesh when AHelicopter::bUsePhysicsProxy is set.
+ * Skeletal mesh is attached to it and only used for visuals then. The box is fitted to the mesh it replaces.
+ */
+UCLASS(
+	ClassGroup=(Custom),
+	HideCategories=(ComponentTick, Navigation, ComponentReplication, Activation, Cooking, Replication),
+	meta=(BlueprintSpawnableComponent)
+)
+class HELI_API UHelicopterPhysicsProxyComponent : public UBoxComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	UHelicopterPhysicsProxyComponent();
+
+	// Sizes the box around bodies of the mesh physics asset in reference pose, or around the whole mesh without one.
+	// OutCenter is center of the box in mesh space. Returns false and keeps the extent when there is no mesh
+	bool FitToMesh(const USkeletalMesh* Mesh, FVector& OutCenter);
+};
@@ -0,0 +1,57 @@
+﻿#include "HelicopterPhysicsStepCallback.h"
+
+#include "HelicopterFlightModel.h"
+#include "PhysicsProxy/SingleParticlePhysicsProxy.h"
+
+void FHelicopterPhysicsStepCallback::OnPreSimulate_Internal()
+{
+	const FHelicopterPhysicsStepInput* Input = GetConsumerInput_Internal();
+	if(!Input)
+		return;
+
+	const float DeltaTime = GetDeltaTime_Internal();
+
+	if(Input->Frame != Frame)
+	{
+		Frame = Input->Frame;
+
+		Collectives.Reset(Input->Helicopters.Num());
+		for(const FHelicopterPhysicsStep& Step : Input->Helicopters)
+		{
+			Collectives.Add(Step.Collective);
+		}
+	}
+
+	for(int32 Index = 0; Index < Input->Helicopters.Num(); ++Index)
+	{
+		const FHelicopterPhysicsStep& Step = Input->Helicopters[Index];
+
+		Chaos::FRigidBodyHandle_Internal* Body = Step.Proxy ? Step.Proxy->GetPhysicsThreadAPI() : nullptr;
+		if(!Body || Body->ObjectState() != Chaos::EObjectStateType::Dynamic)
+			continue;
+
+		// Same order as StepSimulation: collective, velocity, then rotation
+		float& Collective = Collectives[Index];
+		Collective = FMath::Clamp(Collective + Step.CollectiveSpeed * DeltaTime, 0.f, 1.f);
+
+		const FHelicopterFlightModel Model { *Step.PhysicsData, *Step.Curves, Step.Atmosphere };
+		const FQuat Rotation = Body->R();
+
+		const FVector Velocity = Model.StepVelocity(Body->V(), Rotation.GetAxisZ(), Collective, Step.MassKg, DeltaTime);
+		Body->SetV(Velocity);
+
+		// Chaos keeps angular velocity in radians
+		const FVector LocalAngularVelocity = Rotation.UnrotateVector(FMath::RadiansToDegrees(FVector(Body->W())));
+
+		const FVector NewLocalAngularVelocity = Model.StepLocalAngularVelocity(
+			LocalAngularVelocity,
+			Step.RotationInput,
+			*Step.RotationData,
+			Step.WeightOnWheels,
+			Velocity.Size2D(),
+			DeltaTime
+		);
+
+		Body->SetW(FMath::DegreesToRadians(Rotation.RotateVector(NewLocalAngularVelocity)));
+	}
+}
@@ -0,0 +1,74 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Chaos/SimCallbackInput.h"
+#include "Chaos/SimCallbackObject.h"
+#include "HelicopterAtmosphere.h"
+#include "HelicopterMovementComponent.h"
+
+namespace Chaos
+{
+	class FSingleParticlePhysicsProxy;
+}
+
+// Everything a physics step needs to fly one helicopter, taken once per frame on game thread
+struct FHelicopterPhysicsStep
+{
+	Chaos::FSingleParticlePhysicsProxy* Proxy { nullptr };
+
+	// Owned by the movement component and its definition. Physics isn't async, it's done with them within the frame
+	const FPhysicsData* PhysicsData { nullptr };
+	const FRotationData* RotationData { nullptr };
+	const FHelicopterFlightCurves* Curves { nullptr };
+
+	FHelicopterAtmosphereSample Atmosphere {};
+
+	// At the start of the frame
+	float Collective { 0.f };
+
+	// Collective change per second, input times its increase or decrease speed
+	float CollectiveSpeed { 0.f };
+
+	float MassKg { 0.f };
+
+	float WeightOnWheels { 0.f };
+
+	// Roll, pitch and yaw input held for every step of the frame
+	FVector RotationInput { FVector::ZeroVector };
+};
+
+struct FHelicopterPhysicsStepInput : public Chaos::FSimCallbackInput
+{
+	// Substeps of a frame share the input, a new frame number starts collectives over
+	uint64 Frame { 0 };
+
+	TArray<FHelicopterPhysicsStep> Helicopters {};
+
+	void Reset()
+	{
+		Frame = 0;
+		Helicopters.Reset();
+	}
+};
+
+/**
+ * Flies helicopters on physics thread before every physics step, so each step starts from the pose and velocity
+ * the previous one left instead of all of them from the pose of the frame. Registered by
+ * UHelicopterTimeCompressionSubsystem while physics substeps compressed frames, helicopters queue themselves
+ * with UHelicopterMovementComponent::StepSimulation then and don't set velocities on game thread.
+ */
+class HELI_API FHelicopterPhysicsStepCallback : public Chaos::TSimCallbackObject<FHelicopterPhysicsStepInput>
+{
+public:
+
+	virtual void OnPreSimulate_Internal() override;
+
+private:
+
+	// Frame of the input the collectives belong to
+	uint64 Frame { 0 };
+
+	// Per helicopter of the input, moved by every step with the held collective input
+	TArray<float> Collectives {};
+
+};
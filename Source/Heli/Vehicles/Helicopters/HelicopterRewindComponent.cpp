@@ -0,0 +1,210 @@
+﻿#include "HelicopterRewindComponent.h"
+
+#include "Helicopter.h"
+#include "Heli/HeliStats.h"
+#include "Heli/Subsystems/HelicopterSpatialHashSubsystem.h"
+
+DECLARE_CYCLE_STAT(TEXT("Rewind Record"), STAT_HeliRewindRecord, STATGROUP_Heli);
+
+UHelicopterRewindComponent::UHelicopterRewindComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+
+	// Record transforms physics has ended up with
+	PrimaryComponentTick.TickGroup = TG_PostPhysics;
+	PrimaryComponentTick.EndTickGroup = TG_PostPhysics;
+}
+
+void UHelicopterRewindComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if(!ShouldRecord())
+	{
+		SetComponentTickEnabled(false);
+		return;
+	}
+
+	const int32 Capacity = FMath::CeilToInt32(HistorySeconds * SampleRate) + 1;
+	Samples.SetNum(Capacity);
+
+	ResetHistory();
+}
+
+void UHelicopterRewindComponent::TickComponent(float DeltaTime, ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	SCOPE_CYCLE_COUNTER(STAT_HeliRewindRecord);
+
+	const double Time = GetWorld()->GetTimeSeconds();
+	if(Time < NextSampleTime)
+		return;
+
+	RecordSample(Time);
+
+	// Keep the rate even if frame took longer than a sample interval, there is no reason to catch up
+	NextSampleTime = FMath::Max(NextSampleTime + 1.0 / SampleRate, Time);
+}
+
+bool UHelicopterRewindComponent::ShouldRecord() const
+{
+	return !bRecordOnServerOnly || GetNetMode() != NM_Client;
+}
+
+bool UHelicopterRewindComponent::GetSampleAtTime(double Time, FHelicopterRewindSample& OutSample) const
+{
+	if(NumSamples == 0)
+		return false;
+
+	const FHelicopterRewindSample& Oldest = GetSample(0);
+	const FHelicopterRewindSample& Newest = GetSample(NumSamples - 1);
+
+	if(Time <= Oldest.Time)
+	{
+		OutSample = Oldest;
+		return true;
+	}
+
+	if(Time >= Newest.Time)
+	{
+		OutSample = Newest;
+		return true;
+	}
+
+	// Find the first sample that is newer than the time
+	int32 Low = 1;
+	int32 High = NumSamples - 1;
+	while(Low < High)
+	{
+		const int32 Middle = (Low + High) / 2;
+		if(GetSample(Middle).Time > Time)
+			High = Middle;
+		else
+			Low = Middle + 1;
+	}
+
+	const FHelicopterRewindSample& Before = GetSample(Low - 1);
+	const FHelicopterRewindSample& After = GetSample(Low);
+
+	const double Interval = After.Time - Before.Time;
+	const float Alpha = Interval > UE_DOUBLE_SMALL_NUMBER ? static_cast<float>((Time - Before.Time) / Interval) : 0.f;
+
+	// Hermite curve through both samples using their velocities, plain lerp cuts corners at high speed
+	OutSample.Time = Time;
+	OutSample.Location = FMath::CubicInterp(
+		Before.Location,
+		Before.LinearVelocity * Interval,
+		After.Location,
+		After.LinearVelocity * Interval,
+		Alpha
+	);
+	OutSample.Rotation = FQuat::Slerp(Before.Rotation, After.Rotation, Alpha);
+	OutSample.LinearVelocity = FMath::Lerp(Before.LinearVelocity, After.LinearVelocity, Alpha);
+	OutSample.AngularVelocity = FMath::Lerp(Before.AngularVelocity, After.AngularVelocity, Alpha);
+
+	return true;
+}
+
+double UHelicopterRewindComponent::GetOldestSampleTime() const
+{
+	return NumSamples > 0 ? GetSample(0).Time : 0.0;
+}
+
+void UHelicopterRewindComponent::ResetHistory()
+{
+	Head = 0;
+	NumSamples = 0;
+	NextSampleTime = 0.0;
+}
+
+void UHelicopterRewindComponent::GatherInRadius(const UWorld* World, const FVector& Location, float Radius,
+	double Time, TArray<UHelicopterRewindComponent*>& OutComponents)
+{
+	OutComponents.Reset();
+
+	const UHelicopterSpatialHashSubsystem* SpatialHash = World ? World->GetSubsystem<UHelicopterSpatialHashSubsystem>() : nullptr;
+	if(!SpatialHash)
+		return;
+
+	// Helicopter might have been in the radius back then while being outside of it now
+	const double Elapsed = FMath::Max(World->GetTimeSeconds() - Time, 0.0);
+	const float SearchRadius = Radius + SpatialHash->GetMaxTrackedSpeed() * Elapsed;
+	
+	TArray<AHelicopter*> Helicopters {};
+	SpatialHash->FindHelicoptersInRadius(Location, SearchRadius, Helicopters);
+
+	for(const AHelicopter* Helicopter : Helicopters)
+	{
+		if(UHelicopterRewindComponent* Component = Helicopter->FindComponentByClass<UHelicopterRewindComponent>())
+			OutComponents.Add(Component);
+	}
+}
+
+const FHelicopterRewindSample& UHelicopterRewindComponent::GetSample(int32 LogicalIndex) const
+{
+	return Samples[(Head + LogicalIndex) % Samples.Num()];
+}
+
+void UHelicopterRewindComponent::RecordSample(double Time)
+{
+	const USceneComponent* Root = GetOwner()->GetRootComponent();
+	if(!Root || Samples.IsEmpty())
+		return;
+
+	int32 Index;
+	if(NumSamples < Samples.Num())
+	{
+		Index = (Head + NumSamples) % Samples.Num();
+		++NumSamples;
+	}
+	else
+	{
+		// Overwrite the oldest one
+		Index = Head;
+		Head = (Head + 1) % Samples.Num();
+	}
+
+	FHelicopterRewindSample& Sample = Samples[Index];
+	Sample.Time = Time;
+	Sample.Location = Root->GetComponentLocation();
+	Sample.Rotation = Root->GetComponentQuat();
+	Sample.LinearVelocity = Root->GetComponentVelocity();
+
+	const UPrimitiveComponent* Primitive = Cast<UPrimitiveComponent>(Root);
+	Sample.AngularVelocity = Primitive ? Primitive->GetPhysicsAngularVelocityInDegrees() : FVector::ZeroVector;
+}
+
+FScopedHelicopterRewind::FScopedHelicopterRewind(TConstArrayView<UHelicopterRewindComponent*> Components, double Time)
+{
+	RewoundComponents.Reserve(Components.Num());
+	
+	for(const UHelicopterRewindComponent* Component : Components)
+	{
+		if(!Component)
+			continue;
+		
+		USceneComponent* Root = Component->GetOwner()->GetRootComponent();
+
+		FHelicopterRewindSample Sample {};
+		if(!Root || !Component->GetSampleAtTime(Time, Sample))
+			continue;
+
+		RewoundComponents.Add({ Root, Root->GetComponentTransform() });
+
+		// Teleport keeps velocities, so simulation continues as if nothing happened once we are back
+		Root->SetWorldLocationAndRotation(Sample.Location, Sample.Rotation, false, nullptr, ETeleportType::TeleportPhysics);
+	}
+}
+
+FScopedHelicopterRewind::~FScopedHelicopterRewind()
+{
+	for(const FRewoundComponent& Rewound : RewoundComponents)
+	{
+		if(USceneComponent* Root = Rewound.Root.Get())
+		{
+			Root->SetWorldTransform(Rewound.Transform, false, nullptr, ETeleportType::TeleportPhysics);
+		}
+	}
+}
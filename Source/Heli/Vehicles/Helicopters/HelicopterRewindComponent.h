@@ -0,0 +1,127 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "HelicopterRewindComponent.generated.h"
+
+USTRUCT(BlueprintType)
+struct FHelicopterRewindSample
+{
+	GENERATED_BODY()
+
+	// Server world time in seconds
+	UPROPERTY(BlueprintReadOnly)
+	double Time { 0.0 };
+
+	UPROPERTY(BlueprintReadOnly)
+	FVector Location { FVector::ZeroVector };
+
+	UPROPERTY(BlueprintReadOnly)
+	FQuat Rotation { FQuat::Identity };
+
+	UPROPERTY(BlueprintReadOnly)
+	FVector LinearVelocity { FVector::ZeroVector };
+
+	// Degrees per second
+	UPROPERTY(BlueprintReadOnly)
+	FVector AngularVelocity { FVector::ZeroVector };
+};
+
+/**
+ * Remembers where helicopter has been for the last HistorySeconds, so server can validate hits
+ * against the place helicopter was at when client fired.
+ * History is a ring buffer allocated once, sampled with a fixed rate regardless of frame rate.
+ */
+UCLASS(
+	ClassGroup=(Custom),
+	meta=(BlueprintSpawnableComponent),
+	HideCategories=(ComponentReplication, Replication, ComponentTick, Activation)
+)
+class HELI_API UHelicopterRewindComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	UHelicopterRewindComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Interpolates history at the time. Time is clamped to the oldest sample we still have
+	UFUNCTION(BlueprintCallable)
+	bool GetSampleAtTime(double Time, FHelicopterRewindSample& OutSample) const;
+
+	UFUNCTION(BlueprintCallable)
+	double GetOldestSampleTime() const;
+
+	UFUNCTION(BlueprintCallable)
+	void ResetHistory();
+
+	// False on clients when history is recorded on server only, tick must stay off then
+	bool ShouldRecord() const;
+
+	// Components of helicopters that might have been in the radius at the time
+	static void GatherInRadius(
+		const UWorld* World,
+		const FVector& Location,
+		float Radius,
+		double Time,
+		TArray<UHelicopterRewindComponent*>& OutComponents
+	);
+
+protected:
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.1))
+	float HistorySeconds { 1.f };
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=1.0))
+	float SampleRate { 60.f };
+
+	// Clients don't validate hits, history is recorded on server only
+	UPROPERTY(EditAnywhere)
+	bool bRecordOnServerOnly { true };
+
+	virtual void BeginPlay() override;
+
+private:
+
+	TArray<FHelicopterRewindSample> Samples {};
+
+	// Index of the oldest sample
+	int32 Head { 0 };
+
+	int32 NumSamples { 0 };
+
+	double NextSampleTime { 0.0 };
+
+	const FHelicopterRewindSample& GetSample(int32 LogicalIndex) const;
+
+	void RecordSample(double Time);
+
+};
+
+/**
+ * Moves helicopters to where they were at the time and puts them back when goes out of scope.
+ * Do the traces for hit validation while it's alive.
+ */
+class HELI_API FScopedHelicopterRewind
+{
+public:
+
+	FScopedHelicopterRewind(TConstArrayView<UHelicopterRewindComponent*> Components, double Time);
+
+	~FScopedHelicopterRewind();
+
+	UE_NONCOPYABLE(FScopedHelicopterRewind);
+
+private:
+
+	struct FRewoundComponent
+	{
+		TWeakObjectPtr<USceneComponent> Root {};
+		FTransform Transform {};
+	};
+
+	TArray<FRewoundComponent, TInlineAllocator<8>> RewoundComponents {};
+
+};
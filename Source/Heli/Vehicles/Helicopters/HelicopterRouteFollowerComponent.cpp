@@ -0,0 +1,204 @@
+﻿#include "HelicopterRouteFollowerComponent.h"
+
+#include "Helicopter.h"
+#include "HelicopterFlightEnvelope.h"
+#include "HelicopterMovementComponent.h"
+#include "Heli/LogHeli.h"
+#include "Heli/Components/HelicopterRouteComponent.h"
+#include "Heli/Subsystems/HelicopterSchedulerSubsystem.h"
+
+UHelicopterRouteFollowerComponent::UHelicopterRouteFollowerComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	PrimaryComponentTick.bStartWithTickEnabled = false;
+	PrimaryComponentTick.TickGroup = TG_PrePhysics;
+}
+
+void UHelicopterRouteFollowerComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	const AHelicopter* Helicopter = Cast<AHelicopter>(GetOwner());
+	HelicopterMovementComponent = Helicopter ? Helicopter->GetHelicopterMovementComponent() : nullptr;
+
+	if(!HelicopterMovementComponent)
+	{
+		HELI_ERR("Route follower of %s has no helicopter movement to control", *GetNameSafe(GetOwner()));
+		return;
+	}
+
+	// Inputs have to be there before movement consumes them
+	HelicopterMovementComponent->PrimaryComponentTick.AddPrerequisite(this, PrimaryComponentTick);
+
+	if(UHelicopterSchedulerSubsystem* Scheduler = GetWorld()->GetSubsystem<UHelicopterSchedulerSubsystem>())
+	{
+		RouteLookupJobHandle = Scheduler->RegisterJob(GetOwner(), RouteLookupMaxStaleness, [this](float TimeSinceLastRun)
+		{
+			if(IsComponentTickEnabled() && IsRouteLookupScheduled())
+				UpdateRouteDistance(TimeSinceLastRun);
+		});
+	}
+}
+
+void UHelicopterRouteFollowerComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if(UHelicopterSchedulerSubsystem* Scheduler = GetWorld()->GetSubsystem<UHelicopterSchedulerSubsystem>())
+		Scheduler->UnregisterJob(RouteLookupJobHandle);
+
+	RouteLookupJobHandle = INDEX_NONE;
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UHelicopterRouteFollowerComponent::SetRoute(UHelicopterRouteComponent* NewRoute, float StartDistance)
+{
+	Route = NewRoute;
+	RouteDistance = Route ? Route->NormalizeRouteDistance(StartDistance) : 0.f;
+
+	SetComponentTickEnabled(Route != nullptr);
+
+	// Start distance may be anywhere, don't dead reckon from it longer than a frame
+	if(UHelicopterSchedulerSubsystem* Scheduler = GetWorld() ? GetWorld()->GetSubsystem<UHelicopterSchedulerSubsystem>() : nullptr)
+		Scheduler->MarkJobStale(RouteLookupJobHandle);
+}
+
+float UHelicopterRouteFollowerComponent::GetRouteDistance() const
+{
+	return RouteDistance;
+}
+
+bool UHelicopterRouteFollowerComponent::IsRouteFinished() const
+{
+	return Route && !Route->IsClosedLoop() && RouteDistance >= Route->GetRouteLength() - UE_KINDA_SMALL_NUMBER;
+}
+
+void UHelicopterRouteFollowerComponent::TickComponent(float DeltaTime, ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	if(!Route || !HelicopterMovementComponent || !HelicopterMovementComponent->UpdatedPrimitive)
+		return;
+
+	const UPrimitiveComponent* Body = HelicopterMovementComponent->UpdatedPrimitive;
+	const FTransform BodyTransform = Body->GetComponentTransform();
+	const FVector Location = BodyTransform.GetLocation();
+	const FVector Velocity = Body->GetPhysicsLinearVelocity();
+	const float Speed = Velocity.Size();
+
+	// Between scheduled searches helicopter is assumed to follow the route
+	if(IsRouteLookupScheduled())
+	{
+		const float RouteSpeed = Velocity | Route->GetRouteDirectionAtDistance(RouteDistance);
+		RouteDistance = Route->NormalizeRouteDistance(RouteDistance + RouteSpeed * DeltaTime);
+	}
+	else
+	{
+		UpdateRouteDistance(DeltaTime);
+	}
+
+	const float LookAheadDistance = FMath::Max(Speed * LookAheadSeconds, MinLookAheadDistance);
+	const float TargetDistance = Route->IsClosedLoop()
+		? RouteDistance + LookAheadDistance
+		: FMath::Min(RouteDistance + LookAheadDistance, Route->GetRouteLength());
+	
+	const FVector TargetLocation = Route->GetRouteLocationAtDistance(TargetDistance);
+	const FVector ToTarget = TargetLocation - Location;
+
+	// Slow down to the lowest limit until the target point and stop at the end of open routes
+	float DesiredSpeed = FMath::Min(
+		Route->GetRouteSpeedLimitAtDistance(RouteDistance),
+		Route->GetRouteSpeedLimitAtDistance(TargetDistance)
+	);
+	if(!Route->IsClosedLoop())
+		DesiredSpeed = FMath::Min(DesiredSpeed, ToTarget.Size2D() / FMath::Max(LookAheadSeconds, UE_KINDA_SMALL_NUMBER));
+
+	const FVector Heading = ToTarget.Size2D() > UE_KINDA_SMALL_NUMBER
+		? ToTarget.GetSafeNormal2D()
+		: BodyTransform.GetUnitAxis(EAxis::X).GetSafeNormal2D();
+	const float ForwardSpeed = Velocity | Heading;
+
+	const float DesiredVerticalSpeed = FMath::Clamp(
+		ToTarget.Z * VerticalSpeedPerAltitudeError,
+		-MaxVerticalSpeed,
+		MaxVerticalSpeed
+	);
+
+	float TrimPitch = 0.f;
+	const float Collective = FindTargetCollective(DesiredSpeed, DesiredVerticalSpeed, Velocity.Z, TrimPitch);
+	HelicopterMovementComponent->SetCollective(Collective);
+
+	const float DesiredPitch = FMath::Clamp(
+		TrimPitch + (DesiredSpeed - ForwardSpeed) * PitchPerSpeedError,
+		-MaxPitch,
+		MaxPitch
+	);
+
+	// Tilting rotor disc towards heading by the pitch, nose down is positive
+	const float PitchRadians = FMath::DegreesToRadians(DesiredPitch);
+	const FVector DesiredUp = FVector::UpVector * FMath::Cos(PitchRadians) + Heading * FMath::Sin(PitchRadians);
+
+	// Rotation that takes current up to the desired one, in local axes
+	const FVector TiltAxis = BodyTransform.InverseTransformVectorNoScale(BodyTransform.GetUnitAxis(EAxis::Z) ^ DesiredUp);
+	const FVector LocalAngularVelocity = BodyTransform.InverseTransformVectorNoScale(Body->GetPhysicsAngularVelocityInDegrees());
+
+	const float RollError = FMath::RadiansToDegrees(FMath::Asin(FMath::Clamp(TiltAxis.X, -1.f, 1.f)));
+	const float PitchError = FMath::RadiansToDegrees(FMath::Asin(FMath::Clamp(TiltAxis.Y, -1.f, 1.f)));
+	const float YawError = FMath::FindDeltaAngleDegrees(BodyTransform.Rotator().Yaw, Heading.Rotation().Yaw);
+
+	HelicopterMovementComponent->AddRotation(
+		CalculateInput(PitchError, LocalAngularVelocity.Y),
+		CalculateInput(YawError, LocalAngularVelocity.Z),
+		CalculateInput(RollError, LocalAngularVelocity.X)
+	);
+}
+
+void UHelicopterRouteFollowerComponent::UpdateRouteDistance(float TimeSinceLastLookup)
+{
+	if(!Route || !HelicopterMovementComponent || !HelicopterMovementComponent->UpdatedPrimitive)
+		return;
+
+	const UPrimitiveComponent* Body = HelicopterMovementComponent->UpdatedPrimitive;
+	const float Speed = Body->GetPhysicsLinearVelocity().Size();
+
+	// Helicopter can't move further than a couple of lookups worth of distance, search only there
+	const float SearchRadius = Speed * TimeSinceLastLookup * 2.f + 2.f * MinLookAheadDistance;
+	RouteDistance = Route->FindRouteDistanceClosestToLocation(Body->GetComponentLocation(), RouteDistance, SearchRadius);
+}
+
+bool UHelicopterRouteFollowerComponent::IsRouteLookupScheduled() const
+{
+	return RouteLookupJobHandle != INDEX_NONE
+		&& HelicopterMovementComponent
+		&& !HelicopterMovementComponent->IsDrivenByLockstep();
+}
+
+float UHelicopterRouteFollowerComponent::FindTargetCollective(float DesiredForwardSpeed, float DesiredVerticalSpeed,
+	float VerticalSpeed, float& OutTrimPitch) const
+{
+	OutTrimPitch = 0.f;
+	float BaseCollective = HelicopterMovementComponent->GetCurrentCollective();
+
+	// Baked trim gets collective and pitch right away, feedback below only corrects what is left
+	if(const FHelicopterFlightEnvelope* Envelope = HelicopterMovementComponent->GetFlightEnvelope())
+	{
+		const float MassKg = HelicopterMovementComponent->GetActualMass();
+		float TrimCollective = 0.f;
+
+		if(Envelope->FindTrim(MassKg, DesiredForwardSpeed, OutTrimPitch, TrimCollective))
+			BaseCollective = TrimCollective;
+		else if(Envelope->IsValid())
+		{
+			// Helicopter that can't hover at the mass needs everything it has
+			const float HoverCollective = Envelope->GetHoverCollective(MassKg);
+			BaseCollective = HoverCollective >= 0.f ? HoverCollective : 1.f;
+		}
+	}
+
+	return FMath::Clamp(BaseCollective + (DesiredVerticalSpeed - VerticalSpeed) * CollectivePerVerticalSpeedError, 0.f, 1.f);
+}
+
+float UHelicopterRouteFollowerComponent::CalculateInput(float AngleError, float AngularVelocity) const
+{
+	return FMath::Clamp((AngleError - AngularVelocity * AngularLeadSeconds) / FullInputAngle, -1.f, 1.f);
+}
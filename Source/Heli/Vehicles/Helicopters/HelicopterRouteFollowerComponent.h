@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "HelicopterRouteFollowerComponent.generated.h"
+
+class UHelicopterMovementComponent;
+class UHelicopterRouteComponent;
+
+/**
+ * Flies helicopter along UHelicopterRouteComponent by feeding collective and rotation to its movement component.
+ * Route progress is tracked incrementally and all route lookups are table reads, so following costs the same
+ * for any route length. With UHelicopterSchedulerSubsystem the closest point search runs as a scheduled job
+ * and progress is advanced by velocity along the route in between.
+ * Pitch and collective start from baked trim of the helicopter definition when it has one.
+ */
+UCLASS(
+	ClassGroup=(Custom),
+	meta=(BlueprintSpawnableComponent),
+	HideCategories=(ComponentReplication, Replication, ComponentTick, Activation)
+)
+class HELI_API UHelicopterRouteFollowerComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	UHelicopterRouteFollowerComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Starts following from the point of the route closest to StartDistance. Null route stops following
+	UFUNCTION(BlueprintCallable)
+	void SetRoute(UHelicopterRouteComponent* NewRoute, float StartDistance = 0.f);
+
+	UFUNCTION(BlueprintCallable)
+	float GetRouteDistance() const;
+
+	// Helicopter reached the end of an open route and hovers there
+	UFUNCTION(BlueprintCallable)
+	bool IsRouteFinished() const;
+
+protected:
+
+	// Target point is this far ahead in time along the route
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float LookAheadSeconds { 2.f };
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float MinLookAheadDistance { 1500.f };
+
+	// Nose down pitch added per cm/s of missing speed
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float PitchPerSpeedError { 0.02f };
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0, ClampMax=60.0))
+	float MaxPitch { 20.f };
+
+	// Collective added per cm/s of missing vertical speed
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float CollectivePerVerticalSpeedError { 0.0005f };
+
+	// Vertical speed requested per cm of altitude error
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float VerticalSpeedPerAltitudeError { 0.5f };
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float MaxVerticalSpeed { 800.f };
+
+	// Angle error in degrees that gives full rotation input
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.1))
+	float FullInputAngle { 15.f };
+
+	// Current angular velocity is subtracted with this lead, so rotation slows down before reaching the target
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float AngularLeadSeconds { 0.3f };
+
+	// Seconds between closest point searches when they are scheduled
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.01))
+	float RouteLookupMaxStaleness { 0.25f };
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+
+	UPROPERTY(Transient)
+	TObjectPtr<UHelicopterRouteComponent> Route {};
+
+	UPROPERTY(Transient)
+	TObjectPtr<UHelicopterMovementComponent> HelicopterMovementComponent {};
+
+	float RouteDistance { 0.f };
+
+	int32 RouteLookupJobHandle { INDEX_NONE };
+
+	// Searches for the closest route point around the current route distance
+	void UpdateRouteDistance(float TimeSinceLastLookup);
+
+	// Lockstep helicopters search every tick, like they trace ground every step
+	bool IsRouteLookupScheduled() const;
+
+	float FindTargetCollective(float DesiredForwardSpeed, float DesiredVerticalSpeed, float VerticalSpeed, float& OutTrimPitch) const;
+
+	float CalculateInput(float AngleError, float AngularVelocity) const;
+
+};
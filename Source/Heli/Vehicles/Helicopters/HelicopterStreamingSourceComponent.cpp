@@ -0,0 +1,95 @@
+﻿#include "HelicopterStreamingSourceComponent.h"
+
+#include "Helicopter.h"
+#include "Engine/World.h"
+#include "WorldPartition/WorldPartitionSubsystem.h"
+
+UHelicopterStreamingSourceComponent::UHelicopterStreamingSourceComponent()
+{
+	// Source is pulled by World Partition when it updates streaming, there is nothing to tick
+	PrimaryComponentTick.bCanEverTick = false;
+}
+
+void UHelicopterStreamingSourceComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	if(UWorldPartitionSubsystem* WorldPartitionSubsystem = GetWorld()->GetSubsystem<UWorldPartitionSubsystem>())
+	{
+		WorldPartitionSubsystem->RegisterStreamingSourceProvider(this);
+		bIsRegistered = true;
+	}
+}
+
+void UHelicopterStreamingSourceComponent::EndPlay(const EEndPlayReason::Type EndPlayReason)
+{
+	if(bIsRegistered)
+	{
+		if(UWorldPartitionSubsystem* WorldPartitionSubsystem = GetWorld()->GetSubsystem<UWorldPartitionSubsystem>())
+			WorldPartitionSubsystem->UnregisterStreamingSourceProvider(this);
+
+		bIsRegistered = false;
+	}
+
+	Super::EndPlay(EndPlayReason);
+}
+
+void UHelicopterStreamingSourceComponent::SetStreamingSourceEnabled(bool bEnabled)
+{
+	bStreamingSourceEnabled = bEnabled;
+}
+
+bool UHelicopterStreamingSourceComponent::GetStreamingSource(FWorldPartitionStreamingSource& StreamingSource) const
+{
+	const AHelicopter* Helicopter = Cast<AHelicopter>(GetOwner());
+	if(!bStreamingSourceEnabled || !Helicopter || Helicopter->IsInPool())
+		return false;
+
+	if(bPlayerControlledOnly && !Helicopter->IsPlayerControlled())
+		return false;
+
+	const FVector Velocity = Helicopter->GetVelocity();
+	const float Speed = Velocity.Size();
+
+	// Altitude is cached by movement component, this doesn't trace
+	const float LoadingRangeScale = CalculateLoadingRangeScale(Speed, Helicopter->GetAltitude());
+
+	StreamingSource.Name = Helicopter->GetFName();
+	StreamingSource.Location = Helicopter->GetActorLocation();
+	StreamingSource.TargetState = EStreamingSourceTargetState::Activated;
+	StreamingSource.bBlockOnSlowLoading = false;
+	StreamingSource.Priority = Speed >= HighPrioritySpeed ? EStreamingSourcePriority::High : EStreamingSourcePriority::Normal;
+
+	// Shape locations are relative to source rotation, so facing velocity puts look ahead shapes on X axis
+	const bool bLookAhead = Speed >= MinLookAheadSpeed && NumLookAheadShapes > 0 && LookAheadSeconds > 0.f;
+	StreamingSource.Rotation = bLookAhead ? Velocity.Rotation() : Helicopter->GetActorRotation();
+
+	StreamingSource.Shapes.Reset();
+
+	FStreamingSourceShape& AroundShape = StreamingSource.Shapes.AddDefaulted_GetRef();
+	AroundShape.bUseGridLoadingRange = true;
+	AroundShape.LoadingRangeScale = LoadingRangeScale;
+
+	if(!bLookAhead)
+		return true;
+
+	const float LookAheadDistance = Speed * LookAheadSeconds;
+
+	for(int32 Index = 1; Index <= NumLookAheadShapes; ++Index)
+	{
+		FStreamingSourceShape& Shape = StreamingSource.Shapes.AddDefaulted_GetRef();
+		Shape.bUseGridLoadingRange = true;
+		Shape.LoadingRangeScale = LoadingRangeScale;
+		Shape.Location = FVector(LookAheadDistance * Index / NumLookAheadShapes, 0.f, 0.f);
+	}
+
+	return true;
+}
+
+float UHelicopterStreamingSourceComponent::CalculateLoadingRangeScale(float Speed, float Altitude) const
+{
+	const float SpeedAlpha = FMath::Clamp(Speed / SpeedForMaxScale, 0.f, 1.f);
+	const float AltitudeAlpha = FMath::Clamp(Altitude / AltitudeForMaxScale, 0.f, 1.f);
+
+	return FMath::Lerp(1.f, MaxLoadingRangeScale, FMath::Max(SpeedAlpha, AltitudeAlpha));
+}
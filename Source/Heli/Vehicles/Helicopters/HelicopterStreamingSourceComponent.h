@@ -0,0 +1,77 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "Heli/BFLs/HeliConversionsLibrary.h"
+#include "WorldPartition/WorldPartitionStreamingSource.h"
+#include "HelicopterStreamingSourceComponent.generated.h"
+
+/**
+ * World Partition streaming source that looks ahead of the helicopter.
+ * Besides the shape around helicopter it puts shapes along current velocity, so cells on the way
+ * are requested LookAheadSeconds before helicopter gets there. Shapes grow with speed and altitude,
+ * since from above and at speed helicopter sees much further than a character.
+ */
+UCLASS(
+	ClassGroup=(Custom),
+	meta=(BlueprintSpawnableComponent),
+	HideCategories=(ComponentReplication, Replication, ComponentTick, Activation)
+)
+class HELI_API UHelicopterStreamingSourceComponent : public UActorComponent, public IWorldPartitionStreamingSourceProvider
+{
+	GENERATED_BODY()
+
+public:
+
+	UHelicopterStreamingSourceComponent();
+
+	virtual bool GetStreamingSource(FWorldPartitionStreamingSource& StreamingSource) const override;
+
+	UFUNCTION(BlueprintCallable)
+	void SetStreamingSourceEnabled(bool bEnabled);
+
+protected:
+
+	// How far in time ahead cells are requested
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float LookAheadSeconds { 4.f };
+
+	// Shapes spread evenly along the look ahead distance
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0, ClampMax=8))
+	int32 NumLookAheadShapes { 2 };
+
+	// Below this speed helicopter only loads around itself
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float MinLookAheadSpeed { UHeliConversionsLibrary::KmhToCms(30.f) };
+
+	// Loading range scale reached at SpeedForMaxScale or AltitudeForMaxScale, whichever gives more
+	UPROPERTY(EditAnywhere, meta=(ClampMin=1.0))
+	float MaxLoadingRangeScale { 2.5f };
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=1.0))
+	float SpeedForMaxScale { UHeliConversionsLibrary::KmhToCms(300.f) };
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=1.0))
+	float AltitudeForMaxScale { 1500.f * 100.f }; // 1.5 kilometers
+
+	// Fast helicopter gets its cells before the ones around slow sources
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float HighPrioritySpeed { UHeliConversionsLibrary::KmhToCms(150.f) };
+
+	// AI helicopters should not pull the world around them
+	UPROPERTY(EditAnywhere)
+	bool bPlayerControlledOnly { true };
+
+	virtual void BeginPlay() override;
+
+	virtual void EndPlay(const EEndPlayReason::Type EndPlayReason) override;
+
+private:
+
+	bool bStreamingSourceEnabled { true };
+
+	bool bIsRegistered { false };
+
+	float CalculateLoadingRangeScale(float Speed, float Altitude) const;
+
+};
@@ -0,0 +1,202 @@
+﻿#include "HelicopterTrajectoryPredictorComponent.h"
+
+#include "Helicopter.h"
+#include "HelicopterFlightModel.h"
+#include "HelicopterMovementComponent.h"
+#include "Engine/World.h"
+#include "Heli/HeliStats.h"
+#include "Heli/LogHeli.h"
+
+DECLARE_CYCLE_STAT(TEXT("Trajectory Prediction"), STAT_HeliTrajectoryPrediction, STATGROUP_Heli);
+
+UHelicopterTrajectoryPredictorComponent::UHelicopterTrajectoryPredictorComponent()
+{
+	PrimaryComponentTick.bCanEverTick = true;
+	// Predict from the state physics has just produced
+	PrimaryComponentTick.TickGroup = TG_PostPhysics;
+}
+
+void UHelicopterTrajectoryPredictorComponent::BeginPlay()
+{
+	Super::BeginPlay();
+
+	const AHelicopter* Helicopter = Cast<AHelicopter>(GetOwner());
+	HelicopterMovementComponent = Helicopter ? Helicopter->GetHelicopterMovementComponent() : nullptr;
+
+	if(!HelicopterMovementComponent)
+		HELI_ERR("Trajectory predictor of %s has no helicopter movement to predict", *GetNameSafe(GetOwner()));
+
+	NumSteps = FMath::Clamp(NumSteps, 1, MaxNumSteps);
+
+	if(!ShouldPredict())
+		SetComponentTickEnabled(false);
+}
+
+void UHelicopterTrajectoryPredictorComponent::TickComponent(float DeltaTime, ELevelTick TickType,
+	FActorComponentTickFunction* ThisTickFunction)
+{
+	Super::TickComponent(DeltaTime, TickType, ThisTickFunction);
+
+	SCOPE_CYCLE_COUNTER(STAT_HeliTrajectoryPrediction);
+
+	NumStepsSimulatedLastTick = 0;
+
+	if(!HelicopterMovementComponent)
+		return;
+
+	const USceneComponent* UpdatedComponent = HelicopterMovementComponent->UpdatedComponent;
+	if(!UpdatedComponent || !HelicopterMovementComponent->IsFlightDataReady())
+		return;
+
+	const FHelicopterFlightModel Model = HelicopterMovementComponent->MakeFlightModel();
+
+	const FPredictionInputs NewInputs {
+		UpdatedComponent->GetUpVector(),
+		HelicopterMovementComponent->GetCurrentCollective(),
+		HelicopterMovementComponent->GetActualMass()
+	};
+
+	const double Now = GetWorld()->GetTimeSeconds();
+	const FVector Location = UpdatedComponent->GetComponentLocation();
+
+	const bool bHasPrediction = StartTime >= 0.0 && Now >= StartTime;
+	const int32 NumElapsedSteps = bHasPrediction ? FMath::FloorToInt32((Now - StartTime) / StepTime) : 0;
+
+	// Path is followed when helicopter is where prediction said it would be by now
+	const bool bCanReuse = bHasPrediction
+		&& NumElapsedSteps < NumSteps
+		&& !HaveInputsChanged(NewInputs)
+		&& FVector::DistSquared(GetLocationAtTimeFromStart(Now - StartTime), Location) <= FMath::Square(LocationTolerance);
+
+	if(bCanReuse)
+	{
+		AdvancePrediction(Model, NumElapsedSteps);
+		return;
+	}
+
+	Inputs = NewInputs;
+
+	Predict(Model, Location, UpdatedComponent->GetComponentVelocity(), Now);
+}
+
+TConstArrayView<FVector> UHelicopterTrajectoryPredictorComponent::GetPredictedPath() const
+{
+	return MakeArrayView(Locations.GetData(), NumSteps);
+}
+
+double UHelicopterTrajectoryPredictorComponent::GetPredictionStartTime() const
+{
+	return StartTime;
+}
+
+void UHelicopterTrajectoryPredictorComponent::GetPredictedLocations(TArray<FVector>& OutLocations) const
+{
+	OutLocations.Reset(NumSteps);
+	OutLocations.Append(Locations.GetData(), NumSteps);
+}
+
+FVector UHelicopterTrajectoryPredictorComponent::GetPredictedLocation(float TimeFromNow) const
+{
+	if(StartTime < 0.0)
+		return GetOwner()->GetActorLocation();
+
+	const float TimeFromStart = GetWorld()->GetTimeSeconds() - StartTime + FMath::Max(TimeFromNow, 0.f);
+
+	return GetLocationAtTimeFromStart(TimeFromStart);
+}
+
+float UHelicopterTrajectoryPredictorComponent::GetPredictionHorizon() const
+{
+	return NumSteps * StepTime;
+}
+
+void UHelicopterTrajectoryPredictorComponent::ResetPrediction()
+{
+	StartTime = -1.0;
+}
+
+int32 UHelicopterTrajectoryPredictorComponent::GetNumStepsSimulatedLastTick() const
+{
+	return NumStepsSimulatedLastTick;
+}
+
+bool UHelicopterTrajectoryPredictorComponent::ShouldPredict() const
+{
+	return HelicopterMovementComponent && (bPredictOnDedicatedServer || !IsNetMode(NM_DedicatedServer));
+}
+
+bool UHelicopterTrajectoryPredictorComponent::HaveInputsChanged(const FPredictionInputs& NewInputs) const
+{
+	const float MinUpDot = FMath::Cos(FMath::DegreesToRadians(AttitudeTolerance));
+
+	return FMath::Abs(NewInputs.Collective - Inputs.Collective) > CollectiveTolerance
+		|| NewInputs.UpVector.Dot(Inputs.UpVector) < MinUpDot
+		|| !FMath::IsNearlyEqual(NewInputs.MassKg, Inputs.MassKg);
+}
+
+FVector UHelicopterTrajectoryPredictorComponent::GetLocationAtTimeFromStart(float TimeFromStart) const
+{
+	// Start location is step -1, the path begins one step after it
+	const float Position = FMath::Clamp(TimeFromStart / StepTime, 0.f, static_cast<float>(NumSteps)) - 1.f;
+	const int32 Index = FMath::FloorToInt32(Position);
+	const float Alpha = Position - Index;
+
+	const FVector& From = Index < 0 ? StartLocation : Locations[Index];
+
+	if(Index + 1 >= NumSteps)
+		return From;
+
+	return FMath::Lerp(From, Locations[Index + 1], Alpha);
+}
+
+void UHelicopterTrajectoryPredictorComponent::Predict(const FHelicopterFlightModel& Model, const FVector& Location,
+	const FVector& Velocity, double Time)
+{
+	StartLocation = Location;
+	StartVelocity = Velocity;
+	StartTime = Time;
+
+	SimulateStep(Model, StartLocation, StartVelocity, Locations[0], Velocities[0]);
+
+	for(int32 Step = 1; Step < NumSteps; ++Step)
+	{
+		SimulateStep(Model, Locations[Step - 1], Velocities[Step - 1], Locations[Step], Velocities[Step]);
+	}
+
+	NumStepsSimulatedLastTick = NumSteps;
+}
+
+void UHelicopterTrajectoryPredictorComponent::AdvancePrediction(const FHelicopterFlightModel& Model, int32 NumElapsedSteps)
+{
+	if(NumElapsedSteps <= 0)
+		return;
+
+	StartLocation = Locations[NumElapsedSteps - 1];
+	StartVelocity = Velocities[NumElapsedSteps - 1];
+	StartTime += NumElapsedSteps * StepTime;
+
+	const int32 NumKeptSteps = NumSteps - NumElapsedSteps;
+
+	// Shifting a few dozen vectors is cheaper than wrapping every read of the path
+	FMemory::Memmove(&Locations[0], &Locations[NumElapsedSteps], NumKeptSteps * sizeof(FVector));
+	FMemory::Memmove(&Velocities[0], &Velocities[NumElapsedSteps], NumKeptSteps * sizeof(FVector));
+
+	for(int32 Step = NumKeptSteps; Step < NumSteps; ++Step)
+	{
+		const FVector& PreviousLocation = Step > 0 ? Locations[Step - 1] : StartLocation;
+		const FVector& PreviousVelocity = Step > 0 ? Velocities[Step - 1] : StartVelocity;
+
+		SimulateStep(Model, PreviousLocation, PreviousVelocity, Locations[Step], Velocities[Step]);
+	}
+
+	NumStepsSimulatedLastTick = NumElapsedSteps;
+}
+
+void UHelicopterTrajectoryPredictorComponent::SimulateStep(const FHelicopterFlightModel& Model, const FVector& Location,
+	const FVector& Velocity, FVector& OutLocation, FVector& OutVelocity) const
+{
+	OutVelocity = Model.StepVelocity(Velocity, Inputs.UpVector, Inputs.Collective, Inputs.MassKg, StepTime);
+
+	// Trapezoid keeps the path on the curve even with steps much longer than a tick
+	OutLocation = Location + (Velocity + OutVelocity) * (0.5f * StepTime);
+}
@@ -0,0 +1,132 @@
+﻿#pragma once
+
+#include "CoreMinimal.h"
+#include "Components/ActorComponent.h"
+#include "Containers/StaticArray.h"
+#include "HelicopterTrajectoryPredictorComponent.generated.h"
+
+class UHelicopterMovementComponent;
+struct FHelicopterFlightModel;
+
+/**
+ * Predicts where helicopter is going to be over the next seconds, for flight path marker, AI and landing guidance.
+ * Runs FHelicopterFlightModel forward with current collective and attitude held, without touching Chaos.
+ * Prediction is anchored at a point in time and kept while helicopter follows it: every elapsed step is dropped
+ * from the front and one new step is simulated at the end. It's redone from scratch only when inputs change
+ * or helicopter drifts away from it, so most ticks simulate one step or none.
+ * Nothing on dedicated server displays the path, so it doesn't predict there unless bPredictOnDedicatedServer is set.
+ */
+UCLASS(
+	ClassGroup=(Custom),
+	meta=(BlueprintSpawnableComponent),
+	HideCategories=(ComponentReplication, Replication, ComponentTick, Activation)
+)
+class HELI_API UHelicopterTrajectoryPredictorComponent : public UActorComponent
+{
+	GENERATED_BODY()
+
+public:
+
+	static constexpr int32 MaxNumSteps { 64 };
+
+	UHelicopterTrajectoryPredictorComponent();
+
+	virtual void TickComponent(float DeltaTime, ELevelTick TickType, FActorComponentTickFunction* ThisTickFunction) override;
+
+	// Locations StepTime apart, the first one is StepTime after GetPredictionStartTime. Always NumSteps long
+	TConstArrayView<FVector> GetPredictedPath() const;
+
+	// World time the predicted path starts at, it's never later than now and at most StepTime earlier
+	double GetPredictionStartTime() const;
+
+	UFUNCTION(BlueprintCallable)
+	void GetPredictedLocations(TArray<FVector>& OutLocations) const;
+
+	// Seconds from now, clamped to the prediction horizon
+	UFUNCTION(BlueprintCallable)
+	FVector GetPredictedLocation(float TimeFromNow) const;
+
+	UFUNCTION(BlueprintCallable)
+	float GetPredictionHorizon() const;
+
+	// Next tick predicts everything again, call it after teleports
+	UFUNCTION(BlueprintCallable)
+	void ResetPrediction();
+
+	int32 GetNumStepsSimulatedLastTick() const;
+
+	// False without movement to predict or on dedicated server, tick must stay off then
+	bool ShouldPredict() const;
+
+protected:
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=1, ClampMax=64))
+	int32 NumSteps { 30 };
+
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.01))
+	float StepTime { 0.1f };
+
+	// Prediction is redone when collective changes more than this
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float CollectiveTolerance { 0.02f };
+
+	// Prediction is redone when helicopter tilts more than this, in degrees
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float AttitudeTolerance { 1.f };
+
+	// Prediction is redone when helicopter is further than this from where prediction expects it, in cm
+	UPROPERTY(EditAnywhere, meta=(ClampMin=0.0))
+	float LocationTolerance { 100.f };
+
+	// For server side AI that reads the path
+	UPROPERTY(EditAnywhere)
+	bool bPredictOnDedicatedServer { false };
+
+	virtual void BeginPlay() override;
+
+private:
+
+	struct FPredictionInputs
+	{
+		FVector UpVector { FVector::UpVector };
+		float Collective { 0.f };
+		float MassKg { 0.f };
+	};
+
+	UPROPERTY(Transient)
+	TObjectPtr<UHelicopterMovementComponent> HelicopterMovementComponent {};
+
+	TStaticArray<FVector, MaxNumSteps> Locations { InPlace, FVector::ZeroVector };
+
+	TStaticArray<FVector, MaxNumSteps> Velocities { InPlace, FVector::ZeroVector };
+
+	FVector StartLocation { FVector::ZeroVector };
+
+	FVector StartVelocity { FVector::ZeroVector };
+
+	// Negative when there is no prediction
+	double StartTime { -1.0 };
+
+	FPredictionInputs Inputs {};
+
+	int32 NumStepsSimulatedLastTick { 0 };
+
+	bool HaveInputsChanged(const FPredictionInputs& NewInputs) const;
+
+	// Interpolated along the path, TimeFromStart is clamped to the horizon
+	FVector GetLocationAtTimeFromStart(float TimeFromStart) const;
+
+	void Predict(const FHelicopterFlightModel& Model, const FVector& Location, const FVector& Velocity, double Time);
+
+	// Drops steps that are in the past and simulates the same number of new ones at the end
+	void AdvancePrediction(const FHelicopterFlightModel& Model, int32 NumElapsedSteps);
+
+	void SimulateStep(
+		const FHelicopterFlightModel& Model,
+		const FVector& Location,
+		const FVector& Velocity,
+		FVector& OutLocation,
+		FVector& OutVelocity
+	) const;
+
+};